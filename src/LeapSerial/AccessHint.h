@@ -0,0 +1,17 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+
+namespace leap {
+  /// <summary>
+  /// Hint to the operating system about how a file will be accessed
+  /// </summary>
+  enum class AccessHint {
+    Normal,
+
+    // Pages are read in order, so the system may read ahead aggressively and drop pages once read
+    Sequential,
+
+    // Pages are read in no particular order, so read-ahead would be wasted
+    Random
+  };
+}
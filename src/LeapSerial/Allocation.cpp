@@ -2,10 +2,34 @@
 #include "stdafx.h"
 #include "Allocation.h"
 #include "field_serializer.h"
+#include <algorithm>
 
 using namespace leap;
 using namespace leap::internal;
 
+Arena::~Arena(void) {
+  for (auto cur = destructors.rbegin(); cur != destructors.rend(); ++cur)
+    cur->second(cur->first);
+}
+
+void* Arena::Allocate(size_t ncb, size_t align) {
+  size_t ncbPad = (align - reinterpret_cast<uintptr_t>(pCur) % align) % align;
+  if (ncbRemain < ncbPad + ncb) {
+    // Current block is exhausted, the next one is made large enough for this allocation at any alignment
+    size_t ncbBlock = std::max(ncbNextBlock, ncb + align);
+    blocks.emplace_back(new uint8_t[ncbBlock]);
+    pCur = blocks.back().get();
+    ncbRemain = ncbBlock;
+    ncbNextBlock *= 2;
+    ncbPad = (align - reinterpret_cast<uintptr_t>(pCur) % align) % align;
+  }
+
+  void* retVal = pCur + ncbPad;
+  pCur += ncbPad + ncb;
+  ncbRemain -= ncbPad + ncb;
+  return retVal;
+}
+
 AllocationBase::AllocationBase(void) {}
 
 AllocationBase::~AllocationBase(void) {
@@ -1,6 +1,8 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include "Archive.h"
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <utility>
 
@@ -9,6 +11,51 @@ namespace leap {
 }
 
 namespace leap { namespace internal {
+  /// <summary>
+  /// Bump-pointer allocator whose memory is all released at once
+  /// </summary>
+  /// <remarks>
+  /// Memory is carved out of a short list of blocks, each twice the size of the last.  Objects placed
+  /// in the arena are never freed individually; registered destructors are run in reverse order of
+  /// registration when the arena itself is destroyed.
+  /// </remarks>
+  class Arena {
+  public:
+    Arena(void) {}
+    Arena(const Arena&) = delete;
+    void operator=(const Arena&) = delete;
+    ~Arena(void);
+
+  private:
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+
+    // Unused part of the current block
+    uint8_t* pCur = nullptr;
+    size_t ncbRemain = 0;
+
+    // Size of the next block to be allocated
+    size_t ncbNextBlock = 4096;
+
+    // Objects to be destroyed when the arena goes away
+    std::vector<std::pair<void*, void(*)(void*)>> destructors;
+
+  public:
+    /// <returns>The number of blocks allocated so far</returns>
+    size_t BlockCount(void) const { return blocks.size(); }
+
+    /// <summary>
+    /// Allocates uninitialized memory with the specified size and alignment
+    /// </summary>
+    void* Allocate(size_t ncb, size_t align);
+
+    /// <summary>
+    /// Registers an object to be destroyed when the arena is destroyed
+    /// </summary>
+    void AddDestructor(void* pObj, void(*pfnDestroy)(void*)) {
+      destructors.push_back(std::make_pair(pObj, pfnDestroy));
+    }
+  };
+
   class AllocationBase {
   public:
     AllocationBase(void);
@@ -21,6 +68,10 @@ namespace leap { namespace internal {
     // together with the deleter for those types
     std::vector<std::pair<void*, void(*)(void*)>> garbageList;
 
+    // Arena that objects referenced by raw pointers are placed in, if the graph was deserialized in
+    // arena mode.  These objects are released all at once, together with the arena.
+    std::unique_ptr<Arena> arena;
+
     /// <summary>
     /// Retrieves a pointer to the so-called "root object," which should follow the allocation base immediately
     /// </summary>
@@ -6,9 +6,16 @@
 using namespace leap;
 
 OArchive::OArchive(IOutputStream& os):
-  os(os)
+  pOs(&os),
+  bound(pOs),
+  os(bound)
 {}
 
+void OArchive::Rebind(IOutputStream& os) {
+  Reset();
+  pOs = &os;
+}
+
 OArchiveRegistry::OArchiveRegistry(IOutputStream& os) :
   OArchive(os)
 {}
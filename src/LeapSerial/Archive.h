@@ -22,6 +22,8 @@ namespace leap {
 
   namespace internal {
     class AllocationBase;
+    class Arena;
+    class LazySource;
 
     // Utility type for maintaining stack-based state
     template<typename T>
@@ -80,10 +82,42 @@ namespace leap {
   class OArchive {
   public:
     OArchive(IOutputStream& os);
+    OArchive(const OArchive&) = delete;
     virtual ~OArchive(void) {}
 
   protected:
     // Underlying output stream
+    IOutputStream* pOs;
+
+  private:
+    // Forwards to whatever stream the archive is bound to at the time of the call
+    class BoundOutputStream :
+      public IOutputStream
+    {
+    public:
+      BoundOutputStream(IOutputStream* const& pOs) :
+        pOs(pOs)
+      {}
+
+    private:
+      IOutputStream* const& pOs;
+
+    public:
+      bool Write(const void* pBuf, std::streamsize ncb) override { return pOs->Write(pBuf, ncb); }
+      bool Write(const OutputSegment* pSegs, size_t nSegs) override { return pOs->Write(pSegs, nSegs); }
+      CopyResult Write(IInputStream& is, void* scratch, std::streamsize ncbScratch, std::streamsize& ncb) override { return pOs->Write(is, scratch, ncbScratch, ncb); }
+      void Flush(void) override { pOs->Flush(); }
+      std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override { return pOs->Reserve(ppBuf, ncbMin); }
+      bool Commit(std::streamsize ncb) override { return pOs->Commit(ncb); }
+      bool CanPatch(void) const override { return pOs->CanPatch(); }
+      std::streamoff WriteOffset(void) const override { return pOs->WriteOffset(); }
+      bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override { return pOs->Patch(off, pBuf, ncb); }
+    };
+    BoundOutputStream bound;
+
+  protected:
+    // Underlying output stream, as seen by archives written before Rebind existed.  It follows the archive
+    // when it is rebound, at the cost of one more virtual call per operation than pOs.
     IOutputStream& os;
 
   public:
@@ -101,7 +135,21 @@ namespace leap {
     /// JSON or XML; use of this routine is particularly dangerous in these cases because there is no
     /// guarantee that raw bytes written to the stream will not break standards complaince in the file.
     /// </remarks>
-    IOutputStream& GetStream(void) { return os; }
+    IOutputStream& GetStream(void) { return *pOs; }
+
+    /// <summary>
+    /// Discards all state retained from prior calls to WriteObject
+    /// </summary>
+    /// <remarks>
+    /// Tables and scratch buffers keep their capacity across a reset, so an archive that is reset and
+    /// reused reaches a steady state where writing an object does not allocate.
+    /// </remarks>
+    virtual void Reset(void) {}
+
+    /// <summary>
+    /// Resets the archive and directs all further output to the specified stream
+    /// </summary>
+    virtual void Rebind(IOutputStream& os);
 
     /// <summary>
     /// Writes the specified bytes as a string.
@@ -164,6 +212,67 @@ namespace leap {
     OArchiveRegistry(IOutputStream& os);
     virtual ~OArchiveRegistry(void) {}
 
+    /// <summary>
+    /// Marks a region where the objects being serialized are temporaries
+    /// </summary>
+    /// <remarks>
+    /// Accessor-based fields produce their values on the stack, and the address of such a value may be
+    /// reused by an unrelated value while the archive is still in use.  Nothing is considered stable while
+    /// a transient scope is held, even an object that the archive handed out itself.
+    /// </remarks>
+    struct transient_scope {
+      transient_scope(const transient_scope&) = delete;
+      transient_scope(const OArchiveRegistry& ar) :
+        ar(ar)
+      {
+        ar.m_transientDepth++;
+      }
+      ~transient_scope(void) { ar.m_transientDepth--; }
+
+      const OArchiveRegistry& ar;
+    };
+
+    /// <summary>
+    /// Marks the object that an archive is about to hand to a serializer as one that it found in the graph
+    /// </summary>
+    /// <remarks>
+    /// The root, referenced objects, the fields of a stable object, and the entries of a stable container
+    /// all keep their addresses until the archive is done with the root.  Archives only memoize state keyed
+    /// on the address of a stable object, so serial_traits that build temporaries and pass them on to other
+    /// serial_traits need not do anything special.  If stable is false, nothing is marked.
+    /// </remarks>
+    struct stable_scope {
+      stable_scope(const stable_scope&) = delete;
+      stable_scope(const OArchiveRegistry& ar, const void* pObj, bool stable = true) :
+        ar(ar),
+        prior(ar.m_pStable)
+      {
+        ar.m_pStable = stable ? pObj : nullptr;
+      }
+      ~stable_scope(void) { ar.m_pStable = prior; }
+
+      const OArchiveRegistry& ar;
+      const void* const prior;
+    };
+
+    /// <returns>
+    /// True if the archive is presently serializing temporaries
+    /// </returns>
+    bool IsTransient(void) const { return m_transientDepth != 0; }
+
+    /// <returns>
+    /// True if the specified object is the one most recently marked stable, and is not a temporary
+    /// </returns>
+    bool IsStable(const void* pObj) const { return pObj && pObj == m_pStable && !m_transientDepth; }
+
+  private:
+    // Number of transient scopes currently held
+    mutable size_t m_transientDepth = 0;
+
+    // Object most recently handed out by the archive that is known to keep its address
+    mutable const void* m_pStable = nullptr;
+
+  public:
     /// <summary>
     /// Registers an object for serialization, returning the ID that will be given to the object
     /// </summary>
@@ -235,6 +344,17 @@ namespace leap {
     /// </remarks>
     virtual ReleasedMemory ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) = 0;
 
+    /// <summary>
+    /// Reads a reference to an object that is not to be deserialized until it is first used
+    /// </summary>
+    /// <param name="source">Receives the source the object can later be loaded from, or nullptr for a null reference</param>
+    /// <param name="objId">Receives the identifier of the object in the source</param>
+    /// <returns>
+    /// True if the reference was read, false if this archive does not defer objects, in which case nothing
+    /// has been read and ReadObjectReferenceResponsible must be used instead.
+    /// </returns>
+    virtual bool ReadObjectReferenceLazy(std::shared_ptr<internal::LazySource>& source, uint32_t& objId) { return false; }
+
     /// <summary>
     /// Discards the specified number of bytes from the input stream
     /// </summary>
@@ -245,6 +365,23 @@ namespace leap {
     /// </returns>
     virtual uint64_t Count(void) const = 0;
 
+    /// <summary>
+    /// Discards all state retained from prior calls to ReadObject, including the read count
+    /// </summary>
+    /// <remarks>
+    /// Tables and scratch buffers keep their capacity across a reset, so an archive that is reset and
+    /// reused reaches a steady state where reading an object does not allocate.
+    /// </remarks>
+    virtual void Reset(void) {}
+
+    /// <summary>
+    /// Resets the archive and reads all further input from the specified stream
+    /// </summary>
+    /// <remarks>
+    /// Archives that cannot change streams throw std::runtime_error
+    /// </remarks>
+    virtual void Rebind(IInputStream& is) { throw std::runtime_error("Rebind is not supported by this archive"); }
+
     /// <summary>
     /// Reads a described object from the stream.
     /// </summary>
@@ -262,6 +399,21 @@ namespace leap {
     /// <param name="getBufferFn"> Function to get the buffer to write to, takes the size of the string as an argument </param>
     virtual void ReadString(std::function<void*(uint64_t)> getBufferFn, uint8_t charSize, uint64_t ncb) = 0;
 
+    /// <summary>
+    /// Reads out a string in place, without copying it, if the input allows it
+    /// </summary>
+    /// <param name="pBuf">Receives a pointer to the characters of the string</param>
+    /// <param name="count">Receives the number of characters in the string</param>
+    /// <returns>
+    /// True if the string was read, false if it could not be lent out, in which case nothing has been read
+    /// and ReadString must be used instead.
+    /// </returns>
+    /// <remarks>
+    /// A string is only lent out if it is held in memory that outlives the input stream, such as the
+    /// buffer underlying a BufferedInputStream.
+    /// </remarks>
+    virtual bool ReadStringRef(const void*& pBuf, uint64_t& count, uint8_t charSize, uint64_t ncb) { return false; }
+
     /// <summary>
     /// Reads out a length delimited array of an arbitrary type into the specified buffer.
     /// </summary>
@@ -98,10 +98,18 @@ OArchiveFlatbuffer::OArchiveFlatbuffer(leap::IOutputStream& os) :
   OArchiveRegistry(os)
 {}
 
+void OArchiveFlatbuffer::Reset() {
+  m_builder.clear();
+  m_vTables.clear();
+  m_largestAligned = 1;
+  m_currentFieldPtr = nullptr;
+  m_offsets.clear();
+}
+
 void OArchiveFlatbuffer::Finish() {
   //And copy the buffer backwards into the stream...
   for (auto dataIter = m_builder.rbegin(); dataIter != m_builder.rend(); dataIter++) {
-    os.Write((const char*)&*dataIter, 1);
+    pOs->Write((const char*)&*dataIter, 1);
   }
 }
 
@@ -339,6 +347,19 @@ IArchiveFlatbuffer::IArchiveFlatbuffer(std::istream& is) {
   is.read((char*)&m_data[0], m_data.size());
 }
 
+void IArchiveFlatbuffer::Reset() {
+  m_offset = 0;
+}
+
+void IArchiveFlatbuffer::Rebind(IInputStream& is) {
+  // Flatbuffers are addressed by offset, so the whole message has to be in memory before reading
+  m_data.clear();
+  uint8_t buf[1024];
+  for (std::streamsize ncb; (ncb = is.Read(buf, sizeof(buf))) > 0;)
+    m_data.insert(m_data.end(), buf, buf + ncb);
+  Reset();
+}
+
 void IArchiveFlatbuffer::Skip(uint64_t ncb) {
   throw not_implemented_exception();
 }
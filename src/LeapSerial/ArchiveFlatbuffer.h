@@ -37,6 +37,7 @@ namespace leap {
     void Finish();
 
     // OArchiveRegistry overrides
+    void Reset() override;
     void WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize = false) override;
     void WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) override;
     void WriteBool(bool value) override;
@@ -97,6 +98,8 @@ namespace leap {
 
     ReleasedMemory ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) override;
 
+    void Reset() override;
+    void Rebind(IInputStream& is) override;
     void Skip(uint64_t ncb) override;
     uint64_t Count(void) const override { return m_offset; }
 
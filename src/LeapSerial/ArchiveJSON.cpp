@@ -17,86 +17,99 @@ public:
 OArchiveJSON::OArchiveJSON(leap::OutputStreamAdapter& osa, bool escapeSlashes) :
   OArchiveRegistry(osa),
   EscapeSlashes(escapeSlashes),
-  os(osa.GetStdStream())
+  pStdOs(&osa.GetStdStream())
 {}
 
+void OArchiveJSON::Reset(void) {
+  currentTabLevel = 0;
+}
+
+void OArchiveJSON::Rebind(IOutputStream& os) {
+  // Output is formatted with iostreams, so only streams that wrap a std::ostream can be used here
+  auto* osa = dynamic_cast<OutputStreamAdapter*>(&os);
+  if (!osa)
+    throw std::invalid_argument("OArchiveJSON can only be bound to an OutputStreamAdapter");
+  OArchiveRegistry::Rebind(os);
+  pStdOs = &osa->GetStdStream();
+}
+
 void OArchiveJSON::WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize) {
   throw not_implemented_exception();
 }
 
 void OArchiveJSON::WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) {
-  os << '"';
+  *pStdOs << '"';
   if (charSize == 1) {
     for (const char* p = static_cast<const char*>(pBuf); charCount--; p++)
       switch (*p) {
       case '\\':
-        os << "\\\\";
+        *pStdOs << "\\\\";
         break;
       case '"':
-        os << "\\\"";
+        *pStdOs << "\\\"";
       default:
-        os << *p;
+        *pStdOs << *p;
         break;
       }
   }
   else
     throw not_implemented_exception{};
-  os << '"';
+  *pStdOs << '"';
 }
 
 void OArchiveJSON::WriteBool(bool value) {
   if (value)
-    os << "true";
+    *pStdOs << "true";
   else
-    os << "false";
+    *pStdOs << "false";
 }
 
 void OArchiveJSON::WriteInteger(int8_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(uint8_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(int16_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(uint16_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(int32_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(uint32_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(int64_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(uint64_t value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteInteger(int64_t value, uint8_t) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteFloat(float value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteFloat(double value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteFloat(long double value) {
-  os << value;
+  *pStdOs << value;
 }
 
 void OArchiveJSON::WriteObjectReference(const field_serializer& serializer, const void* pObj) {
@@ -109,10 +122,10 @@ void OArchiveJSON::WriteObject(const field_serializer& serializer, const void* p
 
 void OArchiveJSON::WriteDescriptor(const descriptor& descriptor, const void* pObj) {
   if (PrettyPrint) {
-    os << "{\n";
+    *pStdOs << "{\n";
   }
   else
-    os << "{";
+    *pStdOs << "{";
 
   currentTabLevel++;
 
@@ -120,60 +133,60 @@ void OArchiveJSON::WriteDescriptor(const descriptor& descriptor, const void* pOb
   for (const auto &field_descriptor : descriptor.field_descriptors) {
     if (PrettyPrint)
       TabOut();
-    os << "\"" << field_descriptor.name << "\":";
+    *pStdOs << "\"" << field_descriptor.name << "\":";
     if (PrettyPrint)
-      os << ' ';
+      *pStdOs << ' ';
 
     const void* pChildObj = pBase + field_descriptor.offset;
     field_descriptor.serializer.serialize(*this, pChildObj);
 
     if(PrettyPrint)
-      os << ",\n";
+      *pStdOs << ",\n";
     else
-      os << ",";
+      *pStdOs << ",";
   }
   if (!descriptor.field_descriptors.empty()) {
-    os.seekp(PrettyPrint ? -2 : -1, std::ios::cur); //Remove the trailing ","
+    pStdOs->seekp(PrettyPrint ? -2 : -1, std::ios::cur); //Remove the trailing ","
 
     // Reintroduce line break if needed
     if (PrettyPrint)
-      os << "\n";
+      *pStdOs << "\n";
   }
 
   for (const auto& iter : descriptor.identified_descriptors) {
     const auto& field_descriptor = iter.second;
     const void* pChildObj = static_cast<const char*>(pObj)+field_descriptor.offset;
-    os << "\"" << field_descriptor.name << "\":";
+    *pStdOs << "\"" << field_descriptor.name << "\":";
     if (PrettyPrint)
-      os << ' ';
+      *pStdOs << ' ';
     field_descriptor.serializer.serialize(*this, pChildObj);
-    os << (PrettyPrint ? ",\n" : ",");
+    *pStdOs << (PrettyPrint ? ",\n" : ",");
   }
   if (!descriptor.identified_descriptors.empty()) {
-    os.seekp(PrettyPrint ? -2 : -1, std::ios::cur); //Remove the trailing ","
+    pStdOs->seekp(PrettyPrint ? -2 : -1, std::ios::cur); //Remove the trailing ","
 
     // Reintroduce line break if needed
     if (PrettyPrint)
-      os << "\n";
+      *pStdOs << "\n";
   }
 
   currentTabLevel--;
 
   if (PrettyPrint)
     TabOut();
-  os << '}';
+  *pStdOs << '}';
 }
 
 void OArchiveJSON::WriteArray(IArrayReader&& ary) {
-  os << '[';
+  *pStdOs << '[';
   if (ary.size() != 0) {
     ary.serializer.serialize(*this, ary.get(0));
     for(size_t i = 1; i < ary.size(); i++) {
-      os << ',';
+      *pStdOs << ',';
       ary.serializer.serialize(*this, ary.get(i));
     }
   }
-  os << ']';
+  *pStdOs << ']';
 }
 
 void OArchiveJSON::WriteDictionary(IDictionaryReader&& dictionary)
@@ -218,16 +231,22 @@ uint64_t OArchiveJSON::SizeDictionary(IDictionaryReader&& dictionary) const
 void OArchiveJSON::TabOut(void) const {
   if (TabWidth)
     for (size_t i = TabWidth * (currentTabLevel + TabLevel); i--;)
-      os << ' ';
+      *pStdOs << ' ';
   else
     for (size_t i = currentTabLevel + TabLevel; i--;)
-      os << '\t';
+      *pStdOs << '\t';
 }
 
 IArchiveJSON::IArchiveJSON(std::istream& is) {
 
 }
 
+void IArchiveJSON::Reset(void) {}
+
+void IArchiveJSON::Rebind(IInputStream& is) {
+  throw not_implemented_exception();
+}
+
 void IArchiveJSON::Skip(uint64_t ncb) {
   throw not_implemented_exception();
 }
@@ -24,6 +24,8 @@ namespace leap {
     size_t TabWidth = 0;
 
     // OArchiveRegistry overrides
+    void Reset(void) override;
+    void Rebind(IOutputStream& os) override;
     void WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize = false) override;
     void WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) override;
     void WriteBool(bool value) override;
@@ -61,7 +63,7 @@ namespace leap {
   private:
     // Current tab level, if pretty printing is turned on, otherwise ignored
     size_t currentTabLevel = 0;
-    std::ostream& os;
+    std::ostream* pStdOs;
 
     // Prints TabLevel spaces to the output stream
     void TabOut(void) const;
@@ -76,6 +78,8 @@ namespace leap {
     void ReadObject(const field_serializer& sz, void* pObj, internal::AllocationBase* pOwner) override;
     ReleasedMemory ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) override;
 
+    void Reset(void) override;
+    void Rebind(IInputStream& is) override;
     void Skip(uint64_t ncb) override;
     uint64_t Count(void) const override { return 0; }
 
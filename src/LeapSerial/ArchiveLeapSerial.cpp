@@ -5,37 +5,197 @@
 #include "ProtobufType.h"
 #include "field_serializer.h"
 #include "Descriptor.h"
+#include "lazy_ptr.h"
 #include "Utility.hpp"
+#include <algorithm>
 #include <iostream>
+#include <memory.h>
 #include <sstream>
 
 using namespace leap;
+using leap::internal::Plan;
 
-IArchiveLeapSerial::IArchiveLeapSerial(IInputStream& is) :
-  is(is)
-{
-  // This sentry addition means we never have to test objId against zero
-  objMap[0] = { nullptr, nullptr };
+// Width of the placeholder written for a length prefix when backpatching
+static const size_t sc_ncbLengthSlot = 5;
+
+// Heap order for pending deserialization tasks, which puts the smallest identifier on top
+static bool IsLater(const IArchiveLeapSerial::deserialization_task& lhs, const IArchiveLeapSerial::deserialization_task& rhs) {
+  return lhs.id > rhs.id;
+}
+
+// Width of a single element of a packed array of the specified type, or zero if the type cannot be packed
+static size_t PackedWidth(serial_atom atom) {
+  switch (atom) {
+  case serial_atom::boolean:
+  case serial_atom::i8:
+  case serial_atom::ui8:
+    return 1;
+  case serial_atom::i16:
+  case serial_atom::ui16:
+    return 2;
+  case serial_atom::i32:
+  case serial_atom::ui32:
+  case serial_atom::f32:
+    return 4;
+  case serial_atom::i64:
+  case serial_atom::ui64:
+  case serial_atom::f64:
+    return 8;
+  case serial_atom::f80:
+    return sizeof(long double);
+  default:
+    return 0;
+  }
+}
+
+// Width of an integer type that is written as a varint, or zero if the type is not written as a varint
+static size_t VarintWidth(serial_atom atom) {
+  switch (atom) {
+  case serial_atom::i8:
+  case serial_atom::ui8:
+  case serial_atom::i16:
+  case serial_atom::ui16:
+  case serial_atom::i32:
+  case serial_atom::ui32:
+  case serial_atom::i64:
+  case serial_atom::ui64:
+    return PackedWidth(atom);
+  default:
+    return 0;
+  }
+}
+
+// Loads an integer field, widened the same way serial_traits widens integers for WriteInteger
+template<typename T>
+static int64_t Load(const void* pField) {
+  return (int64_t)*static_cast<const T*>(pField);
 }
 
+// Stores a decoded varint into an integer field
+template<typename T>
+static void Store(void* pField, uint64_t value) {
+  *static_cast<T*>(pField) = static_cast<T>(value);
+}
+
+// Size of the read-ahead buffer used by IArchiveLeapSerial
+static const size_t sc_ncbReadAhead = 4096;
+
+// Number of values that are batch encoded or decoded at a time
+static const size_t sc_nBatch = 256;
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Stream offsets of the records of a lazily read graph, and the objects loaded from them so far
+    /// </summary>
+    class LazyIndex:
+      public LazySource,
+      public std::enable_shared_from_this<LazyIndex>
+    {
+    public:
+      LazyIndex(std::shared_ptr<IInputStream> is) :
+        is(std::move(is))
+      {}
+
+      // Stream that the records are read from
+      const std::shared_ptr<IInputStream> is;
+
+      // Offsets of the records in the stream, indexed by identifier.  There is no record zero.
+      std::vector<std::streampos> offsets;
+
+      // Offset just past the last record of the graph, or -1 if the graph has not been indexed yet
+      std::streampos end = -1;
+
+      // Objects held by shared pointers, so that each is only loaded once for as long as it is in use
+      std::unordered_map<uint32_t, std::weak_ptr<void>> loaded;
+
+      // Owner of objects that were loaded for a lazy_ptr and are referred to by plain pointers
+      AllocationBase alloc;
+
+      std::shared_ptr<void> Find(uint32_t objId) const {
+        auto q = loaded.find(objId);
+        return q == loaded.end() ? nullptr : q->second.lock();
+      }
+
+      std::shared_ptr<void> Load(IArchive::ReleasedMemory(*pfnAlloc)(), const field_serializer& serializer, uint32_t objId) override {
+        std::shared_ptr<void> retVal = Find(objId);
+        if (retVal)
+          return retVal;
+        if (objId >= offsets.size())
+          throw std::runtime_error("Lazy reference to an object that is not in the stream");
+
+        IArchive::ReleasedMemory mem = pfnAlloc();
+        loaded[objId] = mem.pContext;
+
+        // Whoever else is reading the stream must find it where they left it
+        const std::streampos pos = is->Tell();
+        try {
+          is->Seek(offsets[objId]);
+          IArchiveLeapSerial ar(*is);
+          ar.pIndex = shared_from_this();
+          ar.rootID = objId;
+          ar.ReadObject(serializer, mem.pObject, &alloc);
+        }
+        catch (...) {
+          is->Clear();
+          is->Seek(pos);
+          throw;
+        }
+        is->Seek(pos);
+        return mem.pContext;
+      }
+    };
+  }
+}
+
+IArchiveLeapSerial::IArchiveLeapSerial(IInputStream& is) :
+  pIs(&is)
+{}
+
 IArchiveLeapSerial::IArchiveLeapSerial(std::istream& is) :
-  is(*new InputStreamAdapter{ is }),
-  pIsMem(&this->is),
+  pIs(new InputStreamAdapter{ is }),
+  pIsMem(pIs),
   pfnDtor([](void* ptr) {
     delete (InputStreamAdapter*)ptr;
   })
-{
-  // This sentry addition means we never have to test objId against zero
-  objMap[0] = { nullptr, nullptr };
-}
+{}
 
 IArchiveLeapSerial::~IArchiveLeapSerial(void) {
+  try {
+    Unread();
+  }
+  catch (...) {
+    // The stream could not take back bytes we read ahead, nothing more we can do
+  }
   if(pfnDtor)
     pfnDtor(pIsMem);
   ClearObjectTable();
 }
 
 void IArchiveLeapSerial::ReadObject(const field_serializer& sz, void* pObj, internal::AllocationBase* pOwner) {
+  internal::Pusher<internal::Arena*> pa(pArena);
+  pArena = pOwner ? pOwner->arena.get() : nullptr;
+
+  internal::Pusher<bool> ps(skipped);
+  skipped = false;
+
+  internal::Pusher<std::shared_ptr<internal::LazyIndex>> pi(pIndex);
+  if (Lazy && !pIndex) {
+    // Each graph gets its own index, because identifiers start over with every graph
+    std::streampos pos = Position();
+    if (pos >= 0) {
+      // Objects are loaded after this archive is gone, so the index needs its own adapter if we own ours
+      std::shared_ptr<IInputStream> is;
+      if (pIs == pIsMem)
+        is = std::make_shared<InputStreamAdapter>(*static_cast<InputStreamAdapter*>(pIs));
+      else
+        is = std::shared_ptr<IInputStream>(pIs, [](IInputStream*) {});
+
+      pIndex = std::make_shared<internal::LazyIndex>(std::move(is));
+      pIndex->offsets.resize(2, -1);
+      pIndex->offsets[1] = pos;
+    }
+  }
   Process(
     deserialization_task(
       &sz,
@@ -65,6 +225,18 @@ void* IArchiveLeapSerial::ReadObjectReference(const create_delete& cd,  const le
   return Lookup(cd, sz, objId);
 }
 
+bool IArchiveLeapSerial::ReadObjectReferenceLazy(std::shared_ptr<internal::LazySource>& source, uint32_t& objId) {
+  if (!pIndex)
+    return false;
+
+  ReadByteArray(&objId, sizeof(objId));
+  if (objId)
+    source = pIndex;
+  else
+    source.reset();
+  return true;
+}
+
 IArchive::ReleasedMemory IArchiveLeapSerial::ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) {
   // Object ID, then directed registration:
   uint32_t objId;
@@ -77,33 +249,96 @@ IArchive::ReleasedMemory IArchiveLeapSerial::ReadObjectReferenceResponsible(Rele
   return Release(pfnAlloc, sz, objId);
 }
 
+IArchiveLeapSerial::entry& IArchiveLeapSerial::Entry(uint32_t objId) {
+  if (rootID != 1) {
+    // Object loaded from the middle of an indexed graph, identifiers are sparse
+    if (objId >= pIndex->offsets.size())
+      throw std::runtime_error("Object identifier is out of range");
+    if (slots.empty()) {
+      objTable.resize(1);
+      objTable[0].pObject = pRoot;
+      slots[rootID] = 0;
+    }
+
+    auto q = slots.emplace(objId, static_cast<uint32_t>(objTable.size()));
+    if (q.second)
+      objTable.emplace_back();
+    return objTable[q.first->second];
+  }
+
+  // Identifiers are issued in the order references are written, and every reference occupies four
+  // bytes, so an identifier larger than this cannot have come from a well-formed stream
+  if (objId > m_count / sizeof(uint32_t) + 1)
+    throw std::runtime_error("Object identifier is out of range");
+
+  if (objTable.size() <= objId) {
+    if (objTable.empty()) {
+      // First reference in this stream, the root object must now be findable
+      objTable.resize(2);
+      objTable[1].pObject = pRoot;
+    }
+    if (objTable.size() <= objId)
+      objTable.resize(objId + 1);
+  }
+  return objTable[objId];
+}
+
 void* IArchiveLeapSerial::Lookup(const create_delete& cd, const field_serializer& serializer, uint32_t objId) {
-  auto q = objMap.find(objId);
-  if (q != objMap.end())
-    return q->second.pObject;
+  if (!objId)
+    return nullptr;
+
+  entry& e = Entry(objId);
+  if (e.pObject)
+    return e.pObject;
 
   // Not yet initialized, allocate and queue up
-  auto& entry = objMap[objId];
-  entry.pObject = cd.pfnAlloc();
-  entry.pfnFree = cd.pfnFree;
-  work.push(deserialization_task(&serializer, objId, entry.pObject));
-  return entry.pObject;
+  if (pArena) {
+    e.pObject = cd.pfnConstruct(pArena->Allocate(cd.size, cd.align));
+    e.inArena = true;
+    if (cd.pfnDestroy)
+      pArena->AddDestructor(e.pObject, cd.pfnDestroy);
+  }
+  else {
+    e.pObject = cd.pfnAlloc();
+    e.pfnFree = cd.pfnFree;
+  }
+  Enqueue(deserialization_task(&serializer, objId, e.pObject));
+  return e.pObject;
+}
+
+void IArchiveLeapSerial::ReadField(const Plan::Op& op, void* pField, uint64_t ncb) {
+  switch (op.code) {
+  case Plan::Opcode::i8: Store<int8_t>(pField, IArchiveLeapSerial::ReadInteger(1)); break;
+  case Plan::Opcode::ui8: Store<uint8_t>(pField, IArchiveLeapSerial::ReadInteger(1)); break;
+  case Plan::Opcode::i16: Store<int16_t>(pField, IArchiveLeapSerial::ReadInteger(2)); break;
+  case Plan::Opcode::ui16: Store<uint16_t>(pField, IArchiveLeapSerial::ReadInteger(2)); break;
+  case Plan::Opcode::i32: Store<int32_t>(pField, IArchiveLeapSerial::ReadInteger(4)); break;
+  case Plan::Opcode::ui32: Store<uint32_t>(pField, IArchiveLeapSerial::ReadInteger(4)); break;
+  case Plan::Opcode::i64: Store<int64_t>(pField, IArchiveLeapSerial::ReadInteger(8)); break;
+  case Plan::Opcode::ui64: Store<uint64_t>(pField, IArchiveLeapSerial::ReadInteger(8)); break;
+  case Plan::Opcode::boolean: *static_cast<bool*>(pField) = IArchiveLeapSerial::ReadBool(); break;
+  case Plan::Opcode::f32: IArchiveLeapSerial::ReadByteArray(pField, sizeof(float)); break;
+  case Plan::Opcode::f64: IArchiveLeapSerial::ReadByteArray(pField, sizeof(double)); break;
+  case Plan::Opcode::object: ReadPlan(*op.child, pField, ncb); break;
+  case Plan::Opcode::generic: op.serializer->deserialize(*this, pField, ncb); break;
+  }
 }
 
 void IArchiveLeapSerial::ReadDescriptor(const descriptor& descriptor, void* pObj, uint64_t ncb) {
+  ReadPlan(Plan::Get(descriptor), pObj, ncb);
+}
+
+void IArchiveLeapSerial::ReadPlan(const Plan& plan, void* pObj, uint64_t ncb) {
   uint64_t countLimit = Count() + ncb;
-  for (const auto& field_descriptor : descriptor.field_descriptors)
-    field_descriptor.serializer.deserialize(
-      *this,
-      static_cast<char*>(pObj)+field_descriptor.offset,
-      0
-    );
+  for (size_t i = 0; i < plan.nPositional; i++)
+    ReadField(plan.ops[i], static_cast<char*>(pObj) + plan.ops[i].offset, 0);
 
   if (!ncb)
     // Impossible for there to be more fields, we don't have a sizer
     return;
 
   // Identified fields, read them in
+  size_t hint = plan.nPositional;
   while (Count() < countLimit) {
     // Ident/type field first
     uint64_t ident = ReadInteger(sizeof(uint64_t));
@@ -126,22 +361,20 @@ void IArchiveLeapSerial::ReadDescriptor(const descriptor& descriptor, void* pObj
     }
 
     // See if we can find the descriptor for this field:
-    auto q = descriptor.identified_descriptors.find(ident >> 3);
-    if (q == descriptor.identified_descriptors.end())
+    const Plan::Op* op = plan.Find(ident >> 3, hint);
+    if (!op)
       // Unrecognized field, need to skip
       if (static_cast<Protobuf::serial_type>(ident & 7) == Protobuf::serial_type::varint)
         // Just read a varint in that we discard right away
         ReadInteger(sizeof(uint64_t));
-      else
+      else {
         // Skip the requisite number of bytes
         Skip(static_cast<size_t>(ncbChild));
+        skipped = true;
+      }
     else
       // Hand off to child class
-      q->second.serializer.deserialize(
-        *this,
-        static_cast<char*>(pObj)+q->second.offset,
-        static_cast<size_t>(ncbChild)
-      );
+      ReadField(*op, static_cast<char*>(pObj) + op->offset, static_cast<size_t>(ncbChild));
   }
 
   if (Count() > countLimit) {
@@ -156,24 +389,95 @@ void IArchiveLeapSerial::ReadArray(IArrayAppender&& ary) {
   uint32_t nEntries;
   ReadByteArray(&nEntries, sizeof(nEntries));
   uint32_t n = nEntries & 0x7FFFFFFF;
-  ary.reserve(n);
 
   if(nEntries & 0x80000000) {
     // Counted-size fields
-    for (size_t i = n; i--;)
-      ary.serializer.deserialize(
-        *this,
-        ary.allocate(),
-        ReadInteger(8)
-      );
+    ary.reserve(n);
+    ReadEntries(ary, n, true);
+  }
+  else if (nEntries & 0x40000000) {
+    // Packed fields, element width followed by a single block of raw elements
+    n &= 0x3FFFFFFF;
+    ary.reserve(n);
+
+    uint8_t width;
+    ReadByteArray(&width, sizeof(width));
+    if (width != PackedWidth(ary.serializer.type()))
+      throw std::runtime_error("Packed array element width does not match the destination element type");
+    if (!n)
+      return;
+
+    void* pDest = ary.allocate_raw(n);
+    if (!pDest)
+      throw std::runtime_error("Packed arrays can only be read into contiguous arrays of arithmetic types");
+    ReadByteArray(pDest, static_cast<uint64_t>(n) * width);
+
+    // The stream may hold any byte at all, but a bool may only hold zero or one
+    if (ary.serializer.type() == serial_atom::boolean) {
+      uint8_t* pBytes = static_cast<uint8_t*>(pDest);
+      for (uint32_t i = 0; i < n; i++)
+        pBytes[i] = pBytes[i] ? 1 : 0;
+    }
   }
   else {
     // Fixed-size fields, just read everything in
-    for (size_t i = n; i--;)
-      ary.serializer.deserialize(*this, ary.allocate(), 0);
+    ary.reserve(n);
+    if (ReadIntegerArray(ary, n))
+      return;
+    ReadEntries(ary, n, false);
   }
 }
 
+void IArchiveLeapSerial::ReadEntries(IArrayAppender& ary, uint32_t n, bool counted) {
+  if (!n)
+    return;
+
+  // One allocation for the whole array if the container supports it, otherwise one per entry
+  size_t stride = 0;
+  uint8_t* pEntry = static_cast<uint8_t*>(ary.allocate_n(n, stride));
+  for (size_t i = n; i--; pEntry += stride) {
+    uint64_t ncb = counted ? ReadInteger(8) : 0;
+    ary.serializer.deserialize(*this, pEntry ? pEntry : ary.allocate(), ncb);
+  }
+}
+
+bool IArchiveLeapSerial::ReadIntegerArray(IArrayAppender& ary, uint32_t n) {
+  const size_t width = VarintWidth(ary.serializer.type());
+  if (!width)
+    return false;
+  if (!n)
+    return true;
+
+  uint8_t* pDest = static_cast<uint8_t*>(ary.allocate_raw(n));
+  if (!pDest)
+    return false;
+
+  uint8_t buf[sc_nBatch];
+  uint64_t vals[sc_nBatch];
+  size_t ncbBuf = 0;
+  for (size_t remain = n; remain;) {
+    // Every remaining value needs at least one more byte, including any value that is partially
+    // buffered, so reading one byte per remaining value can never read past the end of the array
+    size_t ncbRead = std::min(remain, sizeof(buf) - ncbBuf);
+    ReadByteArray(buf + ncbBuf, ncbRead);
+    ncbBuf += ncbRead;
+
+    size_t ncbUsed;
+    const size_t nBatch = std::min(remain, sc_nBatch);
+    size_t nDecoded = FromBase128(buf, ncbBuf, vals, nBatch, ncbUsed);
+    if (nDecoded < nBatch && ncbBuf - ncbUsed >= 10)
+      throw std::runtime_error("Malformed varint encountered in an integer array");
+
+    NarrowIntegers(vals, nDecoded, pDest, width);
+    pDest += nDecoded * width;
+    remain -= nDecoded;
+
+    ncbBuf -= ncbUsed;
+    memmove(buf, buf + ncbUsed, ncbBuf);
+  }
+  return true;
+}
+
 void IArchiveLeapSerial::ReadString(std::function<void*(uint64_t)> getBufferFn, uint8_t charSize, uint64_t ncb) {
   // Read the number of entries first:
   uint32_t nEntries;
@@ -184,6 +488,24 @@ void IArchiveLeapSerial::ReadString(std::function<void*(uint64_t)> getBufferFn,
   ReadByteArray(pBuf, nEntries * charSize);
 }
 
+bool IArchiveLeapSerial::ReadStringRef(const void*& pBuf, uint64_t& count, uint8_t charSize, uint64_t ncb) {
+  // Strings can only be lent out of memory that will still be there once we are done with the stream
+  uint32_t nEntries;
+  if (!pIs->CanRetain() || !Borrow(sizeof(nEntries)))
+    return false;
+  memcpy(&nEntries, pCur, sizeof(nEntries));
+
+  const uint64_t ncbString = sizeof(nEntries) + static_cast<uint64_t>(nEntries) * charSize;
+  if (!Borrow(ncbString))
+    return false;
+
+  pBuf = pCur + sizeof(nEntries);
+  count = nEntries;
+  pCur += ncbString;
+  m_count += ncbString;
+  return true;
+}
+
 void IArchiveLeapSerial::ReadDictionary(IDictionaryInserter&& dictionary)
 {
   // Read the number of entries first:
@@ -199,51 +521,187 @@ void IArchiveLeapSerial::ReadDictionary(IDictionaryInserter&& dictionary)
 }
 
 IArchive::ReleasedMemory IArchiveLeapSerial::Release(ReleasedMemory(*pfnAlloc)(), const field_serializer& serializer, uint32_t objId) {
-  auto q = objMap.find(objId);
-  if (q != objMap.end()) {
+  if (!objId)
+    return{ nullptr, nullptr };
+
+  entry& e = Entry(objId);
+  if (e.inArena)
+    throw std::runtime_error("An object placed in an arena cannot also be owned by a smart pointer");
+  if (e.pObject) {
     // Object already allocated, we just need to remove control back to ourselves
-    q->second.pfnFree = nullptr;
-    return {q->second.pObject, q->second.pContext};
+    e.pfnFree = nullptr;
+    return{ e.pObject, e.pContext };
+  }
+
+  if (pIndex) {
+    // Shared objects of an indexed graph might have been loaded already
+    std::shared_ptr<void> loaded = pIndex->Find(objId);
+    if (loaded) {
+      e.pObject = loaded.get();
+      e.pContext = loaded;
+      return{ e.pObject, e.pContext };
+    }
   }
 
   // Not yet initialized, allocate and queue up
-  auto& entry = objMap[objId];
   IArchive::ReleasedMemory retVal = pfnAlloc();
-  entry.pObject = retVal.pObject;
-  entry.pContext = retVal.pContext;
-  entry.pfnFree = nullptr;
-  work.push(deserialization_task(&serializer, objId, entry.pObject));
+  e.pObject = retVal.pObject;
+  e.pContext = retVal.pContext;
+  e.pfnFree = nullptr;
+  if (pIndex)
+    pIndex->loaded[objId] = retVal.pContext;
+  Enqueue(deserialization_task(&serializer, objId, e.pObject));
   return retVal;
 }
 
 bool IArchiveLeapSerial::IsReleased(uint32_t objId) {
-  auto q = objMap.find(objId);
-  return q != objMap.end() && !q->second.pfnFree;
+  if (!objId)
+    return false;
+
+  const entry& e = Entry(objId);
+  return e.pObject && !e.pfnFree && !e.inArena;
 }
 
 void IArchiveLeapSerial::ReadByteArray(void* pBuf, uint64_t ncb) {
-  std::streamsize nRead = is.Read(pBuf, ncb);
+  if (ncb <= static_cast<uint64_t>(pEnd - pCur)) {
+    memcpy(pBuf, pCur, static_cast<size_t>(ncb));
+    pCur += ncb;
+    m_count += ncb;
+    return;
+  }
+
+  // Take what we have, then either refill or go to the stream for the rest
+  // There may be no window at all yet, in which case pCur is null
+  const size_t ncbHave = pEnd - pCur;
+  if (ncbHave) {
+    memcpy(pBuf, pCur, ncbHave);
+    pCur = pEnd;
+    m_count += ncbHave;
+    pBuf = static_cast<uint8_t*>(pBuf) + ncbHave;
+    ncb -= ncbHave;
+  }
+  Settle();
+
+  if (ncb <= ncbRecordRemain) {
+    if (!Borrow(ncb) && ncb < sc_ncbReadAhead) {
+      if (!readAhead)
+        readAhead.reset(new uint8_t[sc_ncbReadAhead]);
+
+      std::streamsize nRead = pIs->Read(readAhead.get(), static_cast<std::streamsize>(std::min<uint64_t>(sc_ncbReadAhead, ncbRecordRemain)));
+      if (nRead < static_cast<std::streamsize>(ncb))
+        throw std::runtime_error("End of file reached prematurely");
+      ncbRecordRemain -= nRead;
+      pCur = readAhead.get();
+      pEnd = pCur + nRead;
+    }
+
+    if (pCur != pEnd) {
+      memcpy(pBuf, pCur, static_cast<size_t>(ncb));
+      pCur += ncb;
+      m_count += ncb;
+      return;
+    }
+  }
+
+  // Large reads, and reads outside of any record, go straight to the stream
+  std::streamsize nRead = pIs->Read(pBuf, ncb);
   if(nRead != ncb)
     throw std::runtime_error("End of file reached prematurely");
+  ncbRecordRemain -= std::min(ncbRecordRemain, ncb);
   m_count += ncb;
 }
 
+bool IArchiveLeapSerial::Borrow(uint64_t ncb) {
+  if (pBorrowed) {
+    if (ncb <= static_cast<uint64_t>(pEnd - pCur))
+      return true;
+
+    // Hand back the rest of the window, the stream might lend us a larger one starting here
+    Settle();
+  }
+  else if (pCur != pEnd)
+    // Bytes in the read-ahead buffer come first
+    return false;
+
+  if (ncb > ncbRecordRemain)
+    return false;
+
+  // Streams that already hold the record in memory lend it to us, so we can parse it in place
+  const void* pContiguous;
+  uint64_t ncbWindow = static_cast<uint64_t>(pIs->GetContiguous(&pContiguous));
+  if (ncbWindow < ncb)
+    return false;
+
+  ncbWindow = std::min(ncbWindow, ncbRecordRemain);
+  ncbRecordRemain -= ncbWindow;
+  pBorrowed = pCur = static_cast<const uint8_t*>(pContiguous);
+  pEnd = pCur + ncbWindow;
+  return true;
+}
+
+void IArchiveLeapSerial::Settle(void) {
+  if (!pBorrowed)
+    return;
+
+  // Only what we actually used is taken from the stream, the rest of the window goes back
+  pIs->Consume(pCur - pBorrowed);
+  ncbRecordRemain += pEnd - pCur;
+  pBorrowed = nullptr;
+  pCur = pEnd = nullptr;
+}
+
+void IArchiveLeapSerial::Unread(void) {
+  Settle();
+  const std::streamoff ncb = pEnd - pCur;
+  pCur = pEnd = nullptr;
+  ncbRecordRemain = 0;
+  if (!ncb)
+    return;
+
+  std::streampos pos = pIs->Tell();
+  if (pos >= 0)
+    pIs->Seek(pos - ncb);
+}
+
 void IArchiveLeapSerial::Skip(uint64_t ncb) {
-  is.Skip(ncb);
+  m_count += ncb;
+  if (ncb <= static_cast<uint64_t>(pEnd - pCur)) {
+    pCur += ncb;
+    return;
+  }
+
+  ncb -= pEnd - pCur;
+  pCur = pEnd;
+  Settle();
+  pIs->Skip(ncb);
+  ncbRecordRemain -= std::min(ncbRecordRemain, ncb);
+}
+
+void IArchiveLeapSerial::Reset(void) {
+  Unread();
+  ClearObjectTable();
+  work.clear();
+  m_count = 0;
+}
+
+void IArchiveLeapSerial::Rebind(IInputStream& is) {
+  Reset();
+  pIs = &is;
 }
 
 void IArchiveLeapSerial::Transfer(internal::AllocationBase& alloc) {
-  for (auto& cur : objMap)
-    if (cur.second.pfnFree)
+  for (auto& cur : objTable)
+    if (cur.pfnFree)
       // Transfer cleanup responsibility to the allocator
       alloc.garbageList.push_back(
         std::make_pair(
-          cur.second.pObject,
-          cur.second.pfnFree
+          cur.pObject,
+          cur.pfnFree
         )
       );
 
-  objMap.clear();
+  objTable.clear();
+  slots.clear();
 }
 
 bool IArchiveLeapSerial::ReadBool() {
@@ -253,41 +711,88 @@ bool IArchiveLeapSerial::ReadBool() {
 }
 
 uint64_t IArchiveLeapSerial::ReadInteger(uint8_t) {
-  size_t ncb = 0;
-  uint8_t buf[10];
-  do ReadByteArray(&buf[ncb], 1);
-  while (buf[ncb++] & 0x80);
-  return leap::FromBase128(buf, ncb);
+  if (pEnd - pCur < 10) {
+    // Varint might run past the end of what we have buffered, take it one byte at a time
+    size_t ncb = 0;
+    uint8_t buf[10];
+    do {
+      if (ncb == sizeof(buf))
+        throw std::runtime_error("Malformed varint encountered");
+      ReadByteArray(&buf[ncb], 1);
+    } while (buf[ncb++] & 0x80);
+    return leap::FromBase128(buf, ncb);
+  }
+
+  // One and two byte varints cover field headers, lengths, and most small integers
+  const uint8_t* p = pCur;
+  uint64_t retVal = p[0];
+  if (!(p[0] & 0x80)) {
+    pCur += 1;
+    m_count += 1;
+    return retVal;
+  }
+  retVal = (retVal & 0x7F) | static_cast<uint64_t>(p[1] & 0x7F) << 7;
+  if (!(p[1] & 0x80)) {
+    pCur += 2;
+    m_count += 2;
+    return retVal;
+  }
+
+  size_t i = 2;
+  for (; i < 10; i++) {
+    retVal |= static_cast<uint64_t>(p[i] & 0x7F) << (7 * i);
+    if (!(p[i] & 0x80))
+      break;
+  }
+  if (i == 10)
+    throw std::runtime_error("Malformed varint encountered");
+  pCur += i + 1;
+  m_count += i + 1;
+  return retVal;
 }
 
 size_t IArchiveLeapSerial::ClearObjectTable(void) {
   size_t n = 0;
-  for (auto& cur : objMap)
-    if (cur.second.pfnFree) {
+  for (auto& cur : objTable)
+    if (cur.pfnFree) {
       // One more entry freed
       n++;
 
       // Transfer cleanup responsibility to the allocator
-      cur.second.pfnFree(cur.second.pObject);
+      cur.pfnFree(cur.pObject);
     }
 
-  objMap.clear();
+  objTable.clear();
+  slots.clear();
   return n;
 }
 
-void IArchiveLeapSerial::Process(const deserialization_task& task) {
-  objMap[1] = {task.pObject, nullptr};
-  work.push(task);
+void IArchiveLeapSerial::Enqueue(const deserialization_task& task) {
+  work.push_back(task);
+  std::push_heap(work.begin(), work.end(), IsLater);
+}
 
-  // Continue to work as long as there is work to be done
-  for(; !work.empty(); work.pop()) {
-    deserialization_task& task = work.front();
+void IArchiveLeapSerial::ReadRecord(const deserialization_task& task) {
+  // A record that we have already passed over can only be read by going back for it, after which we
+  // return to where we were
+  std::streampos resume = -1;
+  if (task.id && task.id <= lastRecord && !pIndex) {
+    auto q = pPassed->find(task.id);
+    if (q == pPassed->end())
+      throw std::runtime_error("The record of a referenced object was passed over before the reference to it was read");
+    resume = Position();
+    SeekRecord(q->second);
+  }
 
+  uint64_t id;
+  uint64_t ncb;
+  for (;;) {
     // Identifier/type comes first
+    const uint64_t count = m_count;
     auto id_type = ReadInteger(8);
 
     // Then we need the size (if it's available)
-    uint64_t ncb = 0;
+    ncb = 0;
     switch (static_cast<Protobuf::serial_type>(id_type & 7)) {
     case Protobuf::serial_type::b32:
       ncb = 4;
@@ -304,44 +809,303 @@ void IArchiveLeapSerial::Process(const deserialization_task& task) {
       break;
     }
 
-    task.serializer->deserialize(*this, task.pObject, ncb);
+    // Records are written in order of identifier, and are asked for in the same order.  Objects only
+    // referred to from fields that were skipped are never asked for, and their records must be passed
+    // over, but we note where they were in case something we have yet to read refers to them as well.
+    id = id_type >> 3;
+    if (!task.id || id == task.id)
+      break;
+    if (id > task.id)
+      throw std::runtime_error("The record of a referenced object was passed over before the reference to it was read");
+    const std::streampos pos = Position();
+    if (pos >= 0)
+      (*pPassed)[static_cast<uint32_t>(id)] = pos - static_cast<std::streamoff>(m_count - count);
+    Skip(ncb);
+  }
+  if (resume < 0)
+    lastRecord = static_cast<uint32_t>(id);
+
+  // We may now read ahead, but only as far as the end of this record.  Whatever follows the record
+  // belongs to the next reader of the stream, so it must still be there when we are done.
+  const uint64_t ncbHave = pEnd - pCur;
+  ncbRecordRemain = ncb > ncbHave ? ncb - ncbHave : 0;
+
+  task.serializer->deserialize(*this, task.pObject, ncb);
+
+  if (resume >= 0)
+    SeekRecord(resume);
+}
+
+void IArchiveLeapSerial::Process(const deserialization_task& task) {
+  // The root is read directly, and only enters the object table if something refers to it
+  internal::Pusher<void*> p(pRoot);
+  pRoot = task.pObject;
+
+  // Identifiers start over with every graph
+  std::unordered_map<uint32_t, std::streampos> passed;
+  internal::Pusher<std::unordered_map<uint32_t, std::streampos>*> pp(pPassed);
+  pPassed = &passed;
+  internal::Pusher<uint32_t> pl(lastRecord);
+  lastRecord = 0;
+
+  ReadRecord(task);
+
+  // Lazy graph.  The first pass indexes the rest of the graph, after which only the records that are
+  // needed right away are read, each one found through the index.
+  const bool indexing = pIndex && pIndex->end < 0;
+  if (indexing)
+    pIndex->end = ScanRecords(2);
+
+  // Continue to work as long as there is work to be done.  References may be found in any order, but
+  // taking the smallest identifier first means that we read forward through the stream.
+  while (!work.empty()) {
+    std::pop_heap(work.begin(), work.end(), IsLater);
+    const deserialization_task next = work.back();
+    work.pop_back();
+
+    if (pIndex) {
+      if (next.id >= pIndex->offsets.size())
+        throw std::runtime_error("Object identifier is out of range");
+      SeekRecord(pIndex->offsets[next.id]);
+    }
+    ReadRecord(next);
+  }
+
+  if (!pIndex) {
+    // Skipped fields might have referred to objects whose records come after the last one read
+    if (skipped && Position() >= 0)
+      ScanRecords(lastRecord + 1);
+  }
+  else if (indexing)
+    // Leave the stream at the end of the graph, where the next reader expects it
+    SeekRecord(pIndex->end);
+}
+
+std::streampos IArchiveLeapSerial::Position(void) {
+  Settle();
+  std::streampos pos = pIs->Tell();
+  return pos < 0 ? pos : pos - static_cast<std::streamoff>(pEnd - pCur);
+}
+
+void IArchiveLeapSerial::SeekRecord(std::streampos pos) {
+  Settle();
+  pCur = pEnd = nullptr;
+  ncbRecordRemain = 0;
+  pIs->Seek(pos);
+}
+
+std::streampos IArchiveLeapSerial::ScanRecords(uint32_t id) {
+  // Records following the root carry sequential identifiers, and the next graph in the stream, if
+  // any, starts over with a root record of its own
+  for (;; id++) {
+    const std::streampos pos = Position();
+    uint8_t b;
+    if (pIs->Read(&b, 1) != 1) {
+      // End of the stream
+      pIs->Clear();
+      SeekRecord(pos);
+      return pos;
+    }
+    SeekRecord(pos);
+
+    const uint64_t count = m_count;
+    const uint64_t header = ReadInteger(8);
+    if (header != ((static_cast<uint64_t>(id) << 3) | static_cast<uint32_t>(Protobuf::serial_type::string))) {
+      // Belongs to whatever comes next
+      m_count = count;
+      SeekRecord(pos);
+      return pos;
+    }
+
+    if (pIndex)
+      pIndex->offsets.push_back(pos);
+    Skip(ReadInteger(8));
   }
 }
 
 
 OArchiveLeapSerial::OArchiveLeapSerial(IOutputStream& os) :
   OArchiveRegistry(os)
-{
-  objMap[nullptr] = 0;
-}
+{}
 
 OArchiveLeapSerial::~OArchiveLeapSerial(void) {
+  Release();
   if (pfnDtor)
     pfnDtor(pOsMem);
 }
 
+void OArchiveLeapSerial::Reset(void) {
+  objMap.Clear();
+  deferred.clear();
+  lastID = 0;
+  sizeCache.Clear();
+  Release();
+  ncbBuffered = 0;
+}
+
 void OArchiveLeapSerial::WriteSize(uint32_t sz) {
-  os.Write(&sz, sizeof(uint32_t));
+  Emit(&sz, sizeof(uint32_t));
+}
+
+void OArchiveLeapSerial::Emit(const void* pBuf, size_t ncb) {
+  if (!ncb)
+    return;
+  if (ncbWindow - ncbBuffered < ncb) {
+    if (buffering && BufferSize < ncb) {
+      // Too large to be worth staging, send it straight through in the same write as whatever is staged
+      // ahead of it, which is usually its length prefix.  Bytes staged in space that the stream lent us
+      // are committed first, and are then already at the head of the stream's own gather write.
+      OutputSegment segs[2];
+      size_t nSegs = 0;
+      if (reserved)
+        pOs->Commit(ncbBuffered);
+      else if (ncbBuffered)
+        segs[nSegs++] = { pWindow, static_cast<std::streamsize>(ncbBuffered) };
+      segs[nSegs++] = { pBuf, static_cast<std::streamsize>(ncb) };
+      pOs->Write(segs, nSegs);
+      reserved = false;
+      pWindow = nullptr;
+      ncbWindow = 0;
+      ncbBuffered = 0;
+      return;
+    }
+    if (!Claim(ncb)) {
+      // Not buffering, or too large to be worth staging, send it straight through
+      pOs->Write(pBuf, ncb);
+      return;
+    }
+  }
+  memcpy(pWindow + ncbBuffered, pBuf, ncb);
+  ncbBuffered += ncb;
+}
+
+uint8_t* OArchiveLeapSerial::Claim(size_t ncb) {
+  if (ncbWindow - ncbBuffered >= ncb)
+    return pWindow + ncbBuffered;
+
+  FlushBuffer();
+  if (!buffering || BufferSize < ncb)
+    return nullptr;
+
+  // Streams that can lend us space at their end save us a copy out of our own buffer
+  void* pReserved;
+  std::streamsize ncbReserved = pOs->Reserve(&pReserved, BufferSize);
+  if (ncbReserved > 0) {
+    pWindow = static_cast<uint8_t*>(pReserved);
+    ncbWindow = static_cast<size_t>(ncbReserved);
+    reserved = true;
+    return pWindow;
+  }
+
+  if (ncbBuffer != BufferSize) {
+    buffer.reset(new uint8_t[BufferSize]);
+    ncbBuffer = BufferSize;
+  }
+  pWindow = buffer.get();
+  ncbWindow = ncbBuffer;
+  return pWindow;
+}
+
+void OArchiveLeapSerial::FlushBuffer(void) {
+  if (reserved)
+    pOs->Commit(ncbBuffered);
+  else if (ncbBuffered)
+    pOs->Write(pWindow, ncbBuffered);
+  reserved = false;
+  pWindow = nullptr;
+  ncbWindow = 0;
+  ncbBuffered = 0;
+}
+
+void OArchiveLeapSerial::Release(void) {
+  if (reserved)
+    pOs->Commit(0);
+  reserved = false;
+  pWindow = nullptr;
+  ncbWindow = 0;
+  ncbBuffered = 0;
+}
+
+std::streamoff OArchiveLeapSerial::ReserveLength(void) {
+  std::streamoff off = WriteOffset();
+  uint8_t slot[sc_ncbLengthSlot] = {};
+  Emit(slot, sizeof(slot));
+  return off;
+}
+
+void OArchiveLeapSerial::PatchLength(std::streamoff off) {
+  uint64_t ncb = static_cast<uint64_t>(WriteOffset() - off) - sc_ncbLengthSlot;
+
+  uint8_t slot[sc_ncbLengthSlot];
+  if (!ToBase128Padded(ncb, slot, sizeof(slot)))
+    throw std::runtime_error("Object is too large to be written with a backpatched length prefix");
+
+  // Placeholders are staged or flushed as a unit, so the placeholder is either entirely in our
+  // buffer or entirely in the output stream
+  std::streamoff base = pOs->WriteOffset();
+  if (base <= off)
+    memcpy(pWindow + (off - base), slot, sizeof(slot));
+  else if (!pOs->Patch(off, slot, sizeof(slot)))
+    throw std::runtime_error("Output stream refused to patch a length prefix");
 }
 
 uint32_t OArchiveLeapSerial::RegisterObject(const field_serializer& serializer, const void*pObj) {
-  auto q = objMap.find(pObj);
-  if (q == objMap.end()) {
+  if (!pObj)
+    return 0;
+
+  if (pRoot) {
+    // First reference written during this call to WriteObject, the root must now be findable
+    if (!objMap.Find(pRoot))
+      objMap.Insert(pRoot, rootID);
+    pRoot = nullptr;
+  }
+
+  uint32_t id = objMap.Find(pObj);
+  if (!id) {
     // Obtain a new identifier
-    ++lastID;
+    id = ++lastID;
 
     // Need to register this object for serialization
-    deferred.push(work(lastID, &serializer, pObj));
+    deferred.push_back(work(id, &serializer, pObj));
 
-    // Now set the ID that we will be returning to the user and tracking later
-    q = objMap.emplace(pObj, lastID).first;
+    // Now track the ID that we will be returning to the user
+    objMap.Insert(pObj, id);
   }
-  return q->second;
+  return id;
 }
 
 void OArchiveLeapSerial::WriteObject(const field_serializer& serializer, const void* pObj) {
-  RegisterObject(serializer, pObj);
-  Process(); //Write the newly registered object immediately
+  internal::SizeCache::Scope memoize(sizeCache);
+  internal::Pusher<bool> p(backpatching);
+  internal::Pusher<bool> pb(buffering);
+  backpatching = Backpatch && pOs->CanPatch();
+  buffering = BufferSize != 0;
+
+  // Each outermost call produces a self-contained record, the reader expects the root to be
+  // identifier 1 and knows nothing of identifiers issued for earlier records
+  internal::Pusher<bool> pw(writing);
+  const bool outermost = !writing;
+  if (outermost) {
+    objMap.Clear();
+    lastID = 0;
+    Release();
+  }
+  writing = true;
+
+  // The root is written directly, and only enters the identity map if something refers to it
+  internal::Pusher<const void*> pr(pRoot);
+  internal::Pusher<uint32_t> pid(rootID);
+  pRoot = pObj;
+  rootID = ++lastID;
+  {
+    // The outermost root belongs to the caller, but a nested root may be a temporary that a serializer
+    // built on the stack
+    stable_scope ss(*this, pObj, outermost || IsStable(pObj));
+    WriteRecord(work(rootID, &serializer, pObj));
+  }
+
+  Process(); //Write any objects that were referenced by the root
+  FlushBuffer();
 }
 
 void OArchiveLeapSerial::WriteObjectReference(const field_serializer& serializer, const void* pObj) {
@@ -350,81 +1114,117 @@ void OArchiveLeapSerial::WriteObjectReference(const field_serializer& serializer
 }
 
 void OArchiveLeapSerial::WriteDescriptor(const descriptor& descriptor, const void* pObj) {
-  // Stationary descriptors first:
-  for (const auto& field_descriptor : descriptor.field_descriptors)
-    field_descriptor.serializer.serialize(
-      *this,
-      static_cast<const char*>(pObj)+field_descriptor.offset
-    );
-
-  // Then variable descriptors:
-  for (const auto& cur : descriptor.identified_descriptors) {
-    const auto& identified_descriptor = cur.second;
-    const void* pChildObj = static_cast<const char*>(pObj)+identified_descriptor.offset;
+  WritePlan(Plan::Get(descriptor), pObj);
+}
+
+void OArchiveLeapSerial::WritePlan(const Plan& plan, const void* pObj) {
+  const bool stable = IsStable(pObj);
+  for (const Plan::Op& op : plan.ops) {
+    const void* pField = static_cast<const char*>(pObj) + op.offset;
+    stable_scope ss(*this, pField, stable);
+    if (!op.ncbTag) {
+      // Stationary field, nothing precedes it
+      WriteField(op, pField);
+      continue;
+    }
 
     // Has identifier, need to write out the ID with the type and then the payload
-    auto type = Protobuf::GetSerialType(identified_descriptor.serializer.type());
-    WriteInteger(
-      (identified_descriptor.identifier << 3) | static_cast<int>(type),
-      sizeof(int)
-    );
+    Emit(op.tag, op.ncbTag);
 
     // Decide whether this is a counted sequence or not:
-    switch (type) {
-    case Protobuf::serial_type::string:
+    if (op.counted) {
+      if (backpatching) {
+        // Counted string, but we will go back and fill in the size once we know it
+        std::streamoff off = ReserveLength();
+        WriteField(op, pField);
+        PatchLength(off);
+        continue;
+      }
+
       // Counted string, write the size first
-      WriteInteger((int64_t)identified_descriptor.serializer.size(*this, pChildObj), sizeof(uint64_t));
-      break;
-    default:
-      // Nothing else requires that the size be written
-      break;
+      OArchiveLeapSerial::WriteInteger((int64_t)SizeField(op, pField), sizeof(uint64_t));
     }
 
     // Now handoff to serialization proper
-    identified_descriptor.serializer.serialize(*this, pChildObj);
+    WriteField(op, pField);
+  }
+}
+
+void OArchiveLeapSerial::WriteField(const Plan::Op& op, const void* pField) {
+  switch (op.code) {
+  case Plan::Opcode::i8: OArchiveLeapSerial::WriteInteger(Load<int8_t>(pField), 1); break;
+  case Plan::Opcode::ui8: OArchiveLeapSerial::WriteInteger(Load<uint8_t>(pField), 1); break;
+  case Plan::Opcode::i16: OArchiveLeapSerial::WriteInteger(Load<int16_t>(pField), 2); break;
+  case Plan::Opcode::ui16: OArchiveLeapSerial::WriteInteger(Load<uint16_t>(pField), 2); break;
+  case Plan::Opcode::i32: OArchiveLeapSerial::WriteInteger(Load<int32_t>(pField), 4); break;
+  case Plan::Opcode::ui32: OArchiveLeapSerial::WriteInteger(Load<uint32_t>(pField), 4); break;
+  case Plan::Opcode::i64: OArchiveLeapSerial::WriteInteger(Load<int64_t>(pField), 8); break;
+  case Plan::Opcode::ui64: OArchiveLeapSerial::WriteInteger(Load<uint64_t>(pField), 8); break;
+  case Plan::Opcode::boolean: OArchiveLeapSerial::WriteBool(*static_cast<const bool*>(pField)); break;
+  case Plan::Opcode::f32: Emit(pField, sizeof(float)); break;
+  case Plan::Opcode::f64: Emit(pField, sizeof(double)); break;
+  case Plan::Opcode::object: WritePlan(*op.child, pField); break;
+  case Plan::Opcode::generic: op.serializer->serialize(*this, pField); break;
   }
 }
 
 uint64_t OArchiveLeapSerial::SizeDescriptor(const descriptor& descriptor, const void* pObj) const {
-  uint64_t retVal = 0;
-  for (const auto& field_descriptor : descriptor.field_descriptors)
-    retVal += field_descriptor.serializer.size(
-      *this,
-      static_cast<const char*>(pObj)+field_descriptor.offset
-    );
-
-  for (const auto& cur : descriptor.identified_descriptors) {
-    const auto& identified_descriptor = cur.second;
-
-    // Need the type of the child object and its size proper
-    uint64_t ncbChild =
-      identified_descriptor.serializer.size(
-        *this,
-        static_cast<const char*>(pObj) + identified_descriptor.offset
-      );
+  // Every ancestor of this object will ask for its size, so we try to only compute it once.  Only an
+  // object that we found in the graph ourselves is sure to hold the same contents the next time we see
+  // its address.
+  const bool memoize = IsStable(pObj);
+  uint64_t retVal;
+  if (memoize && sizeCache.Find(descriptor, pObj, retVal))
+    return retVal;
+
+  retVal = SizePlan(Plan::Get(descriptor), pObj);
+  return memoize ? sizeCache.Insert(descriptor, pObj, retVal) : retVal;
+}
 
-    // Add the size required to encode type information and identity information to the
-    // size proper of the child object
-    const auto type = Protobuf::GetSerialType(identified_descriptor.serializer.type());
-    retVal +=
-      leap::serial_traits<uint32_t>::size(
-        *this,
-        (identified_descriptor.identifier << 3) | static_cast<int>(type)
-      ) +
-      ncbChild;
-
-    if (type == Protobuf::serial_type::string)
+uint64_t OArchiveLeapSerial::SizePlan(const Plan& plan, const void* pObj) const {
+  uint64_t retVal = 0;
+  const bool stable = IsStable(pObj);
+  for (const Plan::Op& op : plan.ops) {
+    // Need the size proper of the field
+    const void* pField = static_cast<const char*>(pObj) + op.offset;
+    stable_scope ss(*this, pField, stable);
+    uint64_t ncbChild = SizeField(op, pField);
+
+    // Add the size required to encode type information and identity information, which
+    // is zero for stationary fields
+    retVal += op.ncbTag + ncbChild;
+
+    if (op.ncbTag && op.counted)
       // Need to know the size-of-the-size
-      retVal += leap::serial_traits<uint64_t>::size(*this, ncbChild);
+      retVal += leap::SizeBase128(ncbChild);
   }
   return retVal;
 }
 
+uint64_t OArchiveLeapSerial::SizeField(const Plan::Op& op, const void* pField) const {
+  switch (op.code) {
+  case Plan::Opcode::i8: return leap::SizeBase128(Load<int8_t>(pField));
+  case Plan::Opcode::ui8: return leap::SizeBase128(Load<uint8_t>(pField));
+  case Plan::Opcode::i16: return leap::SizeBase128(Load<int16_t>(pField));
+  case Plan::Opcode::ui16: return leap::SizeBase128(Load<uint16_t>(pField));
+  case Plan::Opcode::i32: return leap::SizeBase128(Load<int32_t>(pField));
+  case Plan::Opcode::ui32: return leap::SizeBase128(Load<uint32_t>(pField));
+  case Plan::Opcode::i64: return leap::SizeBase128(Load<int64_t>(pField));
+  case Plan::Opcode::ui64: return leap::SizeBase128(Load<uint64_t>(pField));
+  case Plan::Opcode::boolean: return 1;
+  case Plan::Opcode::f32: return sizeof(float);
+  case Plan::Opcode::f64: return sizeof(double);
+  case Plan::Opcode::object: return OArchiveLeapSerial::SizeDescriptor(*op.desc, pField);
+  case Plan::Opcode::generic: break;
+  }
+  return op.serializer->size(*this, pField);
+}
+
 void OArchiveLeapSerial::WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize) {
   if(writeSize)
     WriteSize((uint32_t)ncb);
 
-  os.Write(pBuf, ncb);
+  Emit(pBuf, static_cast<size_t>(ncb));
 }
 
 void OArchiveLeapSerial::WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) {
@@ -434,7 +1234,7 @@ void OArchiveLeapSerial::WriteString(const void* pBuf, uint64_t charCount, uint8
 
 void OArchiveLeapSerial::WriteBool(bool value) {
   uint8_t v = value ? 1 : 0;
-  WriteByteArray(&v, 1);
+  Emit(&v, 1);
 }
 
 void OArchiveLeapSerial::WriteInteger(int64_t value, uint8_t) {
@@ -442,28 +1242,58 @@ void OArchiveLeapSerial::WriteInteger(int64_t value, uint8_t) {
   if (value) {
     // Write out our composed varint
     const auto arr = ToBase128(value, ncb);
-    WriteByteArray(arr.data(), ncb);
+    Emit(arr.data(), ncb);
   }
   else
     // Just write one byte of zero
-    WriteByteArray(&ncb, 1);
+    Emit(&ncb, 1);
 }
 
 void OArchiveLeapSerial::WriteArray(IArrayReader&& ary) {
   uint32_t n = (uint32_t)ary.size();
+  const bool stable = IsStable(ary.object());
 
   if(ary.immutable_size()) {
+    const void* pData = ary.data();
+    const uint8_t width = static_cast<uint8_t>(ary.immutable_size());
+    if (Pack && pData && width == PackedWidth(ary.serializer.type())) {
+      // The top two bits are reserved to signal the array mode
+      if (n & 0xC0000000)
+        throw std::runtime_error("Cannot serialize packed arrays of more than 0x3FFFFFFF entries");
+
+      // OR with 0x40000000 to signal that the elements follow as a single raw block
+      WriteSize(n | 0x40000000);
+      Emit(&width, sizeof(width));
+      Emit(pData, static_cast<size_t>(n) * width);
+      return;
+    }
+
+    // The high bit is reserved to signal mode 2
     if (n & 0x80000000)
       throw std::runtime_error("Cannot serialize fixed arrays of more than 0x7FFFFFFF bytes");
+
     WriteSize(n);
-    for (uint32_t i = 0; i < n; i++)
-      ary.serializer.serialize(*this, ary.get(i));
+    if (WriteIntegerArray(ary))
+      return;
+    for (uint32_t i = 0; i < n; i++) {
+      const void* const pObj = ary.get(i);
+      stable_scope ss(*this, pObj, stable);
+      ary.serializer.serialize(*this, pObj);
+    }
   }
   else {
     // OR with 0x80000000 to signal mode 2 for array writing
     WriteSize(n | 0x80000000);
     for (uint32_t i = 0; i < n; i++) {
       const void* const pObj = ary.get(i);
+      stable_scope ss(*this, pObj, stable);
+      if (backpatching) {
+        std::streamoff off = ReserveLength();
+        ary.serializer.serialize(*this, pObj);
+        PatchLength(off);
+        continue;
+      }
+
       uint64_t ncb = ary.serializer.size(*this, pObj);
       WriteInteger(ncb);
       ary.serializer.serialize(*this, pObj);
@@ -471,18 +1301,52 @@ void OArchiveLeapSerial::WriteArray(IArrayReader&& ary) {
   }
 }
 
+bool OArchiveLeapSerial::WriteIntegerArray(IArrayReader& ary) {
+  const serial_atom atom = ary.serializer.type();
+  const size_t width = VarintWidth(atom);
+  const uint8_t* pData = static_cast<const uint8_t*>(ary.data());
+  if (!width || !pData || width != ary.immutable_size())
+    return false;
+
+  const bool isSigned =
+    atom == serial_atom::i8 ||
+    atom == serial_atom::i16 ||
+    atom == serial_atom::i32 ||
+    atom == serial_atom::i64;
+
+  uint64_t vals[sc_nBatch];
+  uint8_t buf[sc_nBatch * 10];
+  for (size_t i = 0, n = ary.size(); i < n;) {
+    size_t nBatch = std::min(n - i, sc_nBatch);
+    WidenIntegers(pData + i * width, nBatch, width, isSigned, vals);
+
+    // Encode in place if the batch fits in the window, otherwise stage it here
+    if (uint8_t* pDest = Claim(nBatch * 10))
+      ncbBuffered += ToBase128(vals, nBatch, pDest);
+    else
+      Emit(buf, ToBase128(vals, nBatch, buf));
+    i += nBatch;
+  }
+  return true;
+}
+
 uint64_t OArchiveLeapSerial::SizeArray(IArrayReader&& ary) const {
   uint64_t sz = sizeof(uint32_t);
   size_t n = ary.size();
 
-  if (ary.immutable_size())
-    for (size_t i = 0; i < n; i++)
-      sz += ary.serializer.size(*this, ary.get(i));
-  else
-    for (size_t i = 0; i < n; i++) {
-      uint64_t ncb = ary.serializer.size(*this, ary.get(i));
-      sz += ncb + SizeInteger(ncb, 8);
-    }
+  if (ary.immutable_size()) {
+    const size_t width = ary.immutable_size();
+    if (Pack && ary.data() && width == PackedWidth(ary.serializer.type()))
+      return sz + sizeof(uint8_t) + n * width;
+  }
+
+  const bool stable = IsStable(ary.object());
+  for (size_t i = 0; i < n; i++) {
+    const void* const pObj = ary.get(i);
+    stable_scope ss(*this, pObj, stable);
+    uint64_t ncb = ary.serializer.size(*this, pObj);
+    sz += ary.immutable_size() ? ncb : ncb + SizeInteger(ncb, 8);
+  }
   return sz;
 }
 
@@ -491,9 +1355,16 @@ void OArchiveLeapSerial::WriteDictionary(IDictionaryReader&& dictionary)
   uint32_t n = static_cast<uint32_t>(dictionary.size());
   WriteSize((uint32_t)n);
 
+  const bool stable = IsStable(dictionary.object());
   while (dictionary.next()) {
-    dictionary.key_serializer.serialize(*this, dictionary.key());
-    dictionary.value_serializer.serialize(*this, dictionary.value());
+    {
+      stable_scope ss(*this, dictionary.key(), stable);
+      dictionary.key_serializer.serialize(*this, dictionary.key());
+    }
+    {
+      stable_scope ss(*this, dictionary.value(), stable);
+      dictionary.value_serializer.serialize(*this, dictionary.value());
+    }
     if (!n--)
       break;
   }
@@ -505,9 +1376,16 @@ uint64_t OArchiveLeapSerial::SizeDictionary(IDictionaryReader&& dictionary) cons
 {
   uint64_t retVal = sizeof(uint32_t);
   size_t n = dictionary.size();
+  const bool stable = IsStable(dictionary.object());
   while (dictionary.next()) {
-    retVal += dictionary.key_serializer.size(*this, dictionary.key());
-    retVal += dictionary.value_serializer.size(*this, dictionary.value());
+    {
+      stable_scope ss(*this, dictionary.key(), stable);
+      retVal += dictionary.key_serializer.size(*this, dictionary.key());
+    }
+    {
+      stable_scope ss(*this, dictionary.value(), stable);
+      retVal += dictionary.value_serializer.size(*this, dictionary.value());
+    }
     if (!n--)
       break;
   }
@@ -520,20 +1398,34 @@ uint64_t OArchiveLeapSerial::SizeInteger(int64_t value, uint8_t) const {
   return leap::SizeBase128(value);
 }
 
-void OArchiveLeapSerial::Process(void) {
-  for (; !deferred.empty(); deferred.pop()) {
-    work& w = deferred.front();
-
-    // Write the expected size first in a string-type field.  Identifier first, string
-    // type, then the length
-    WriteInteger(
-      (w.id << 3) |
-      static_cast<uint32_t>(Protobuf::serial_type::string),
-      sizeof(uint32_t)
-    );
-    WriteInteger(w.serializer->size(*this, w.pObj), sizeof(uint32_t));
-
-    // Now hand off to this type's serialization behavior
+void OArchiveLeapSerial::WriteRecord(work w) {
+  // Write the expected size first in a string-type field.  Identifier first, string
+  // type, then the length
+  WriteInteger(
+    (w.id << 3) |
+    static_cast<uint32_t>(Protobuf::serial_type::string),
+    sizeof(uint32_t)
+  );
+
+  if (backpatching) {
+    std::streamoff off = ReserveLength();
     w.serializer->serialize(*this, w.pObj);
+    PatchLength(off);
+    return;
+  }
+
+  WriteInteger(w.serializer->size(*this, w.pObj), sizeof(uint32_t));
+
+  // Now hand off to this type's serialization behavior
+  w.serializer->serialize(*this, w.pObj);
+}
+
+void OArchiveLeapSerial::Process(void) {
+  // Writing one object may queue up others, so entries are copied out rather than referenced
+  for (size_t i = 0; i < deferred.size(); i++) {
+    // Referenced objects are never temporaries, they must outlive the root to be written at all
+    stable_scope ss(*this, deferred[i].pObj);
+    WriteRecord(deferred[i]);
   }
+  deferred.clear();
 }
@@ -1,12 +1,20 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include "Archive.h"
-#include <queue>
+#include "IdentityMap.h"
+#include "Plan.h"
+#include "SizeCache.h"
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 namespace leap {
   struct create_delete;
 
+  namespace internal {
+    class LazyIndex;
+  }
+
   class OArchiveLeapSerial:
     public OArchiveRegistry
   {
@@ -14,6 +22,21 @@ namespace leap {
     OArchiveLeapSerial(IOutputStream& os);
     virtual ~OArchiveLeapSerial(void);
 
+    // Backpatch flag.  If set, and if the output stream supports patching, length prefixes are
+    // written as fixed-width placeholders and filled in after the object has been written.  This
+    // eliminates the sizing pass at the cost of a few bytes of padding per length prefix.
+    bool Backpatch = false;
+
+    // Pack flag.  If set, fixed-size arrays of arithmetic elements held in contiguous storage are
+    // written as a single block of raw elements, which the reader copies straight into place.  Readers
+    // that predate this encoding cannot read it, and such arrays are then limited to 0x3FFFFFFF entries.
+    bool Pack = false;
+
+    // Size of the write-combining buffer.  Writes made during WriteObject are staged in a buffer of
+    // this size and handed to the output stream in blocks, rather than making a call to Write for
+    // each field.  Setting this to zero causes every write to go straight to the output stream.
+    size_t BufferSize = 4096;
+
   protected:
     // If any additional (flat) memory was required to construct the output stream reference, this is it
     void* const pOsMem = nullptr;
@@ -41,20 +64,108 @@ namespace leap {
 
     // Map of objects (as we encounter them) to their identifiers.  We use this
     // to reconcile cycles
-    std::unordered_map<const void*, uint32_t> objMap;
+    internal::IdentityMap objMap;
 
     // Queue of things waiting to be serialized.  Objects are serialized in order so that identifiers
     // will be sequential in the output stream.
-    std::queue<work> deferred;
+    std::vector<work> deferred;
+
+    // The root object of the current call to WriteObject, if it has not yet been entered into objMap,
+    // and the identifier it was given.  The root is only entered into objMap once a reference is
+    // written, so graphs without any references never touch objMap at all.
+    const void* pRoot = nullptr;
+    uint32_t rootID = 0;
+
+    // Sizes of objects already computed during the current call to WriteObject
+    mutable internal::SizeCache sizeCache;
+
+    // True if length prefixes are being backpatched during the current call to WriteObject
+    bool backpatching = false;
+
+    // Write-combining buffer owned by this archive, used when the output stream cannot lend us space
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t ncbBuffer = 0;
+
+    // Window that writes are currently staged in, and the number of bytes in it that have yet to be
+    // written.  The window is either our own buffer or space reserved in the output stream, in which
+    // case staged bytes are encoded directly into their final location.
+    uint8_t* pWindow = nullptr;
+    size_t ncbWindow = 0;
+    size_t ncbBuffered = 0;
+    bool reserved = false;
+
+    // True if writes are being staged in the write-combining buffer
+    bool buffering = false;
+
+    // True while a call to WriteObject is in progress
+    bool writing = false;
+
+    /// <summary>
+    /// Writes bytes to the output stream by way of the write-combining buffer, if it is in use
+    /// </summary>
+    void Emit(const void* pBuf, size_t ncb);
+
+    /// <summary>
+    /// Passes any staged bytes to the output stream
+    /// </summary>
+    void FlushBuffer(void);
+
+    /// <summary>
+    /// Flushes the window if fewer than the specified number of bytes remain in it, and opens a new one
+    /// </summary>
+    /// <returns>
+    /// A pointer to at least ncb bytes of the window, or nullptr if the bytes must be written directly
+    /// </returns>
+    uint8_t* Claim(size_t ncb);
+
+    /// <summary>
+    /// Abandons any outstanding reservation in the output stream, along with whatever was staged in it
+    /// </summary>
+    void Release(void);
+
+    /// <returns>
+    /// The stream offset of the next byte that will be written
+    /// </returns>
+    std::streamoff WriteOffset(void) const { return pOs->WriteOffset() + static_cast<std::streamoff>(ncbBuffered); }
 
     void WriteSize(uint32_t sz);
 
+    /// <summary>
+    /// Writes a fixed-width placeholder for a length prefix
+    /// </summary>
+    /// <returns>The stream offset of the placeholder</returns>
+    std::streamoff ReserveLength(void);
+
+    /// <summary>
+    /// Fills in a placeholder written by ReserveLength with the number of bytes written after it
+    /// </summary>
+    void PatchLength(std::streamoff off);
+
+    /// <summary>
+    /// Writes the elements of an array of integers as consecutive varints, encoding them in batches
+    /// </summary>
+    /// <returns>False if the array does not hold contiguous integers, in which case nothing is written</returns>
+    bool WriteIntegerArray(IArrayReader& ary);
+
+    /// <summary>
+    /// Writes the fields of an object by executing its compiled plan
+    /// </summary>
+    void WritePlan(const internal::Plan& plan, const void* pObj);
+    void WriteField(const internal::Plan::Op& op, const void* pField);
+    uint64_t SizePlan(const internal::Plan& plan, const void* pObj) const;
+    uint64_t SizeField(const internal::Plan::Op& op, const void* pField) const;
+
     /// <summary>
     /// Translates from an object pointer to an object ID, and registers the pointer
     /// for later deserialization by Process() if it has not been encountered before
     /// </summary>
     uint32_t RegisterObject(const field_serializer& serializer, const void* pObj);
 
+    /// <summary>
+    /// Writes a single object along with its identifier and length
+    /// </summary>
+    void WriteRecord(work w);
+
     /// <summary>
     /// Processes objects on the internal queue until the queue is empty
     /// </summary>
@@ -65,6 +176,7 @@ namespace leap {
     using OArchive::SizeInteger;
 
     // OArchive overrides:
+    void Reset(void) override;
     void WriteObject(const field_serializer& serializer, const void* pObj) override;
     void WriteObjectReference(const field_serializer& serializer, const void* pObj) override;
     void WriteDescriptor(const descriptor& descriptor, const void* pObj) override;
@@ -73,9 +185,9 @@ namespace leap {
     void WriteString(const void* pbuf, uint64_t charCount, uint8_t charSize) override;
     void WriteBool(bool value) override;
     void WriteInteger(int64_t value, uint8_t ncb) override;
-    void WriteFloat(float value) override { WriteByteArray(&value, sizeof(value)); }
-    void WriteFloat(double value) override { WriteByteArray(&value, sizeof(value)); }
-    void WriteFloat(long double value) override { WriteByteArray(&value, sizeof(value)); }
+    void WriteFloat(float value) override { Emit(&value, sizeof(value)); }
+    void WriteFloat(double value) override { Emit(&value, sizeof(value)); }
+    void WriteFloat(long double value) override { Emit(&value, sizeof(value)); }
     void WriteArray(IArrayReader&& ary) override;
     void WriteDictionary(IDictionaryReader&& dictionary) override;
 
@@ -104,6 +216,12 @@ namespace leap {
     IArchiveLeapSerial(std::istream& is);
     virtual ~IArchiveLeapSerial(void);
 
+    // Lazy flag.  If set, and if the input stream can seek, objects referred to by lazy_ptr fields are not
+    // read by ReadObject.  Instead, the records that make up the graph are indexed by skipping over their
+    // bodies, and each such object is read from the stream when its lazy_ptr is first dereferenced.  The
+    // input stream must then outlive the deserialized graph.
+    bool Lazy = false;
+
     struct deserialization_task {
       deserialization_task(
         const field_serializer* serializer,
@@ -121,9 +239,24 @@ namespace leap {
       void* pObject;
     };
 
+  protected:
+    /// <summary>
+    /// Reads n consecutive varints into an array of integers, decoding them in batches
+    /// </summary>
+    /// <returns>False if the array cannot provide contiguous integer storage, in which case nothing is read</returns>
+    bool ReadIntegerArray(IArrayAppender& ary, uint32_t n);
+
+    /// <summary>
+    /// Deserializes n consecutive entries into an array, allocating them as a block where possible
+    /// </summary>
+    /// <param name="counted">True if each entry is preceded by its length</param>
+    void ReadEntries(IArrayAppender& ary, uint32_t n, bool counted);
+
   private:
+    friend class internal::LazyIndex;
+
     // Underlying input stream
-    IInputStream& is;
+    IInputStream* pIs;
 
     // If any additional (flat) memory was required to construct the output stream reference, this is it
     void* const pIsMem = nullptr;
@@ -132,27 +265,114 @@ namespace leap {
     // Number of bytes read so far:
     uint64_t m_count = 0;
 
+    // Read-ahead buffer, and the window of bytes not yet consumed, which is either in the buffer or borrowed
+    // from the stream.  Reading ahead is bounded by the end of the record being read, so the stream is never
+    // advanced beyond the last record, and streams holding several consecutive objects can still be read one
+    // object at a time.
+    std::unique_ptr<uint8_t[]> readAhead;
+    const uint8_t* pCur = nullptr;
+    const uint8_t* pEnd = nullptr;
+
+    // Number of bytes of the current record that have not yet been pulled from the stream
+    uint64_t ncbRecordRemain = 0;
+
+    // Start of the window, if the window is borrowed from the stream rather than held in readAhead.
+    // Borrowed bytes are only consumed from the stream once we are done with the window.
+    const uint8_t* pBorrowed = nullptr;
+
+    /// <summary>
+    /// Makes sure the window is borrowed from the stream and holds at least the specified number of bytes
+    /// </summary>
+    /// <returns>False if the stream cannot lend that many bytes of the current record</returns>
+    bool Borrow(uint64_t ncb);
+
+    /// <summary>
+    /// Consumes the part of a borrowed window that has been read, and hands the rest back to the stream
+    /// </summary>
+    void Settle(void);
+
+    /// <summary>
+    /// Returns any bytes that were read ahead but not consumed to the stream, if the stream can seek
+    /// </summary>
+    void Unread(void);
+
     struct entry {
-      // A pointer to the raw object
-      void* pObject;
+      // A pointer to the raw object, or nullptr if the object has not been encountered yet
+      void* pObject = nullptr;
 
       // Caller-specified context field, if Release was called, otherwise nullptr
       std::shared_ptr<void> pContext;
 
       // A pointer to the routine that will be used to clean up the object
-      void(*pfnFree)(void*);
+      void(*pfnFree)(void*) = nullptr;
+
+      // True if the object was placed in an arena, which is responsible for cleaning it up
+      bool inArena = false;
     };
 
-    // Map of objects (as we encounter them) to their identifiers.  We use this
-    // to reconcile cycles
-    std::unordered_map<uint32_t, entry> objMap;
+    // Objects (as we encounter them), indexed by their identifiers.  We use this to reconcile
+    // cycles.  Identifiers are issued sequentially by the writer, so this table is dense.
+    std::vector<entry> objTable;
+
+    // Arena that objects are placed in during the current call to ReadObject, if any
+    internal::Arena* pArena = nullptr;
+
+    // The root object of the current call to ReadObject.  The root is only entered into objTable once
+    // a reference is read, so graphs without any references never touch objTable at all.
+    void* pRoot = nullptr;
 
-    // Identifiers remaining to be deserialized:
-    std::queue<deserialization_task> work;
+    // Identifiers remaining to be deserialized, kept as a heap with the smallest identifier on top
+    std::vector<deserialization_task> work;
+
+    // Index of the records of the graph being read, if it is being read lazily
+    std::shared_ptr<internal::LazyIndex> pIndex;
+
+    // Identifier of the root object of the current call to ReadObject.  This is only ever something other
+    // than 1 when an object is loaded from the middle of a graph for a lazy_ptr, in which case the identifiers
+    // encountered are sparse, and are mapped to dense slots in objTable.
+    uint32_t rootID = 1;
+    std::unordered_map<uint32_t, uint32_t> slots;
+
+    /// <returns>
+    /// The stream offset of the next byte to be read, or -1 if the stream cannot report it
+    /// </returns>
+    std::streampos Position(void);
+
+    /// <summary>
+    /// Discards anything read ahead and moves to the specified stream offset
+    /// </summary>
+    void SeekRecord(std::streampos pos);
+
+    // Identifier of the last record read
+    uint32_t lastRecord = 0;
+
+    // Stream offsets of the records of the current graph that were passed over, so that they can still be
+    // read if something read later turns out to refer to them.  Only kept while reading a seekable stream.
+    std::unordered_map<uint32_t, std::streampos>* pPassed = nullptr;
+
+    // True if any field was skipped during the current call to ReadObject
+    bool skipped = false;
+
+    /// <summary>
+    /// Passes over the records of the current graph starting with the specified identifier, and indexes
+    /// them if the graph is being read lazily
+    /// </summary>
+    /// <returns>The stream offset just past the last record of the graph, where the stream is left</returns>
+    std::streampos ScanRecords(uint32_t id);
+
+    /// <returns>
+    /// The table entry for the specified nonzero object identifier, which is created if necessary
+    /// </returns>
+    entry& Entry(uint32_t objId);
 
     ReleasedMemory Release(ReleasedMemory(*pfnAlloc)(), const field_serializer& serializer, uint32_t objId);
     void* Lookup(const create_delete& cd, const field_serializer& serializer, uint32_t objId);
 
+    /// <summary>
+    /// Queues up the record of a referenced object to be read
+    /// </summary>
+    void Enqueue(const deserialization_task& task);
+
     bool IsReleased(uint32_t objId);
 
     /// <summary>
@@ -169,6 +389,17 @@ namespace leap {
     /// <returns>The number of objects destroyed</returns>
     size_t ClearObjectTable(void);
 
+    /// <summary>
+    /// Reads the fields of an object by executing its compiled plan
+    /// </summary>
+    void ReadPlan(const internal::Plan& plan, void* pObj, uint64_t ncb);
+    void ReadField(const internal::Plan::Op& op, void* pField, uint64_t ncb);
+
+    /// <summary>
+    /// Reads a single object along with its identifier and length
+    /// </summary>
+    void ReadRecord(const deserialization_task& task);
+
     /// <summary>
     /// Recursively processes deserialization tasks, starting with the one passed, until none are left
     /// </summary>
@@ -178,14 +409,18 @@ namespace leap {
     void* ReadObjectReference(const create_delete& cd, const field_serializer& sz) override;
 
     // IArchive overrides:
+    void Reset(void) override;
+    void Rebind(IInputStream& is) override;
     void Skip(uint64_t ncb) override;
     uint64_t Count(void) const override { return m_count; }
 
     void ReadObject(const field_serializer& sz, void* pObj, internal::AllocationBase* pOwner) override;
 
     ReleasedMemory ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) override;
+    bool ReadObjectReferenceLazy(std::shared_ptr<internal::LazySource>& source, uint32_t& objId) override;
     void ReadByteArray(void* pBuf, uint64_t ncb) override;
     void ReadString(std::function<void*(uint64_t)> getBufferFn, uint8_t charSize, uint64_t ncb) override;
+    bool ReadStringRef(const void*& pBuf, uint64_t& count, uint8_t charSize, uint64_t ncb) override;
     bool ReadBool() override;
     uint64_t ReadInteger(uint8_t ncb) override;
     void ReadFloat(float& value) override { ReadByteArray(&value, sizeof(value)); }
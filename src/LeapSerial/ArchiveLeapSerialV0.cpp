@@ -19,10 +19,11 @@ void IArchiveLeapSerialV0::ReadArray(IArrayAppender&& ary) {
   uint32_t nEntries;
   ReadByteArray(&nEntries, sizeof(nEntries));
   ary.reserve(nEntries);
+  if (ReadIntegerArray(ary, nEntries))
+    return;
 
-  // Now loop until we get the desired number of entries from the stream
-  for (size_t i = 0; i < nEntries; i++)
-    ary.serializer.deserialize(*this, ary.allocate(), 0);
+  // Now get the desired number of entries from the stream
+  ReadEntries(ary, nEntries, false);
 }
 
 OArchiveLeapSerialV0::OArchiveLeapSerialV0(IOutputStream& os) : OArchiveLeapSerial(os) {}
@@ -30,6 +31,8 @@ OArchiveLeapSerialV0::OArchiveLeapSerialV0(IOutputStream& os) : OArchiveLeapSeri
 void OArchiveLeapSerialV0::WriteArray(IArrayReader&& ary) {
   uint32_t n = (uint32_t)ary.size();
   WriteSize(n);
+  if (WriteIntegerArray(ary))
+    return;
 
   for (uint32_t i = 0; i < n; i++)
     ary.serializer.serialize(*this, ary.get(i));
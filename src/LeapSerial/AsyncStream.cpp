@@ -0,0 +1,275 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "AsyncStream.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace leap;
+using namespace leap::internal;
+
+static void AllocateBlocks(std::vector<AsyncBlock>& blocks, size_t nBlocks, size_t ncb) {
+  blocks.resize(std::max<size_t>(nBlocks, 2));
+  for (AsyncBlock& block : blocks)
+    block.data.reset(new uint8_t[ncb]);
+}
+
+AsyncOutputStream::AsyncOutputStream(std::unique_ptr<IOutputStream>&& os, size_t ncbBuffer, size_t nBuffers) :
+  os(std::move(os)),
+  ncbBuffer(std::max<size_t>(ncbBuffer, 1))
+{
+  AllocateBlocks(blocks, nBuffers, this->ncbBuffer);
+  pCur = &blocks[0];
+  for (size_t i = 1; i < blocks.size(); i++)
+    empty.push_back(&blocks[i]);
+
+  writer = std::thread(&AsyncOutputStream::ThreadProc, this);
+}
+
+AsyncOutputStream::~AsyncOutputStream(void) {
+  Flush();
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    stop = true;
+  }
+  cv.notify_all();
+  writer.join();
+}
+
+void AsyncOutputStream::ThreadProc(void) {
+  std::unique_lock<std::mutex> lk(lock);
+  for (;;) {
+    cv.wait(lk, [this] { return stop || !full.empty(); });
+    if (full.empty())
+      return;
+
+    AsyncBlock* pBlock = full.front();
+    full.pop_front();
+    busy = true;
+
+    // Once a write has failed, nothing after it is written, so that the output has no holes
+    if (!failed) {
+      lk.unlock();
+      bool ok = os->Write(pBlock->data.get(), static_cast<std::streamsize>(pBlock->ncb));
+      lk.lock();
+      if (!ok)
+        failed = true;
+    }
+
+    pBlock->ncb = 0;
+    empty.push_back(pBlock);
+    busy = false;
+    cv.notify_all();
+  }
+}
+
+void AsyncOutputStream::Submit(void) {
+  if (!pCur->ncb)
+    return;
+
+  std::unique_lock<std::mutex> lk(lock);
+  full.push_back(pCur);
+  cv.notify_all();
+
+  cv.wait(lk, [this] { return !empty.empty(); });
+  pCur = empty.front();
+  empty.pop_front();
+}
+
+bool AsyncOutputStream::Write(const void* pBuf, std::streamsize ncb) {
+  if (failed)
+    return false;
+
+  const uint8_t* p = static_cast<const uint8_t*>(pBuf);
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  while (ncbRemain) {
+    if (pCur->ncb == ncbBuffer)
+      Submit();
+
+    size_t n = std::min(ncbBuffer - pCur->ncb, ncbRemain);
+    memcpy(pCur->data.get() + pCur->ncb, p, n);
+    pCur->ncb += n;
+    p += n;
+    ncbRemain -= n;
+  }
+  return true;
+}
+
+void AsyncOutputStream::Flush(void) {
+  Submit();
+
+  // The underlying stream is idle once nothing is queued or being written, and stays that way until the
+  // next call to Submit, which only this thread makes
+  {
+    std::unique_lock<std::mutex> lk(lock);
+    cv.wait(lk, [this] { return full.empty() && !busy; });
+  }
+  if (!failed)
+    os->Flush();
+}
+
+std::streamsize AsyncOutputStream::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  if (ncbBuffer < static_cast<size_t>(ncbMin)) {
+    *ppBuf = nullptr;
+    return 0;
+  }
+  if (ncbBuffer - pCur->ncb < static_cast<size_t>(ncbMin))
+    Submit();
+
+  *ppBuf = pCur->data.get() + pCur->ncb;
+  return static_cast<std::streamsize>(ncbBuffer - pCur->ncb);
+}
+
+bool AsyncOutputStream::Commit(std::streamsize ncb) {
+  pCur->ncb += static_cast<size_t>(ncb);
+  return !failed;
+}
+
+PrefetchInputStream::PrefetchInputStream(std::unique_ptr<IInputStream>&& is, size_t ncbBlock, size_t nBlocks) :
+  is(std::move(is)),
+  ncbBlock(std::max<size_t>(ncbBlock, 1)),
+  ncbInitialLength(this->is->Length())
+{
+  AllocateBlocks(blocks, nBlocks, this->ncbBlock);
+  for (AsyncBlock& block : blocks)
+    empty.push_back(&block);
+
+  reader = std::thread(&PrefetchInputStream::ThreadProc, this);
+}
+
+PrefetchInputStream::~PrefetchInputStream(void) {
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    stop = true;
+  }
+  cv.notify_all();
+  reader.join();
+}
+
+void PrefetchInputStream::ThreadProc(void) {
+  std::unique_lock<std::mutex> lk(lock);
+  for (;;) {
+    cv.wait(lk, [this] { return stop || !empty.empty(); });
+    if (stop)
+      return;
+
+    AsyncBlock* pBlock = empty.front();
+    empty.pop_front();
+    lk.unlock();
+
+    // Blocks are filled completely, except for the last one
+    size_t ncbRead = 0;
+    bool end = false;
+    std::exception_ptr e;
+    try {
+      while (ncbRead < ncbBlock) {
+        std::streamsize n = is->Read(pBlock->data.get() + ncbRead, static_cast<std::streamsize>(ncbBlock - ncbRead));
+        if (n < 0)
+          throw std::runtime_error("Failed to read from the underlying stream");
+        if (n == 0) {
+          end = true;
+          break;
+        }
+        ncbRead += static_cast<size_t>(n);
+      }
+    }
+    catch (...) {
+      e = std::current_exception();
+      end = true;
+    }
+
+    lk.lock();
+    pBlock->ncb = ncbRead;
+    if (ncbRead)
+      full.push_back(pBlock);
+    else
+      empty.push_back(pBlock);
+    if (end) {
+      done = true;
+      err = e;
+    }
+    cv.notify_all();
+    if (end)
+      return;
+  }
+}
+
+bool PrefetchInputStream::Advance(void) {
+  std::unique_lock<std::mutex> lk(lock);
+  if (pCur) {
+    empty.push_back(pCur);
+    pCur = nullptr;
+    m_readOffset = 0;
+    cv.notify_all();
+  }
+
+  cv.wait(lk, [this] { return !full.empty() || done; });
+  if (full.empty()) {
+    if (err) {
+      // Only reported once
+      std::exception_ptr e = err;
+      err = nullptr;
+      std::rethrow_exception(e);
+    }
+    return false;
+  }
+
+  pCur = full.front();
+  full.pop_front();
+  return true;
+}
+
+std::streamsize PrefetchInputStream::Read(void* pBuf, std::streamsize ncb) {
+  uint8_t* p = static_cast<uint8_t*>(pBuf);
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  while (ncbRemain) {
+    if (!Available() && !Advance())
+      break;
+
+    size_t n = std::min(Available(), ncbRemain);
+    memcpy(p, pCur->data.get() + m_readOffset, n);
+    m_readOffset += n;
+    m_ncbConsumed += n;
+    p += n;
+    ncbRemain -= n;
+  }
+
+  m_eof = ncbRemain != 0;
+  return ncb - static_cast<std::streamsize>(ncbRemain);
+}
+
+std::streamsize PrefetchInputStream::Skip(std::streamsize ncb) {
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  while (ncbRemain) {
+    if (!Available() && !Advance())
+      break;
+
+    size_t n = std::min(Available(), ncbRemain);
+    m_readOffset += n;
+    m_ncbConsumed += n;
+    ncbRemain -= n;
+  }
+
+  m_eof = ncbRemain != 0;
+  return ncb - static_cast<std::streamsize>(ncbRemain);
+}
+
+std::streamsize PrefetchInputStream::GetContiguous(const void** ppBuf) {
+  if (!Available() && !Advance()) {
+    *ppBuf = nullptr;
+    return 0;
+  }
+  *ppBuf = pCur->data.get() + m_readOffset;
+  return static_cast<std::streamsize>(Available());
+}
+
+void PrefetchInputStream::Consume(std::streamsize ncb) {
+  m_readOffset += static_cast<size_t>(ncb);
+  m_ncbConsumed += static_cast<size_t>(ncb);
+}
+
+std::streamsize PrefetchInputStream::Length(void) {
+  if (ncbInitialLength < 0)
+    return -1;
+  return ncbInitialLength - static_cast<std::streamsize>(m_ncbConsumed);
+}
@@ -0,0 +1,161 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "IInputStream.h"
+#include "IOutputStream.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// One of the buffers that is passed between a caller and the background thread of an async stream
+    /// </summary>
+    struct AsyncBlock {
+      std::unique_ptr<uint8_t[]> data;
+      size_t ncb = 0;
+    };
+  }
+
+  /// <summary>
+  /// Output stream that writes to another stream on a background thread
+  /// </summary>
+  /// <remarks>
+  /// Bytes are gathered into one of a fixed set of buffers.  Once a buffer is full, it is queued for the
+  /// background thread to write, and the caller moves on to the next buffer; the caller only waits if every
+  /// buffer is still queued.  Reserve lends out the current buffer, so archives can encode into it directly.
+  ///
+  /// Flush waits for everything written so far to reach the underlying stream, and then flushes that
+  /// stream too.  If the underlying stream fails a write, nothing more is written to it, and the failure is
+  /// reported by the next call to Write or Commit on this stream.
+  /// </remarks>
+  class AsyncOutputStream :
+    public IOutputStream
+  {
+  public:
+    /// <param name="os">The stream to write to</param>
+    /// <param name="ncbBuffer">The size of each buffer</param>
+    /// <param name="nBuffers">The number of buffers, at least two</param>
+    AsyncOutputStream(std::unique_ptr<IOutputStream>&& os, size_t ncbBuffer = 1024 * 1024, size_t nBuffers = 2);
+    ~AsyncOutputStream(void);
+
+  private:
+    const std::unique_ptr<IOutputStream> os;
+    const size_t ncbBuffer;
+
+    std::vector<internal::AsyncBlock> blocks;
+
+    // The block being filled by the caller, which belongs to neither queue
+    internal::AsyncBlock* pCur = nullptr;
+
+    // Guards everything below
+    std::mutex lock;
+    std::condition_variable cv;
+
+    // Blocks waiting to be written, oldest first, and blocks that may be filled
+    std::deque<internal::AsyncBlock*> full;
+    std::deque<internal::AsyncBlock*> empty;
+
+    // True while the background thread is writing a block
+    bool busy = false;
+
+    // Set if the underlying stream failed a write, and checked by the caller without taking the lock
+    std::atomic<bool> failed{ false };
+    bool stop = false;
+
+    std::thread writer;
+
+    void ThreadProc(void);
+
+    /// <summary>
+    /// Queues the current block, if it holds anything, and waits for an empty one to take its place
+    /// </summary>
+    void Submit(void);
+
+  public:
+    bool Write(const void* pBuf, std::streamsize ncb) override;
+    void Flush(void) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
+
+    using IOutputStream::Write;
+  };
+
+  /// <summary>
+  /// Input stream that reads ahead from another stream on a background thread
+  /// </summary>
+  /// <remarks>
+  /// The background thread reads the underlying stream in blocks of a fixed size, and keeps up to the
+  /// specified number of blocks ready ahead of the caller.  Each block is lent out through GetContiguous
+  /// while the caller parses it.  An error raised by the underlying stream is thrown to the caller once
+  /// the caller has consumed every byte read before it.
+  ///
+  /// The underlying stream belongs to the background thread, so this stream cannot seek.
+  /// </remarks>
+  class PrefetchInputStream :
+    public IInputStream
+  {
+  public:
+    /// <param name="is">The stream to read from</param>
+    /// <param name="ncbBlock">The size of each block read from the underlying stream</param>
+    /// <param name="nBlocks">The number of blocks, at least two</param>
+    PrefetchInputStream(std::unique_ptr<IInputStream>&& is, size_t ncbBlock = 1024 * 1024, size_t nBlocks = 2);
+    ~PrefetchInputStream(void);
+
+  private:
+    const std::unique_ptr<IInputStream> is;
+    const size_t ncbBlock;
+
+    // The length of the underlying stream when it was wrapped, or -1 if unknown
+    const std::streamsize ncbInitialLength;
+
+    std::vector<internal::AsyncBlock> blocks;
+
+    // The block being read by the caller, which belongs to neither queue, and the read offset within it
+    internal::AsyncBlock* pCur = nullptr;
+    size_t m_readOffset = 0;
+
+    // The total number of bytes consumed by the caller
+    uint64_t m_ncbConsumed = 0;
+    bool m_eof = false;
+
+    // Guards everything below
+    std::mutex lock;
+    std::condition_variable cv;
+
+    // Blocks that have been read ahead, oldest first, and blocks that may be read into
+    std::deque<internal::AsyncBlock*> full;
+    std::deque<internal::AsyncBlock*> empty;
+
+    // Set once the underlying stream is exhausted, along with whatever it threw, if anything
+    bool done = false;
+    std::exception_ptr err;
+    bool stop = false;
+
+    std::thread reader;
+
+    void ThreadProc(void);
+
+    /// <summary>
+    /// Hands back the current block, if any, and waits for the next one
+    /// </summary>
+    /// <returns>False if there are no more blocks</returns>
+    bool Advance(void);
+
+    size_t Available(void) const { return pCur ? pCur->ncb - m_readOffset : 0; }
+
+  public:
+    bool IsEof(void) const override { return m_eof; }
+    std::streamsize Read(void* pBuf, std::streamsize ncb) override;
+    std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
+    void Consume(std::streamsize ncb) override;
+    std::streamsize Length(void) override;
+  };
+}
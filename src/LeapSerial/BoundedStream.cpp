@@ -37,6 +37,15 @@ std::streamsize BoundedInputStream::Skip(std::streamsize ncb) {
   return rs;
 }
 
+std::streamsize BoundedInputStream::GetContiguous(const void** ppBuf) {
+  return std::min(is->GetContiguous(ppBuf), ReadLimit - m_totalRead);
+}
+
+void BoundedInputStream::Consume(std::streamsize ncb) {
+  is->Consume(ncb);
+  m_totalRead += ncb;
+}
+
 std::streamsize BoundedInputStream::Length(void) {
   auto underlying = is->Length();
   if(underlying == -1)
@@ -25,6 +25,9 @@ namespace leap {
     bool IsEof(void) const override;
     std::streamsize Read(void* pBuf, std::streamsize ncb) override;
     std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
+    void Consume(std::streamsize ncb) override;
+    bool CanRetain(void) const override { return is->CanRetain(); }
     std::streamsize Length(void) override;
   };
 
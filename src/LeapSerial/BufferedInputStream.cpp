@@ -17,7 +17,10 @@ BufferedInputStream::BufferedInputStream(const void* buffer, size_t ncbBuffer, s
 std::streamsize BufferedInputStream::Read(void* pBuf, std::streamsize ncb) {
   const void* pSrcData = static_cast<const uint8_t*>(buffer) + m_readOffset;
   ncb = Skip(ncb);
-  memcpy(pBuf, pSrcData, static_cast<size_t>(ncb));
+
+  // An empty buffer, such as the mapping of an empty file, may have no address at all
+  if (ncb)
+    memcpy(pBuf, pSrcData, static_cast<size_t>(ncb));
   return ncb;
 }
 
@@ -32,6 +35,11 @@ std::streamsize BufferedInputStream::Skip(std::streamsize ncb) {
   return skipCount;
 }
 
+std::streamsize BufferedInputStream::GetContiguous(const void** ppBuf) {
+  *ppBuf = static_cast<const uint8_t*>(buffer) + m_readOffset;
+  return static_cast<std::streamsize>(m_lastValidByte - m_readOffset);
+}
+
 std::streamsize BufferedInputStream::Length(void) {
   return static_cast<std::streamsize>(m_lastValidByte - m_readOffset);
 }
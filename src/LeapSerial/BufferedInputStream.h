@@ -41,7 +41,11 @@ namespace leap {
     bool IsEof(void) const override { return m_eof; }
     std::streamsize Read(void* pBuf, std::streamsize ncb) override;
     std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
+    void Consume(std::streamsize ncb) override { m_readOffset += ncb; }
+    bool CanRetain(void) const override { return true; }
     std::streamsize Length(void) override;
+    std::streampos Tell(void) override { return m_readOffset; }
     IInputStream* Seek(std::streampos off) override;
   };
 }
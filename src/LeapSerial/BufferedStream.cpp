@@ -23,3 +23,26 @@ bool BufferedStream::Write(const void* pBuf, std::streamsize ncb) {
   m_lastValidByte += static_cast<size_t>(ncb);
   return true;
 }
+
+std::streamsize BufferedStream::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  const std::streamsize ncbFree = static_cast<std::streamsize>(ncbBuffer - m_lastValidByte);
+  if (ncbFree < ncbMin) {
+    *ppBuf = nullptr;
+    return 0;
+  }
+  *ppBuf = static_cast<uint8_t*>(buffer) + m_lastValidByte;
+  return ncbFree;
+}
+
+bool BufferedStream::Commit(std::streamsize ncb) {
+  m_lastValidByte += ncb;
+  return true;
+}
+
+bool BufferedStream::Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) {
+  if (off < m_readOffset || m_lastValidByte - off < ncb)
+    return false;
+
+  memcpy(static_cast<uint8_t*>(buffer) + off, pBuf, static_cast<size_t>(ncb));
+  return true;
+}
@@ -24,5 +24,10 @@ namespace leap {
 
   public:
     bool Write(const void* pBuf, std::streamsize ncb) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
+    bool CanPatch(void) const override { return true; }
+    std::streamoff WriteOffset(void) const override { return m_lastValidByte; }
+    bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override;
   };
 }
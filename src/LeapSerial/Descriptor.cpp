@@ -21,6 +21,11 @@ leap::descriptor::descriptor(const char* name, const field_descriptor* begin, co
   }
 }
 
+const field_descriptor* leap::descriptor::find_identified(uint64_t identifier, size_t& hint) const {
+  const internal::Plan::Op* op = internal::Plan::Get(*this).Find(identifier, hint);
+  return op ? op->field : nullptr;
+}
+
 uint64_t leap::descriptor::size(const OArchiveRegistry& ar, const void* pObj) const {
   return ar.SizeDescriptor(*this, pObj);
 }
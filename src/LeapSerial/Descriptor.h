@@ -2,6 +2,7 @@
 #pragma once
 #include "field_descriptor.h"
 #include "field_serializer.h"
+#include "Plan.h"
 #include <initializer_list>
 #include <unordered_map>
 #include <vector>
@@ -61,6 +62,20 @@ namespace leap {
     // Identified field descriptors
     std::unordered_map<uint64_t, field_descriptor> identified_descriptors;
 
+    // Compiled form of this descriptor, see internal::Plan
+    mutable internal::PlanSlot m_plan;
+
+    /// <summary>
+    /// Finds the identified field with the specified identifier
+    /// </summary>
+    /// <param name="hint">
+    /// Lookup state for a sequence of calls made while reading one object, which should start at zero.
+    /// Fields are expected to arrive in ascending order of identifier, so the field following the last one
+    /// found is checked before anything else.
+    /// </param>
+    /// <returns>The field, or nullptr if this descriptor has no field with that identifier</returns>
+    const field_descriptor* find_identified(uint64_t identifier, size_t& hint) const;
+
     // field_serializer overrides:
     bool allocates(void) const override { return m_allocates; }
     serial_atom type(void) const override { return identified_descriptors.empty() ? serial_atom::finalized_descriptor : serial_atom::descriptor; }
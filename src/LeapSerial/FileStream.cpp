@@ -0,0 +1,394 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "FileStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace leap;
+using namespace leap::internal;
+
+static std::system_error LastError(const char* what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+static size_t RoundUp(size_t ncb, size_t ncbAlign) {
+  return (ncb + ncbAlign - 1) & ~(ncbAlign - 1);
+}
+
+FileStreamBase::FileStreamBase(const char* path, int flags, const FileStreamOptions& options) :
+  ncbAlign(options.ncbAlign ? options.ncbAlign : 1),
+  ncbBuf(RoundUp(std::max(options.ncbBuffer, ncbAlign), ncbAlign))
+{
+  if (options.direct) {
+#if defined(O_DIRECT)
+    fd = open(path, flags | O_DIRECT, 0666);
+    if (fd >= 0)
+      direct = true;
+    else if (errno != EINVAL)
+      throw LastError("Failed to open a file");
+#elif defined(F_NOCACHE)
+    fd = open(path, flags, 0666);
+    if (fd >= 0 && !fcntl(fd, F_NOCACHE, 1))
+      direct = true;
+#endif
+  }
+
+  // Not every file system supports unbuffered I/O
+  if (fd < 0) {
+    fd = open(path, flags, 0666);
+    if (fd < 0)
+      throw LastError("Failed to open a file");
+  }
+
+  void* p;
+  if (posix_memalign(&p, std::max(ncbAlign, sizeof(void*)), ncbBuf)) {
+    close(fd);
+    throw std::bad_alloc();
+  }
+  pBuf = static_cast<uint8_t*>(p);
+}
+
+FileStreamBase::~FileStreamBase(void) {
+  free(pBuf);
+  close(fd);
+}
+
+FileInputStream::FileInputStream(const char* path, const FileStreamOptions& options) :
+  FileStreamBase(path, O_RDONLY, options)
+{
+  struct stat st;
+  if (fstat(fd, &st))
+    throw LastError("Failed to get the size of a file");
+  m_fileSize = static_cast<uint64_t>(st.st_size);
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+  switch (options.access) {
+  case AccessHint::Sequential:
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    break;
+  case AccessHint::Random:
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+    break;
+  default:
+    break;
+  }
+#endif
+}
+
+std::streamsize FileInputStream::Fill(void) {
+  // Unbuffered reads must start on an aligned offset, so the chunk may begin a little early
+  const uint64_t pos = Position();
+  const uint64_t off = direct ? pos & ~static_cast<uint64_t>(ncbAlign - 1) : pos;
+
+  size_t ncbRead = 0;
+  do {
+    ssize_t n = pread(fd, pBuf + ncbRead, ncbBuf - ncbRead, static_cast<off_t>(off + ncbRead));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+
+      // Whatever was read before the failure is dropped, so that the position stays where it was
+      m_error = errno;
+      return -1;
+    }
+    if (!n)
+      break;
+    ncbRead += static_cast<size_t>(n);
+  } while (!direct && ncbRead < ncbBuf);
+
+  m_bufOffset = off;
+  m_ncbValid = ncbRead;
+  m_readOffset = static_cast<size_t>(pos - off);
+  return m_ncbValid > m_readOffset ? static_cast<std::streamsize>(m_ncbValid - m_readOffset) : 0;
+}
+
+std::streamsize FileInputStream::Read(void* pDest, std::streamsize ncb) {
+  if (m_error)
+    return -1;
+
+  uint8_t* p = static_cast<uint8_t*>(pDest);
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  while (ncbRemain) {
+    size_t ncbAvail = m_ncbValid > m_readOffset ? m_ncbValid - m_readOffset : 0;
+    if (!ncbAvail) {
+      if (!direct && ncbRemain >= ncbBuf) {
+        // Large reads go straight to the caller's buffer
+        const uint64_t pos = Position();
+        ssize_t n = pread(fd, p, ncbRemain, static_cast<off_t>(pos));
+        if (n < 0) {
+          if (errno == EINTR)
+            continue;
+          m_error = errno;
+          return -1;
+        }
+        if (!n)
+          break;
+
+        m_bufOffset = pos + static_cast<uint64_t>(n);
+        m_ncbValid = 0;
+        m_readOffset = 0;
+        p += n;
+        ncbRemain -= static_cast<size_t>(n);
+        continue;
+      }
+
+      std::streamsize ncbFilled = Fill();
+      if (ncbFilled < 0)
+        return -1;
+      if (!ncbFilled)
+        break;
+      ncbAvail = static_cast<size_t>(ncbFilled);
+    }
+
+    size_t n = std::min(ncbAvail, ncbRemain);
+    memcpy(p, pBuf + m_readOffset, n);
+    m_readOffset += n;
+    p += n;
+    ncbRemain -= n;
+  }
+
+  m_eof = ncbRemain != 0;
+  return ncb - static_cast<std::streamsize>(ncbRemain);
+}
+
+std::streamsize FileInputStream::Skip(std::streamsize ncb) {
+  if (m_error)
+    return -1;
+
+  const uint64_t pos = Position();
+  const uint64_t ncbRemain = m_fileSize > pos ? m_fileSize - pos : 0;
+  const std::streamsize ncbSkipped = static_cast<std::streamsize>(std::min(static_cast<uint64_t>(ncb), ncbRemain));
+
+  Seek(static_cast<std::streamoff>(pos + ncbSkipped));
+  m_eof = ncbSkipped != ncb;
+  return ncbSkipped;
+}
+
+std::streamsize FileInputStream::GetContiguous(const void** ppBuf) {
+  // A failure is left for Read to report
+  std::streamsize ncbAvail = m_ncbValid > m_readOffset ? static_cast<std::streamsize>(m_ncbValid - m_readOffset) : 0;
+  if (!ncbAvail && !m_error)
+    ncbAvail = std::max<std::streamsize>(Fill(), 0);
+  *ppBuf = ncbAvail ? pBuf + m_readOffset : nullptr;
+  return ncbAvail;
+}
+
+std::streamsize FileInputStream::Length(void) {
+  const uint64_t pos = Position();
+  return m_fileSize > pos ? static_cast<std::streamsize>(m_fileSize - pos) : 0;
+}
+
+IInputStream* FileInputStream::Seek(std::streampos off) {
+  const uint64_t pos = static_cast<uint64_t>(static_cast<std::streamoff>(off));
+
+  // Keep the buffer if the new position is inside of it
+  if (m_bufOffset <= pos && pos <= m_bufOffset + m_ncbValid)
+    m_readOffset = static_cast<size_t>(pos - m_bufOffset);
+  else {
+    m_bufOffset = pos;
+    m_ncbValid = 0;
+    m_readOffset = 0;
+  }
+  m_eof = false;
+  m_error = 0;
+  return this;
+}
+
+FileOutputStream::FileOutputStream(const char* path, bool append, const FileStreamOptions& options) :
+  FileStreamBase(path, O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), options)
+{
+  if (append) {
+    struct stat st;
+    if (fstat(fd, &st))
+      throw LastError("Failed to get the size of a file");
+
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (direct) {
+      // Unbuffered writes must start on an aligned offset, so the partial block at the end of the file is
+      // read back and rewritten along with whatever follows it
+      m_bufOffset = size & ~static_cast<uint64_t>(ncbAlign - 1);
+      m_ncbValid = static_cast<size_t>(size - m_bufOffset);
+      if (m_ncbValid && pread(fd, pBuf, ncbAlign, static_cast<off_t>(m_bufOffset)) < static_cast<ssize_t>(m_ncbValid))
+        throw LastError("Failed to read the end of a file");
+    }
+    else
+      m_bufOffset = size;
+  }
+
+#if defined(__linux__)
+  if (options.ncbPreallocate && !posix_fallocate(fd, static_cast<off_t>(m_bufOffset), static_cast<off_t>(options.ncbPreallocate)))
+    m_trim = true;
+#endif
+}
+
+FileOutputStream::~FileOutputStream(void) {
+  Flush();
+
+  // There is no way to report a failure from here
+  if (m_trim) {
+    int rc = ftruncate(fd, static_cast<off_t>(WriteOffset()));
+    (void)rc;
+  }
+}
+
+bool FileOutputStream::WriteAt(const void* pSrc, size_t ncb, uint64_t off) {
+  const uint8_t* p = static_cast<const uint8_t*>(pSrc);
+  while (ncb) {
+    ssize_t n = pwrite(fd, p, ncb, static_cast<off_t>(off));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    off += static_cast<uint64_t>(n);
+    ncb -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool FileOutputStream::Drain(void) {
+  const size_t ncbOut = direct ? m_ncbValid & ~(ncbAlign - 1) : m_ncbValid;
+  if (!ncbOut)
+    return true;
+  if (!WriteAt(pBuf, ncbOut, m_bufOffset))
+    return false;
+
+  // Whatever could not be written yet moves to the front of the buffer
+  memmove(pBuf, pBuf + ncbOut, m_ncbValid - ncbOut);
+  m_bufOffset += ncbOut;
+  m_ncbValid -= ncbOut;
+  return true;
+}
+
+bool FileOutputStream::Write(const void* pSrc, std::streamsize ncb) {
+  const uint8_t* p = static_cast<const uint8_t*>(pSrc);
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  while (ncbRemain) {
+    if (m_ncbValid == ncbBuf && !Drain())
+      return false;
+
+    if (!direct && !m_ncbValid && ncbRemain >= ncbBuf) {
+      // Large writes go straight from the caller's buffer
+      if (!WriteAt(p, ncbRemain, m_bufOffset))
+        return false;
+      m_bufOffset += ncbRemain;
+      return true;
+    }
+
+    size_t n = std::min(ncbBuf - m_ncbValid, ncbRemain);
+    memcpy(pBuf + m_ncbValid, p, n);
+    m_ncbValid += n;
+    p += n;
+    ncbRemain -= n;
+  }
+  return true;
+}
+
+bool FileOutputStream::Write(const OutputSegment* pSegs, size_t nSegs) {
+  size_t ncbTotal = 0;
+  for (size_t i = 0; i < nSegs; i++)
+    ncbTotal += static_cast<size_t>(pSegs[i].ncb);
+
+  // Small writes are gathered in the buffer as usual, and unbuffered I/O must stay aligned
+  if (direct || ncbBuf - m_ncbValid >= ncbTotal || nSegs >= IOV_MAX)
+    return IOutputStream::Write(pSegs, nSegs);
+
+  // Everything else goes to the file in one call, led by whatever was already buffered
+  std::vector<iovec> iov;
+  iov.reserve(nSegs + 1);
+  if (m_ncbValid)
+    iov.push_back({ pBuf, m_ncbValid });
+  for (size_t i = 0; i < nSegs; i++)
+    if (pSegs[i].ncb)
+      iov.push_back({ const_cast<void*>(pSegs[i].pBuf), static_cast<size_t>(pSegs[i].ncb) });
+
+  if (lseek(fd, static_cast<off_t>(m_bufOffset), SEEK_SET) < 0)
+    return false;
+  for (iovec* pIov = iov.data(), *pEnd = pIov + iov.size(); pIov != pEnd;) {
+    ssize_t n = writev(fd, pIov, static_cast<int>(pEnd - pIov));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    // Step past whatever was written, which may end partway through an entry
+    for (size_t ncb = static_cast<size_t>(n); ncb;) {
+      size_t ncbEntry = std::min(ncb, pIov->iov_len);
+      pIov->iov_base = static_cast<uint8_t*>(pIov->iov_base) + ncbEntry;
+      pIov->iov_len -= ncbEntry;
+      ncb -= ncbEntry;
+      if (!pIov->iov_len)
+        pIov++;
+    }
+  }
+
+  m_bufOffset += m_ncbValid + ncbTotal;
+  m_ncbValid = 0;
+  return true;
+}
+
+void FileOutputStream::Flush(void) {
+  if (!Drain() || !m_ncbValid)
+    return;
+
+  // An unbuffered stream is left holding a partial block.  This is written out padded to the alignment,
+  // but stays in the buffer to be rewritten once more follows it.
+  const size_t ncbPadded = RoundUp(m_ncbValid, ncbAlign);
+  memset(pBuf + m_ncbValid, 0, ncbPadded - m_ncbValid);
+  if (!WriteAt(pBuf, ncbPadded, m_bufOffset))
+    return;
+
+  if (!m_trim) {
+    int rc = ftruncate(fd, static_cast<off_t>(WriteOffset()));
+    (void)rc;
+  }
+}
+
+std::streamsize FileOutputStream::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  if (ncbBuf - m_ncbValid < static_cast<size_t>(ncbMin))
+    Drain();
+  if (ncbBuf - m_ncbValid < static_cast<size_t>(ncbMin)) {
+    *ppBuf = nullptr;
+    return 0;
+  }
+
+  *ppBuf = pBuf + m_ncbValid;
+  return static_cast<std::streamsize>(ncbBuf - m_ncbValid);
+}
+
+bool FileOutputStream::Commit(std::streamsize ncb) {
+  m_ncbValid += static_cast<size_t>(ncb);
+  return true;
+}
+
+bool FileOutputStream::Patch(std::streamoff off, const void* pSrc, std::streamsize ncb) {
+  if (direct || off < 0 || WriteOffset() - off < ncb)
+    return false;
+
+  // Part of the range may already have been handed to the operating system, and the rest is buffered
+  const uint8_t* p = static_cast<const uint8_t*>(pSrc);
+  uint64_t pos = static_cast<uint64_t>(off);
+  size_t ncbRemain = static_cast<size_t>(ncb);
+  if (pos < m_bufOffset) {
+    size_t n = static_cast<size_t>(std::min<uint64_t>(ncbRemain, m_bufOffset - pos));
+    if (!WriteAt(p, n, pos))
+      return false;
+    p += n;
+    pos += n;
+    ncbRemain -= n;
+  }
+  memcpy(pBuf + (pos - m_bufOffset), p, ncbRemain);
+  return true;
+}
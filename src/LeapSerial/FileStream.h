@@ -0,0 +1,150 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "AccessHint.h"
+#include "IInputStream.h"
+#include "IOutputStream.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace leap {
+  /// <summary>
+  /// Settings shared by FileInputStream and FileOutputStream
+  /// </summary>
+  struct FileStreamOptions {
+    // The size of the buffer that reads and writes are gathered into, rounded up to a multiple of ncbAlign
+    size_t ncbBuffer = 1024 * 1024;
+
+    // True to bypass the page cache, so that a large file streamed once does not evict hotter data.  If
+    // the file system does not support unbuffered I/O, the stream falls back to ordinary I/O.
+    bool direct = false;
+
+    // The alignment that unbuffered I/O requires of file offsets, sizes, and memory, a power of two
+    size_t ncbAlign = 4096;
+
+    // How the file will be read
+    AccessHint access = AccessHint::Sequential;
+
+    // The number of bytes to allocate up front for a file being written, or zero not to do so
+    uint64_t ncbPreallocate = 0;
+  };
+
+  namespace internal {
+    /// <summary>
+    /// File descriptor and aligned buffer behind the file streams
+    /// </summary>
+    class FileStreamBase {
+    protected:
+      FileStreamBase(const char* path, int flags, const FileStreamOptions& options);
+      ~FileStreamBase(void);
+
+      int fd = -1;
+
+      // True if the descriptor really was opened for unbuffered I/O
+      bool direct = false;
+      const size_t ncbAlign;
+
+      uint8_t* pBuf = nullptr;
+      size_t ncbBuf = 0;
+
+      // The offset in the file of the first byte in the buffer, and the number of bytes held there
+      uint64_t m_bufOffset = 0;
+      size_t m_ncbValid = 0;
+
+    public:
+      /// <returns>True if the file was opened for unbuffered I/O</returns>
+      bool IsDirect(void) const { return direct; }
+    };
+  }
+
+  /// <summary>
+  /// Input stream that reads a file in large chunks through a file descriptor
+  /// </summary>
+  class FileInputStream :
+    public internal::FileStreamBase,
+    public IInputStream
+  {
+  public:
+    FileInputStream(const char* path, const FileStreamOptions& options = FileStreamOptions{});
+
+  private:
+    // The length of the file when it was opened
+    uint64_t m_fileSize = 0;
+
+    // The read offset in the buffer
+    size_t m_readOffset = 0;
+
+    bool m_eof = false;
+
+    // The error number of the read that failed, or zero
+    int m_error = 0;
+
+    /// <summary>
+    /// Reads the chunk of the file that holds the current position into the buffer
+    /// </summary>
+    /// <returns>The number of bytes now available past the current position, or -1 if the read failed</returns>
+    std::streamsize Fill(void);
+
+    uint64_t Position(void) const { return m_bufOffset + m_readOffset; }
+
+  public:
+    /// <returns>
+    /// The error number of the read that failed, or zero if none has.  Once a read fails, Read and Skip
+    /// return -1 until Clear or Seek is called.
+    /// </returns>
+    int GetError(void) const { return m_error; }
+
+    bool IsEof(void) const override { return m_eof; }
+    std::streamsize Read(void* pBuf, std::streamsize ncb) override;
+    std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
+    void Consume(std::streamsize ncb) override { m_readOffset += static_cast<size_t>(ncb); }
+    std::streamsize Length(void) override;
+    std::streampos Tell(void) override { return static_cast<std::streamoff>(Position()); }
+    void Clear(void) override { m_error = 0; }
+    IInputStream* Seek(std::streampos off) override;
+  };
+
+  /// <summary>
+  /// Output stream that writes a file in large chunks through a file descriptor
+  /// </summary>
+  /// <remarks>
+  /// Bytes are only handed to the operating system once the buffer fills up, or on Flush.  The stream is
+  /// flushed when it is destroyed.  Unbuffered streams cannot be patched.
+  /// </remarks>
+  class FileOutputStream :
+    public internal::FileStreamBase,
+    public IOutputStream
+  {
+  public:
+    /// <param name="path">The file to write, which is created if it does not exist</param>
+    /// <param name="append">True to keep the contents of an existing file and write after them</param>
+    FileOutputStream(const char* path, bool append = false, const FileStreamOptions& options = FileStreamOptions{});
+    ~FileOutputStream(void);
+
+  private:
+    // True if space was allocated past the end of the file, which must be cut back when it is closed
+    bool m_trim = false;
+
+    /// <summary>
+    /// Hands as much of the buffer to the operating system as can be written at this alignment
+    /// </summary>
+    bool Drain(void);
+
+    /// <summary>
+    /// Writes the specified bytes at the specified offset in the file
+    /// </summary>
+    bool WriteAt(const void* pBuf, size_t ncb, uint64_t off);
+
+  public:
+    bool Write(const void* pBuf, std::streamsize ncb) override;
+    bool Write(const OutputSegment* pSegs, size_t nSegs) override;
+    void Flush(void) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
+    bool CanPatch(void) const override { return !direct; }
+    std::streamoff WriteOffset(void) const override { return static_cast<std::streamoff>(m_bufOffset + m_ncbValid); }
+    bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override;
+
+    using IOutputStream::Write;
+  };
+}
@@ -13,6 +13,37 @@ InputFilterStreamBase::InputFilterStreamBase(std::unique_ptr<IInputStream>&& is)
   buffer(1024, 0)
 {}
 
+int InputFilterStreamBase::Pump(void) {
+  // Pump in from the underlying stream
+  auto nRead = is->Read(inputChunk.data() + inChunkRemain, inputChunk.size() - inChunkRemain);
+  if (nRead < 0)
+    // Treat an error condition as "zero bytes read".  It's possible that we have everything we
+    // need because we still have buffer from the prior read operation.
+    nRead = 0;
+
+  // Increment by the number of bytes unprocessed in the last filter operation
+  nRead += inChunkRemain;
+  if (nRead == 0) {
+    eof = true;
+    return 0;
+  }
+
+  // Handoff to transform behavior:
+  size_t ncbIn = static_cast<size_t>(nRead);
+  buffer.resize(1024);
+  ncbAvail = buffer.size();
+  if (!Transform(inputChunk.data(), ncbIn, buffer.data(), ncbAvail)) {
+    ncbAvail = 0;
+    return -1;
+  }
+
+  // Shift over what we didn't consume under decompression
+  buffer.resize(ncbAvail);
+  inChunkRemain = static_cast<size_t>(nRead) - ncbIn;
+  memmove(inputChunk.data(), inputChunk.data() + nRead - inChunkRemain, inChunkRemain);
+  return 1;
+}
+
 std::streamsize InputFilterStreamBase::Read(void* pBuf, std::streamsize ncb) {
   if (fail)
     return -1;
@@ -30,41 +61,43 @@ std::streamsize InputFilterStreamBase::Read(void* pBuf, std::streamsize ncb) {
       reinterpret_cast<uint8_t*&>(pBuf) += ncbCopy;
       ncbAvail -= ncbCopy;
       ncb -= ncbCopy;
-    } else {
-      // Pump in from the underlying stream
-      auto nRead = is->Read(inputChunk.data() + inChunkRemain, inputChunk.size() - inChunkRemain);
-      if (nRead < 0)
-        // Treat an error condition as "zero bytes read".  It's possible that we have everything we
-        // need because we still have buffer from the prior read operation.
-        nRead = 0;
-
-      // Increment by the number of bytes unprocessed in the last filter operation
-      nRead += inChunkRemain;
-      if (nRead == 0) {
-        eof = true;
+    } else
+      switch (Pump()) {
+      case -1:
+        return -1;
+      case 0:
         return total;
       }
 
-      // Handoff to transform behavior:
-      size_t ncbIn = static_cast<size_t>(nRead);
-      buffer.resize(1024);
-      ncbAvail = buffer.size();
-      if(!Transform(inputChunk.data(), ncbIn, buffer.data(), ncbAvail))
-        return -1;
-
-      // Shift over what we didn't consume under decompression
-      buffer.resize(ncbAvail);
-      inChunkRemain = static_cast<size_t>(nRead) - ncbIn;
-      memmove(inputChunk.data(), inputChunk.data() + nRead - inChunkRemain, inChunkRemain);
-    }
-
   // EOF if we hit the end prematurely
   eof = ncb != 0;
   return total;
 }
 
 std::streamsize InputFilterStreamBase::Skip(std::streamsize ncb) {
-  return 0;
+  std::streamsize total = 0;
+  while (total < ncb) {
+    const void* pBuf;
+    std::streamsize n = std::min(GetContiguous(&pBuf), ncb - total);
+    if (!n)
+      break;
+    Consume(n);
+    total += n;
+  }
+  return total;
+}
+
+std::streamsize InputFilterStreamBase::GetContiguous(const void** ppBuf) {
+  *ppBuf = nullptr;
+  if (fail)
+    return 0;
+
+  // Transformed bytes are already sitting in the holding buffer, lend those out
+  while (!ncbAvail)
+    if (Pump() <= 0)
+      return 0;
+  *ppBuf = &*(buffer.end() - ncbAvail);
+  return static_cast<std::streamsize>(ncbAvail);
 }
 
 OutputFilterStreamBase::OutputFilterStreamBase(std::unique_ptr<IOutputStream>&& os) :
@@ -103,6 +136,17 @@ bool OutputFilterStreamBase::Write(const void* pBuf, std::streamsize ncb) {
   return Write(pBuf, ncb, false);
 }
 
+std::streamsize OutputFilterStreamBase::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  if (reservation.size() < static_cast<size_t>(ncbMin))
+    reservation.resize(static_cast<size_t>(ncbMin));
+  *ppBuf = reservation.data();
+  return static_cast<std::streamsize>(reservation.size());
+}
+
+bool OutputFilterStreamBase::Commit(std::streamsize ncb) {
+  return Write(reservation.data(), ncb, false);
+}
+
 void OutputFilterStreamBase::Flush(void) {
   Write(nullptr, 0, true);
 }
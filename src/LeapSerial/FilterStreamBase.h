@@ -43,11 +43,20 @@ namespace leap {
     /// <param name="ncbOut">The number of bytes in the output buffer; on output, the number of bytes written to the output buffer</param>
     virtual bool Transform(const void* input, size_t& ncbIn, void* output, size_t& ncbOut) = 0;
 
+  private:
+    /// <summary>
+    /// Transforms the next chunk of the underlying stream into the holding buffer
+    /// </summary>
+    /// <returns>-1 if the transform failed, 0 if the underlying stream is exhausted, otherwise 1</returns>
+    int Pump(void);
+
   public:
     // IInputStream overrides:
     bool IsEof(void) const override { return eof; }
     std::streamsize Read(void* pBuf, std::streamsize ncb) override;
     std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
+    void Consume(std::streamsize ncb) override { ncbAvail -= static_cast<size_t>(ncb); }
   };
 
   /// <summary>
@@ -71,6 +80,9 @@ namespace leap {
     // Fail bit, used to indicate something went wrong with compression
     bool fail = false;
 
+    // Space lent out by Reserve, which is transformed straight from here when it is committed
+    std::vector<uint8_t> reservation;
+
     /// <summary>
     /// In-memory transform operation
     /// </summary>
@@ -85,5 +97,7 @@ namespace leap {
     // IOutputStream overrides:
     bool Write(const void* pBuf, std::streamsize ncb) override;
     void Flush(void) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
   };
 }
@@ -22,6 +22,9 @@ namespace leap {
     bool IsEof(void) const { return is.IsEof(); }
     std::streamsize Read(void* pBuf, std::streamsize ncb) { return is.Read(pBuf, ncb); }
     std::streamsize Skip(std::streamsize ncb) { return is.Skip(ncb); }
+    std::streamsize GetContiguous(const void** ppBuf) { return is.GetContiguous(ppBuf); }
+    void Consume(std::streamsize ncb) { is.Consume(ncb); }
+    bool CanRetain(void) const { return is.CanRetain(); }
     std::streamsize Length(void) { return is.Length(); }
   };
 
@@ -38,7 +41,13 @@ namespace leap {
 
   public:
     bool Write(const void* pBuf, std::streamsize ncb) override { return os.Write(pBuf, ncb); }
+    bool Write(const OutputSegment* pSegs, size_t nSegs) override { return os.Write(pSegs, nSegs); }
     CopyResult Write(IInputStream& is, void* scratch, std::streamsize ncbScratch, std::streamsize& ncb) override { return os.Write(is, scratch, ncbScratch, ncb); }
     void Flush(void) override { os.Flush(); }
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override { return os.Reserve(ppBuf, ncbMin); }
+    bool Commit(std::streamsize ncb) override { return os.Commit(ncb); }
+    bool CanPatch(void) const override { return os.CanPatch(); }
+    std::streamoff WriteOffset(void) const override { return os.WriteOffset(); }
+    bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override { return os.Patch(off, pBuf, ncb); }
   };
 }
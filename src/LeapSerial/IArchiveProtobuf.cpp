@@ -5,15 +5,31 @@
 #include "field_serializer.h"
 #include "ProtobufUtil.hpp"
 #include "Utility.hpp"
+#include <algorithm>
 #include <iostream>
+#include <memory.h>
 
 using namespace leap;
+using leap::internal::protobuf::ToWireType;
 using leap::internal::protobuf::WireType;
 
 IArchiveProtobuf::IArchiveProtobuf(IInputStream& is) :
-  is(is)
+  pIs(&is)
 {}
 
+void IArchiveProtobuf::Reset(void) {
+  m_pCurDesc = nullptr;
+  m_lenDelimited = false;
+  m_pPacked = nullptr;
+  m_nPacked = 0;
+  m_count = 0;
+}
+
+void IArchiveProtobuf::Rebind(IInputStream& is) {
+  Reset();
+  pIs = &is;
+}
+
 void IArchiveProtobuf::ReadObject(const field_serializer& sz, void* pObj, internal::AllocationBase* pOwner) {
   sz.deserialize(*this, pObj, 0);
 }
@@ -23,20 +39,20 @@ IArchive::ReleasedMemory IArchiveProtobuf::ReadObjectReferenceResponsible(Releas
 }
 
 void IArchiveProtobuf::Skip(uint64_t ncb) {
-  is.Skip(ncb);
+  pIs->Skip(ncb);
   m_count += ncb;
 }
 
-bool IArchiveProtobuf::ReadSingle(const descriptor& descriptor, void* pObj) {
+bool IArchiveProtobuf::ReadSingle(const descriptor& descriptor, void* pObj, size_t& hint) {
   uint64_t v = ReadInteger(0);
-  if (is.IsEof())
+  if (pIs->IsEof())
     return false;
 
   WireType type = static_cast<WireType>(v & 7);
   uint64_t ident = v >> 3;
 
-  auto q = descriptor.identified_descriptors.find(ident);
-  if (q == descriptor.identified_descriptors.end())
+  const field_descriptor* field = descriptor.find_identified(ident, hint);
+  if (!field)
     // Skip behavior
     switch (type) {
     case WireType::Varint:
@@ -57,13 +73,15 @@ bool IArchiveProtobuf::ReadSingle(const descriptor& descriptor, void* pObj) {
     case WireType::ObjReference:
       throw std::runtime_error("Cannot serialize object references");
     }
-  else
+  else {
     // Straight handoff to deserialize
-    q->second.serializer.deserialize(
+    m_lenDelimited = type == WireType::LenDelimit;
+    field->serializer.deserialize(
       *this,
-      reinterpret_cast<uint8_t*>(pObj) + q->second.offset,
+      reinterpret_cast<uint8_t*>(pObj) + field->offset,
       0
     );
+  }
   return true;
 }
 
@@ -79,15 +97,16 @@ void IArchiveProtobuf::ReadDescriptor(const descriptor& descriptor, void* pObj,
   leap::internal::Pusher<decltype(m_pCurDesc)> r(m_pCurDesc);
   m_pCurDesc = &descriptor;
 
+  size_t hint = 0;
   if(ncb)
   {
     uint64_t maxCount = m_count + ncb;
     while (m_count < maxCount)
-      if(!ReadSingle(descriptor, pObj))
+      if(!ReadSingle(descriptor, pObj, hint))
         throw std::runtime_error("Premature end of input stream");
   }
   else
-    while (ReadSingle(descriptor, pObj));
+    while (ReadSingle(descriptor, pObj, hint));
 }
 
 void IArchiveProtobuf::ReadByteArray(void* pBuf, uint64_t ncb) {
@@ -96,7 +115,7 @@ void IArchiveProtobuf::ReadByteArray(void* pBuf, uint64_t ncb) {
 void IArchiveProtobuf::ReadString(std::function<void*(uint64_t)> getBufferFn, uint8_t charSize, uint64_t ncb) {
   uint64_t n = ReadInteger(0);
   void* pBuf = getBufferFn(n);
-  is.Read(pBuf, n);
+  pIs->Read(pBuf, n);
   m_count += n;
 }
 
@@ -105,9 +124,14 @@ bool IArchiveProtobuf::ReadBool(void) {
 }
 
 uint64_t IArchiveProtobuf::ReadInteger(uint8_t) {
+  if (m_nPacked) {
+    m_nPacked--;
+    return *m_pPacked++;
+  }
+
   size_t ncb = 0;
   uint8_t buf[10];
-  do if(is.Read(buf, 1) < 0)
+  do if(pIs->Read(buf, 1) < 0)
     return ~0;
   while (buf[ncb++] & 0x80);
   m_count += ncb;
@@ -115,11 +139,13 @@ uint64_t IArchiveProtobuf::ReadInteger(uint8_t) {
 }
 
 void IArchiveProtobuf::ReadFloat(float& value) {
-  is.Read(&value, sizeof(value));
+  pIs->Read(&value, sizeof(value));
+  m_count += sizeof(value);
 }
 
 void IArchiveProtobuf::ReadFloat(double& value) {
-  is.Read(&value, sizeof(value));
+  pIs->Read(&value, sizeof(value));
+  m_count += sizeof(value);
 }
 
 void IArchiveProtobuf::ReadFloat(long double& value) {
@@ -129,12 +155,103 @@ void IArchiveProtobuf::ReadFloat(long double& value) {
 }
 
 void IArchiveProtobuf::ReadArray(IArrayAppender&& ary) {
+  WireType elementType = ToWireType(ary.serializer.type());
+  if (m_lenDelimited && elementType != WireType::LenDelimit) {
+    // Packed repeated field, the entries follow one another without any keys
+    uint64_t ncb = ReadInteger(8);
+    if (elementType == WireType::Varint) {
+      ReadPackedVarints(ary, ncb);
+      return;
+    }
+
+    uint64_t maxCount = m_count + ncb;
+    const uint64_t width = elementType == WireType::QuadWord ? 8 : elementType == WireType::DoubleWord ? 4 : 0;
+    size_t stride = 0;
+    uint8_t* pEntry = nullptr;
+    if (width && !(ncb % width))
+      // Fixed-width entries, so the number of entries is known up front
+      pEntry = static_cast<uint8_t*>(ary.allocate_n(static_cast<size_t>(ncb / width), stride));
+
+    if (pEntry)
+      for (uint64_t i = ncb / width; i--; pEntry += stride)
+        ary.serializer.deserialize(*this, pEntry, 0);
+    else
+      while (m_count < maxCount)
+        ary.serializer.deserialize(*this, ary.allocate(), 0);
+    if (m_count != maxCount)
+      throw std::runtime_error("Stray bytes encountered after deserializing a packed field");
+    return;
+  }
+
   // Protobuf array deserialization is funny, it's just a bunch of single entries repeated
   // over and over again.
   void* pEntry = ary.allocate();
   ary.serializer.deserialize(*this, pEntry, 0);
 }
 
+void IArchiveProtobuf::ReadPackedVarints(IArrayAppender& ary, uint64_t ncb) {
+  const serial_atom atom = ary.serializer.type();
+  size_t width = 0;
+  switch (atom) {
+  case serial_atom::boolean:
+    width = sizeof(bool);
+    break;
+  case serial_atom::i8:
+  case serial_atom::ui8:
+    width = 1;
+    break;
+  case serial_atom::i16:
+  case serial_atom::ui16:
+    width = 2;
+    break;
+  case serial_atom::i32:
+  case serial_atom::ui32:
+    width = 4;
+    break;
+  default:
+    width = 8;
+    break;
+  }
+
+  static const size_t sc_nBatch = 256;
+  uint8_t buf[sc_nBatch];
+  uint64_t vals[sc_nBatch];
+  size_t ncbBuf = 0;
+  while (ncb || ncbBuf) {
+    size_t ncbRead = static_cast<size_t>(std::min<uint64_t>(ncb, sizeof(buf) - ncbBuf));
+    if (ncbRead) {
+      if (pIs->Read(buf + ncbBuf, ncbRead) != static_cast<std::streamsize>(ncbRead))
+        throw std::runtime_error("Premature end of input stream");
+      m_count += ncbRead;
+      ncb -= ncbRead;
+      ncbBuf += ncbRead;
+    }
+
+    size_t ncbUsed;
+    size_t nDecoded = FromBase128(buf, ncbBuf, vals, sc_nBatch, ncbUsed);
+    if (!nDecoded && (!ncb || ncbBuf == sizeof(buf)))
+      throw std::runtime_error("Malformed varint encountered in a packed field");
+
+    if (atom == serial_atom::boolean)
+      for (size_t i = 0; i < nDecoded; i++)
+        vals[i] = !!vals[i];
+
+    void* pDest = ary.allocate_raw(nDecoded);
+    if (pDest)
+      NarrowIntegers(vals, nDecoded, pDest, width);
+    else {
+      // No contiguous storage, let the element serializer pick up each value via ReadInteger
+      leap::internal::Pusher<const uint64_t*> p(m_pPacked);
+      m_pPacked = vals;
+      for (m_nPacked = nDecoded; m_nPacked;)
+        ary.serializer.deserialize(*this, ary.allocate(), 0);
+    }
+
+    ncbBuf -= ncbUsed;
+    memmove(buf, buf + ncbUsed, ncbBuf);
+  }
+}
+
 void IArchiveProtobuf::ReadDictionary(IDictionaryInserter&& dictionary)
 {
   // Read out length field first
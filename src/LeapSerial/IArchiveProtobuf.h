@@ -12,6 +12,8 @@ namespace leap {
     void ReadObject(const field_serializer& sz, void* pObj, internal::AllocationBase* pOwner) override;
     ReleasedMemory ReadObjectReferenceResponsible(ReleasedMemory(*pfnAlloc)(), const field_serializer& sz, bool isUnique) override;
 
+    void Reset(void) override;
+    void Rebind(IInputStream& is) override;
     void Skip(uint64_t ncb) override;
     uint64_t Count(void) const override { return 0; }
 
@@ -29,13 +31,30 @@ namespace leap {
     void* ReadObjectReference(const create_delete& cd, const field_serializer& desc) override;
 
   private:
-    bool ReadSingle(const descriptor& descriptor, void* pObj);
+    /// <summary>
+    /// Reads one field of the specified descriptor
+    /// </summary>
+    /// <param name="hint">Field lookup state, see descriptor::find_identified</param>
+    /// <returns>False if the end of the stream was reached</returns>
+    bool ReadSingle(const descriptor& descriptor, void* pObj, size_t& hint);
+
+    /// <summary>
+    /// Reads the payload of a packed repeated field of varints, decoding the entries in batches
+    /// </summary>
+    void ReadPackedVarints(IArrayAppender& ary, uint64_t ncb);
 
     // Descriptor of current object being read, if any exist:
     const descriptor* m_pCurDesc = nullptr;
 
+    // True if the field currently being read was written with the length-delimited wire type
+    bool m_lenDelimited = false;
+
+    // Entries of a packed repeated field that have been decoded but not yet handed out by ReadInteger
+    const uint64_t* m_pPacked = nullptr;
+    size_t m_nPacked = 0;
+
     // Stream traits:
     uint64_t m_count = 0;
-    IInputStream& is;
+    IInputStream* pIs;
   };
 }
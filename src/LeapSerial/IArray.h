@@ -46,6 +46,23 @@ namespace leap {
     /// The size of the array object
     /// </returns>
     virtual size_t size(void) const = 0;
+
+    /// <returns>
+    /// A pointer to the elements of the array, if they are arithmetic and stored contiguously, or nullptr
+    /// </returns>
+    /// <remarks>
+    /// Archives may use this to transfer the whole array as a single block rather than serializing each
+    /// element individually.  The returned pointer must be valid for size() * immutable_size() bytes.
+    /// </remarks>
+    virtual const void* data(void) const { return nullptr; }
+
+    /// <returns>
+    /// The array object itself, if its entries are owned by it, or nullptr
+    /// </returns>
+    /// <remarks>
+    /// Archives treat the entries as being exactly as stable as this object.
+    /// </remarks>
+    virtual const void* object(void) const { return nullptr; }
   };
 
   struct IArrayAppender {
@@ -70,5 +87,27 @@ namespace leap {
     /// The returned space must be default-constructed or otherwise valid
     /// </remarks>
     virtual void* allocate(void) = 0;
+
+    /// <summary>
+    /// Allocates contiguous space for n new entries in the array
+    /// </summary>
+    /// <returns>
+    /// A pointer to the first of the new entries, or nullptr if the array cannot provide contiguous storage
+    /// </returns>
+    /// <remarks>
+    /// This is only supported for arrays of arithmetic types.  The returned space may be overwritten
+    /// directly with the raw bytes of n elements.
+    /// </remarks>
+    virtual void* allocate_raw(size_t n) { return nullptr; }
+
+    /// <summary>
+    /// Allocates contiguous space for n new default-constructed entries in the array
+    /// </summary>
+    /// <param name="stride">Receives the distance in bytes between consecutive entries</param>
+    /// <returns>
+    /// A pointer to the first of the new entries, or nullptr if the array cannot provide contiguous
+    /// storage, in which case the caller should fall back to calling allocate once per entry
+    /// </returns>
+    virtual void* allocate_n(size_t n, size_t& stride) { return nullptr; }
   };
 }
@@ -43,6 +43,14 @@ namespace leap {
 
     /// <returns>The currently enumerated value</returns>
     virtual const void* value(void) const = 0;
+
+    /// <returns>
+    /// The dictionary object itself, if its entries are owned by it, or nullptr
+    /// </returns>
+    /// <remarks>
+    /// Archives treat the keys and values as being exactly as stable as this object.
+    /// </remarks>
+    virtual const void* object(void) const { return nullptr; }
   };
 
   /// <summary>
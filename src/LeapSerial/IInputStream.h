@@ -32,6 +32,35 @@ namespace leap {
     /// </summary>
     virtual std::streamsize Skip(std::streamsize ncb) = 0;
 
+    /// <summary>
+    /// Borrows the bytes at the current read position that are already contiguous in memory
+    /// </summary>
+    /// <param name="ppBuf">Receives a pointer to the first available byte</param>
+    /// <returns>
+    /// The number of bytes available at *ppBuf, or zero if the stream cannot lend any bytes right now.
+    /// Zero does not imply end of file; Read must be used to make progress in that case.
+    /// </returns>
+    /// <remarks>
+    /// The stream position does not move until Consume is called.  Borrowed bytes remain valid until
+    /// the next call to any other method on this stream, except for Consume, Tell, Length, and IsEof.
+    /// </remarks>
+    virtual std::streamsize GetContiguous(const void** ppBuf) {
+      *ppBuf = nullptr;
+      return 0;
+    }
+
+    /// <summary>
+    /// Advances the stream past bytes that were previously borrowed with GetContiguous
+    /// </summary>
+    /// <param name="ncb">The number of bytes to consume, at most the count returned by GetContiguous</param>
+    virtual void Consume(std::streamsize ncb) { Skip(ncb); }
+
+    /// <returns>
+    /// True if bytes lent out by GetContiguous stay valid after they are consumed, for as long as the
+    /// memory underlying this stream, so that callers may keep pointers to them
+    /// </returns>
+    virtual bool CanRetain(void) const { return false; }
+
     /// <returns>
     /// The number of bytes remaining in the input stream
     /// </returns>
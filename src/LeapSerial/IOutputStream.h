@@ -8,6 +8,14 @@
 namespace leap {
   class IInputStream;
 
+  /// <summary>
+  /// One of the runs of bytes passed to a gather write
+  /// </summary>
+  struct OutputSegment {
+    const void* pBuf;
+    std::streamsize ncb;
+  };
+
   /// <summary>
   /// Stream adaptor interface for use with the Archive type
   /// </summary>
@@ -35,6 +43,20 @@ namespace leap {
     /// </summary>
     virtual bool Write(const void* pBuf, std::streamsize ncb) = 0;
 
+    /// <summary>
+    /// Writes each of the specified runs of bytes to the output stream, in order
+    /// </summary>
+    /// <remarks>
+    /// Streams backed by a file descriptor pass all of the runs to the operating system in a single call,
+    /// so that a large payload need not be copied in behind the header that precedes it.
+    /// </remarks>
+    virtual bool Write(const OutputSegment* pSegs, size_t nSegs) {
+      for (size_t i = 0; i < nSegs; i++)
+        if (!Write(pSegs[i].pBuf, pSegs[i].ncb))
+          return false;
+      return true;
+    }
+
     /// <summary>
     /// Writes the specified number of bytes from the specified input stream
     /// </summary>
@@ -111,5 +133,47 @@ namespace leap {
     /// Causes any unwritten data to be flushed from memory
     /// </summary>
     virtual void Flush(void) {}
+
+    /// <summary>
+    /// Reserves space at the end of the stream that the caller may write into directly
+    /// </summary>
+    /// <param name="ppBuf">Receives a pointer to the reserved space</param>
+    /// <param name="ncbMin">The minimum number of bytes the caller needs</param>
+    /// <returns>
+    /// The number of bytes reserved, which is at least ncbMin, or zero if the stream cannot reserve
+    /// that much space.  Write must be used in that case.
+    /// </returns>
+    /// <remarks>
+    /// Every successful reservation must be followed by a call to Commit before the stream is written to,
+    /// flushed, or reserved from again.  Nothing written to the reserved space is part of the stream until
+    /// then, and WriteOffset does not move.  Bytes committed earlier may still be patched meanwhile.
+    /// </remarks>
+    virtual std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) {
+      *ppBuf = nullptr;
+      return 0;
+    }
+
+    /// <summary>
+    /// Appends the first ncb bytes of the outstanding reservation to the stream and backs up the rest
+    /// </summary>
+    /// <returns>False if the bytes could not be written</returns>
+    virtual bool Commit(std::streamsize ncb) { return false; }
+
+    /// <returns>
+    /// True if bytes already written to this stream may be overwritten in place with Patch
+    /// </returns>
+    virtual bool CanPatch(void) const { return false; }
+
+    /// <returns>
+    /// The offset at which the next byte will be written, or -1 if patching is not supported
+    /// </returns>
+    virtual std::streamoff WriteOffset(void) const { return -1; }
+
+    /// <summary>
+    /// Overwrites bytes previously written to the stream
+    /// </summary>
+    /// <param name="off">An offset obtained from WriteOffset</param>
+    /// <returns>False if the stream does not support patching or the range was never written</returns>
+    virtual bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) { return false; }
   };
 }
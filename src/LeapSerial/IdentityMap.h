@@ -0,0 +1,44 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "OpenTable.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Maps object addresses to the identifiers they have been assigned in an output stream
+    /// </summary>
+    class IdentityMap {
+    private:
+      struct hash {
+        uint64_t operator()(const void* pObj) const {
+          // Fibonacci hashing; objects are aligned, so the low bits of the address carry little information
+          return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pObj)) * 0x9E3779B97F4A7C15ULL;
+        }
+      };
+
+      OpenTable<const void*, uint32_t, hash> m_table;
+
+    public:
+      /// <returns>The number of entries in the map</returns>
+      size_t Size(void) const { return m_table.Size(); }
+
+      /// <returns>The identifier assigned to pObj, or zero if pObj is not in the map</returns>
+      uint32_t Find(const void* pObj) const {
+        const uint32_t* pId = m_table.Find(pObj);
+        return pId ? *pId : 0;
+      }
+
+      /// <summary>
+      /// Assigns an identifier to an object that is not yet in the map
+      /// </summary>
+      void Insert(const void* pObj, uint32_t id) { m_table.Insert(pObj, id); }
+
+      /// <summary>
+      /// Removes all entries without releasing the table
+      /// </summary>
+      void Clear(void) { m_table.Clear(); }
+    };
+  }
+}
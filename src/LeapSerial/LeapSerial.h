@@ -4,6 +4,7 @@
 #include "Archive.h"
 #include "Descriptor.h"
 #include "field_serializer.h"
+#include "fields.h"
 #include "ArchiveLeapSerial.h"
 #include "IArchiveProtobuf.h"
 #include "OArchiveProtobuf.h"
@@ -102,6 +103,44 @@ namespace leap {
     return { retVal, pObj };
   }
 
+  /// <summary>
+  /// Deserialization routine that places the objects of the graph in an arena
+  /// </summary>
+  /// <remarks>
+  /// Objects referenced by raw pointers are allocated from a single bump-pointer arena, owned by the
+  /// returned pointer, and are released all at once when it goes away.  This is much cheaper than
+  /// allocating and freeing each object separately when the graph is large.  Objects referenced by smart
+  /// pointers are still allocated individually, because their owners free them individually.
+  /// </remarks>
+  template<class T = void, class archive_t = IArchiveLeapSerial, class stream_t = std::istream>
+  std::shared_ptr<T> DeserializeArena(stream_t&& is) {
+    auto retVal = std::make_shared<leap::internal::Allocation<T>>();
+    retVal->arena.reset(new leap::internal::Arena);
+    T* pObj = &retVal->val;
+
+    archive_t ar(is);
+    ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), pObj, retVal.get());
+    return { retVal, pObj };
+  }
+
+  /// <summary>
+  /// Deserialization routine that defers objects referred to by lazy_ptr fields until they are used
+  /// </summary>
+  /// <remarks>
+  /// The stream must be able to seek, otherwise everything is read right away.  Deferred objects are read
+  /// from the stream when they are first dereferenced, so the stream must outlive the returned graph.
+  /// </remarks>
+  template<class T = void, class stream_t = std::istream>
+  std::shared_ptr<T> DeserializeLazy(stream_t&& is) {
+    auto retVal = std::make_shared<leap::internal::Allocation<T>>();
+    T* pObj = &retVal->val;
+
+    IArchiveLeapSerial ar(is);
+    ar.Lazy = true;
+    ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), pObj, retVal.get());
+    return { retVal, pObj };
+  }
+
   /// <summary>
   /// Deserialization routine that modifies object in place
   /// </summary>
@@ -112,6 +151,55 @@ namespace leap {
     ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), &obj, nullptr);
   }
 
+  /// <summary>
+  /// Deserialization routine that reads only the selected fields of the root object
+  /// </summary>
+  /// <remarks>
+  /// If fields that are not selected refer to other objects, the stream must be able to seek in order for
+  /// objects that follow in the same stream to be read.
+  /// </remarks>
+  template<class T, class archive_t = IArchiveLeapSerial, class stream_t = std::istream>
+  std::shared_ptr<T> Deserialize(stream_t&& is, fields projection) {
+    auto retVal = std::make_shared<leap::internal::Allocation<T>>();
+    T* pObj = &retVal->val;
+
+    archive_t ar(is);
+    ar.ReadObject(projection.project(serial_traits<T>::get_descriptor()), pObj, retVal.get());
+    return { retVal, pObj };
+  }
+
+  /// <summary>
+  /// Deserialization routine that reads only the selected fields of the root object, modifying the object in place
+  /// </summary>
+  template<class archive_t = IArchiveLeapSerial, class T = void, class stream_t = std::istream>
+  void Deserialize(stream_t&& is, T& obj, fields projection) {
+    archive_t ar(is);
+    ar.ReadObject(projection.project(serial_traits<T>::get_descriptor()), &obj, nullptr);
+  }
+
+  /// <summary>
+  /// Deserialization routine that reads the next object from an existing archive
+  /// </summary>
+  /// <remarks>
+  /// Reusing an archive across calls, together with Reset or Rebind, avoids the setup cost of a new archive
+  /// and lets the archive keep its internal tables from one object to the next.
+  /// </remarks>
+  template<class T, class archive_t>
+  std::shared_ptr<T> DeserializeWithArchive(archive_t& ar) {
+    auto retVal = std::make_shared<leap::internal::Allocation<T>>();
+    T* pObj = &retVal->val;
+    ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), pObj, retVal.get());
+    return { retVal, pObj };
+  }
+
+  /// <summary>
+  /// Deserialization routine that reads the next object from an existing archive, modifying the object in place
+  /// </summary>
+  template<class archive_t, class T>
+  void DeserializeWithArchive(archive_t& ar, T& obj) {
+    ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), &obj, nullptr);
+  }
+
   // Fill a collection with objects serialized to 'is'
   // Returns one past the end of the container
   template<class T, class archive_t = IArchiveLeapSerial, class stream_t = std::istream>
@@ -0,0 +1,164 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "MappedStream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace leap;
+using namespace leap::internal;
+
+static int ToAdvice(AccessHint access) {
+  switch (access) {
+  case AccessHint::Sequential:
+    return MADV_SEQUENTIAL;
+  case AccessHint::Random:
+    return MADV_RANDOM;
+  default:
+    return MADV_NORMAL;
+  }
+}
+
+static std::system_error LastError(const char* what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+MappedRegion::MappedRegion(const char* path, AccessHint access) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    throw LastError("Failed to open a file for mapping");
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    auto err = LastError("Failed to get the size of a file for mapping");
+    close(fd);
+    throw err;
+  }
+
+  // Nothing can be mapped from an empty file, and there is nothing to read from it anyway
+  ncbMapped = static_cast<size_t>(st.st_size);
+  if (ncbMapped) {
+    void* p = mmap(nullptr, ncbMapped, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      auto err = LastError("Failed to map a file");
+      close(fd);
+      throw err;
+    }
+    pBase = p;
+  }
+
+  // The mapping keeps the file alive on its own
+  close(fd);
+  Advise(access);
+}
+
+MappedRegion::~MappedRegion(void) {
+  if (pBase)
+    munmap(pBase, ncbMapped);
+}
+
+void MappedRegion::Advise(AccessHint access) {
+  if (pBase)
+    madvise(pBase, ncbMapped, ToAdvice(access));
+}
+
+MappedInputStream::MappedInputStream(const char* path, AccessHint access) :
+  MappedRegion(path, access),
+  BufferedInputStream(pBase, ncbMapped)
+{}
+
+MappedOutputStream::MappedOutputStream(const char* path, bool append, size_t ncbInitial) {
+  fd = open(path, O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0666);
+  if (fd < 0)
+    throw LastError("Failed to open a file for mapping");
+
+  if (append) {
+    struct stat st;
+    if (fstat(fd, &st)) {
+      auto err = LastError("Failed to get the size of a file for mapping");
+      close(fd);
+      fd = -1;
+      throw err;
+    }
+    m_writeOffset = static_cast<size_t>(st.st_size);
+  }
+
+  if (!Grow(std::max<size_t>(ncbInitial, 1))) {
+    auto err = LastError("Failed to map a file");
+    close(fd);
+    fd = -1;
+    throw err;
+  }
+}
+
+MappedOutputStream::~MappedOutputStream(void) {
+  if (pBase)
+    munmap(pBase, ncbMapped);
+
+  // Give back whatever was reserved but never written, there is no way to report a failure from here
+  int rc = ftruncate(fd, static_cast<off_t>(m_writeOffset));
+  (void)rc;
+  close(fd);
+}
+
+bool MappedOutputStream::Grow(size_t ncb) {
+  if (ncbMapped - m_writeOffset >= ncb && pBase)
+    return true;
+
+  // Double the size of the file each time, so that remapping is rare
+  size_t ncbNew = std::max(m_writeOffset + ncb, 2 * ncbMapped);
+  if (ftruncate(fd, static_cast<off_t>(ncbNew)))
+    return false;
+
+  void* p = mmap(nullptr, ncbNew, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    return false;
+  madvise(p, ncbNew, MADV_SEQUENTIAL);
+
+  if (pBase)
+    munmap(pBase, ncbMapped);
+  pBase = static_cast<uint8_t*>(p);
+  ncbMapped = ncbNew;
+  return true;
+}
+
+bool MappedOutputStream::Write(const void* pBuf, std::streamsize ncb) {
+  if (!Grow(static_cast<size_t>(ncb)))
+    return false;
+  memcpy(pBase + m_writeOffset, pBuf, static_cast<size_t>(ncb));
+  m_writeOffset += static_cast<size_t>(ncb);
+  return true;
+}
+
+void MappedOutputStream::Flush(void) {
+  // Starts writing back dirty pages without waiting for them
+  msync(pBase, ncbMapped, MS_ASYNC);
+}
+
+std::streamsize MappedOutputStream::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  // Everything mapped past the write offset is ours to lend out
+  if (!Grow(static_cast<size_t>(ncbMin))) {
+    *ppBuf = nullptr;
+    return 0;
+  }
+  *ppBuf = pBase + m_writeOffset;
+  return static_cast<std::streamsize>(ncbMapped - m_writeOffset);
+}
+
+bool MappedOutputStream::Commit(std::streamsize ncb) {
+  m_writeOffset += static_cast<size_t>(ncb);
+  return true;
+}
+
+bool MappedOutputStream::Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) {
+  if (off < 0 || static_cast<std::streamoff>(m_writeOffset) - off < ncb)
+    return false;
+
+  memcpy(pBase + off, pBuf, static_cast<size_t>(ncb));
+  return true;
+}
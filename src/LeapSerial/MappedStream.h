@@ -0,0 +1,87 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "AccessHint.h"
+#include "BufferedInputStream.h"
+#include "IOutputStream.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Read-only mapping of an entire file
+    /// </summary>
+    class MappedRegion {
+    protected:
+      MappedRegion(const char* path, AccessHint access);
+      ~MappedRegion(void);
+
+      void* pBase = nullptr;
+      size_t ncbMapped = 0;
+
+    public:
+      /// <summary>
+      /// Changes the access hint given for this mapping
+      /// </summary>
+      void Advise(AccessHint access);
+    };
+  }
+
+  /// <summary>
+  /// Input stream over a file that is mapped into memory
+  /// </summary>
+  /// <remarks>
+  /// The whole file is lent out through GetContiguous, and stays valid for the lifetime of the stream, so
+  /// archives can parse it in place and string_ref fields can point into it.  The file must not be
+  /// truncated while it is mapped.
+  /// </remarks>
+  class MappedInputStream :
+    public internal::MappedRegion,
+    public BufferedInputStream
+  {
+  public:
+    MappedInputStream(const char* path, AccessHint access = AccessHint::Sequential);
+  };
+
+  /// <summary>
+  /// Output stream that writes to a file through a memory mapping
+  /// </summary>
+  /// <remarks>
+  /// The file is extended and remapped as it fills up, so pointers obtained from Reserve do not survive
+  /// a later Write or Reserve.  The file is trimmed to the number of bytes written when the stream is
+  /// destroyed; until then, it may be longer.
+  /// </remarks>
+  class MappedOutputStream :
+    public IOutputStream
+  {
+  public:
+    /// <param name="path">The file to write, which is created if it does not exist</param>
+    /// <param name="append">True to keep the contents of an existing file and write after them</param>
+    /// <param name="ncbInitial">The size that the file is initially extended to</param>
+    MappedOutputStream(const char* path, bool append = false, size_t ncbInitial = 1024 * 1024);
+    ~MappedOutputStream(void);
+
+  private:
+    int fd = -1;
+    uint8_t* pBase = nullptr;
+    size_t ncbMapped = 0;
+    size_t m_writeOffset = 0;
+
+    /// <summary>
+    /// Ensures at least the specified number of bytes are mapped past the write offset
+    /// </summary>
+    /// <returns>False if the file could not be extended or remapped, in which case errno says why</returns>
+    bool Grow(size_t ncb);
+
+  public:
+    bool Write(const void* pBuf, std::streamsize ncb) override;
+    void Flush(void) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
+    bool CanPatch(void) const override { return true; }
+    std::streamoff WriteOffset(void) const override { return static_cast<std::streamoff>(m_writeOffset); }
+    bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override;
+
+    using IOutputStream::Write;
+  };
+}
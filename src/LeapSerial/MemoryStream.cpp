@@ -8,16 +8,19 @@ using namespace leap;
 
 MemoryStream::MemoryStream(void) {}
 
-bool MemoryStream::Write(const void* pBuf, std::streamsize ncb) {
-  if (buffer.size() - m_writeOffset < static_cast<size_t>(ncb))
+void MemoryStream::Grow(size_t ncb) {
+  if (buffer.size() - m_writeOffset < ncb)
     // Exponential growth on the buffer:
     buffer.resize(
       std::max(
         buffer.size() * 2,
-        m_writeOffset + static_cast<size_t>(ncb)
+        m_writeOffset + ncb
       )
     );
+}
 
+bool MemoryStream::Write(const void* pBuf, std::streamsize ncb) {
+  Grow(static_cast<size_t>(ncb));
   memcpy(
     buffer.data() + m_writeOffset,
     pBuf,
@@ -27,6 +30,18 @@ bool MemoryStream::Write(const void* pBuf, std::streamsize ncb) {
   return true;
 }
 
+std::streamsize MemoryStream::Reserve(void** ppBuf, std::streamsize ncbMin) {
+  // Everything past the write offset is ours to lend out
+  Grow(static_cast<size_t>(ncbMin));
+  *ppBuf = buffer.data() + m_writeOffset;
+  return static_cast<std::streamsize>(buffer.size() - m_writeOffset);
+}
+
+bool MemoryStream::Commit(std::streamsize ncb) {
+  m_writeOffset += static_cast<size_t>(ncb);
+  return true;
+}
+
 std::streamsize MemoryStream::Read(void* pBuf, std::streamsize ncb) {
   const void* pSrcData = buffer.data() + m_readOffset;
   ncb = Skip(ncb);
@@ -50,6 +65,20 @@ std::streamsize MemoryStream::Skip(std::streamsize ncb) {
   return nSkipped;
 }
 
+std::streamsize MemoryStream::GetContiguous(const void** ppBuf) {
+  // Consume goes through Skip, which may rewind the offsets, but it never touches the buffer itself
+  *ppBuf = buffer.data() + m_readOffset;
+  return static_cast<std::streamsize>(m_writeOffset - m_readOffset);
+}
+
 std::streamsize MemoryStream::Length(void) {
   return static_cast<std::streamsize>(m_writeOffset - m_readOffset);
 }
+
+bool MemoryStream::Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) {
+  if (off < static_cast<std::streamoff>(m_readOffset) || static_cast<std::streamoff>(m_writeOffset) - off < ncb)
+    return false;
+
+  memcpy(buffer.data() + off, pBuf, static_cast<size_t>(ncb));
+  return true;
+}
@@ -26,16 +26,32 @@ namespace leap {
     // EOF flag
     bool m_eof = false;
 
+    /// <summary>
+    /// Ensures at least the specified number of bytes are available past the write offset
+    /// </summary>
+    void Grow(size_t ncb);
+
   public:
     std::vector<uint8_t>& GetData(void) { return buffer; }
     const std::vector<uint8_t>& GetData(void) const { return buffer; }
 
     bool Write(const void* pBuf, std::streamsize ncb) override;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override;
+    bool Commit(std::streamsize ncb) override;
     bool IsEof(void) const override { return m_eof; }
     std::streamsize Read(void* pBuf, std::streamsize ncb) override;
     std::streamsize Skip(std::streamsize ncb) override;
+    std::streamsize GetContiguous(const void** ppBuf) override;
     std::streamsize Length(void) override;
 
+    /// <remarks>
+    /// Write offsets are relative to the start of the buffer, which is rewound whenever a read
+    /// operation consumes all written bytes.  Offsets must not be retained across such a read.
+    /// </remarks>
+    bool CanPatch(void) const override { return true; }
+    std::streamoff WriteOffset(void) const override { return static_cast<std::streamoff>(m_writeOffset); }
+    bool Patch(std::streamoff off, const void* pBuf, std::streamsize ncb) override;
+
     using leap::IOutputStream::Write;
   };
 }
@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include "OArchiveProtobuf.h"
 #include "Descriptor.h"
+#include "Plan.h"
 #include "field_serializer.h"
 #include "ProtobufUtil.hpp"
 #include "Utility.hpp"
@@ -17,12 +18,17 @@ OArchiveProtobuf::OArchiveProtobuf(IOutputStream& os):
   OArchiveRegistry(os)
 {}
 
+void OArchiveProtobuf::Reset(void) {
+  curDescEntry = nullptr;
+  sizeCache.Clear();
+}
+
 void OArchiveProtobuf::WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize) {
 
 }
 
 void OArchiveProtobuf::WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) {
-  os.Write(pBuf, charCount);
+  pOs->Write(pBuf, charCount);
 }
 
 void OArchiveProtobuf::WriteInteger(int64_t value, uint8_t) {
@@ -31,18 +37,18 @@ void OArchiveProtobuf::WriteInteger(int64_t value, uint8_t) {
 
   if (ncb)
     // Write out our composed varint
-    os.Write(varint.data(), ncb);
+    pOs->Write(varint.data(), ncb);
   else
     // Just write one byte of zero
-    os.Write(&ncb, 1);
+    pOs->Write(&ncb, 1);
 }
 
 void OArchiveProtobuf::WriteFloat(float value) {
-  os.Write(&value, sizeof(value));
+  pOs->Write(&value, sizeof(value));
 }
 
 void OArchiveProtobuf::WriteFloat(double value) {
-  os.Write(&value, sizeof(value));
+  pOs->Write(&value, sizeof(value));
 }
 
 void OArchiveProtobuf::WriteFloat(long double value) {
@@ -56,6 +62,8 @@ void OArchiveProtobuf::WriteObjectReference(const field_serializer& serializer,
 
 void OArchiveProtobuf::WriteObject(const field_serializer& serializer, const void* pObj) {
   // Root object, no identifier.  We just pass control to the serializer.
+  internal::SizeCache::Scope memoize(sizeCache);
+  stable_scope ss(*this, pObj);
   try {
     serializer.serialize(*this, pObj);
   }
@@ -71,11 +79,14 @@ void OArchiveProtobuf::WriteDescriptor(const descriptor& descriptor, const void*
   if (!descriptor.field_descriptors.empty())
     throw leap::internal::protobuf::serialization_error{ descriptor };
 
-  // Now we write out the identified fields in order.
+  // Now we write out the identified fields in order of identifier.
   leap::internal::Pusher<decltype(curDescEntry)> p(curDescEntry);
-  for (const auto& identified_descriptor : descriptor.identified_descriptors) {
-    const auto& member_field = identified_descriptor.second;
+  const internal::Plan& plan = internal::Plan::Get(descriptor);
+  const bool stable = IsStable(pObj);
+  for (size_t i = plan.nPositional; i < plan.ops.size(); i++) {
+    const field_descriptor& member_field = *plan.ops[i].field;
     const void* pMember = reinterpret_cast<const uint8_t*>(pObj) + member_field.offset;
+    stable_scope ss(*this, pMember, stable);
 
     // Header with the identifier and wire type.  For some serializers, we are responsible for writing out
     // the wire type; for other serializers, the wire type must be written out by the serializer itself.
@@ -109,7 +120,7 @@ void OArchiveProtobuf::WriteDescriptor(const descriptor& descriptor, const void*
       // Array type is very inefficient.  It stamps out the field name and type for each entry in the array.
     case serial_atom::map:
       // Map type is implemented basically the same way as array, except entries are pairs
-      curDescEntry = &identified_descriptor;
+      curDescEntry = &member_field;
       break;
     case serial_atom::ignored:
       throw std::runtime_error("Invalid serialization atom type returned");
@@ -122,12 +133,14 @@ void OArchiveProtobuf::WriteDescriptor(const descriptor& descriptor, const void*
 
 void OArchiveProtobuf::WriteArray(IArrayReader&& ary) {
   WireType wireType = ToWireType(ary.serializer.type());
-  uint64_t key = (curDescEntry->first << 3) | (size_t)wireType;
+  uint64_t key = (static_cast<uint64_t>(curDescEntry->identifier) << 3) | (size_t)wireType;
   size_t n = ary.size();
+  const bool stable = IsStable(ary.object());
   for (size_t i = 0; i < n; i++) {
     WriteInteger(key, 8);
 
     const void* pObj = ary.get(i);
+    stable_scope ss(*this, pObj, stable);
     if (wireType == WireType::LenDelimit)
       WriteInteger(ary.serializer.size(*this, pObj), 8);
     ary.serializer.serialize(*this, pObj);
@@ -137,7 +150,7 @@ void OArchiveProtobuf::WriteArray(IArrayReader&& ary) {
 void OArchiveProtobuf::WriteDictionary(IDictionaryReader&& dictionary) {
   // We are responsible for writing out our header constraints just as OArchiveProtobuf is, except we know that
   // the wire type is length-delimited
-  uint64_t header = (curDescEntry->first << 3) | (size_t)WireType::LenDelimit;
+  uint64_t header = (static_cast<uint64_t>(curDescEntry->identifier) << 3) | (size_t)WireType::LenDelimit;
 
   // Key always has an ID of 1, as per spec
   WireType keyType = ToWireType(dictionary.key_serializer.type());
@@ -187,12 +200,20 @@ uint64_t OArchiveProtobuf::SizeObjectReference(const field_serializer& serialize
 }
 
 uint64_t OArchiveProtobuf::SizeDescriptor(const descriptor& descriptor, const void* pObj) const {
+  // Embedded messages are sized by each enclosing message, try to only compute this once.  Only an
+  // object that we found in the graph ourselves is sure to keep its contents at the same address.
+  const bool memoize = IsStable(pObj);
+  uint64_t retVal;
+  if (memoize && sizeCache.Find(descriptor, pObj, retVal))
+    return retVal;
+
   leap::internal::Pusher<decltype(curDescEntry)> p(curDescEntry);
 
   // Context-free.  We just write out the identified fields in order.
-  uint64_t retVal = 0;
-  for (const auto& identified_descriptor : descriptor.identified_descriptors) {
-    const auto& member_field = identified_descriptor.second;
+  retVal = 0;
+  const internal::Plan& plan = internal::Plan::Get(descriptor);
+  for (size_t i = plan.nPositional; i < plan.ops.size(); i++) {
+    const field_descriptor& member_field = *plan.ops[i].field;
 
     switch(member_field.serializer.type()) {
     case serial_atom::boolean:
@@ -217,16 +238,15 @@ uint64_t OArchiveProtobuf::SizeDescriptor(const descriptor& descriptor, const vo
       break;
     case serial_atom::array:
     case serial_atom::map:
-      curDescEntry = &identified_descriptor;
+      curDescEntry = &member_field;
       break;
     case serial_atom::ignored:
       throw std::runtime_error("Invalid serialization atom type returned");
     }
 
-    uint64_t ncb = member_field.serializer.size(
-      *this,
-      reinterpret_cast<const uint8_t*>(pObj) + member_field.offset
-    );
+    const void* pMember = reinterpret_cast<const uint8_t*>(pObj) + member_field.offset;
+    stable_scope ss(*this, pMember, memoize);
+    uint64_t ncb = member_field.serializer.size(*this, pMember);
 
     switch (member_field.serializer.type()) {
     case serial_atom::string:
@@ -243,27 +263,33 @@ uint64_t OArchiveProtobuf::SizeDescriptor(const descriptor& descriptor, const vo
     retVal += ncb;
   }
   // Also need to include the number of bytes that will be needed to represent the size itself
-  return retVal;
+  return memoize ? sizeCache.Insert(descriptor, pObj, retVal) : retVal;
 }
 
 uint64_t OArchiveProtobuf::SizeArray(IArrayReader&& ary) const {
   uint64_t keySize = leap::SizeBase128(
-    (curDescEntry->first << 3) | (size_t)ToWireType(ary.serializer.type())
+    (static_cast<uint64_t>(curDescEntry->identifier) << 3) | (size_t)ToWireType(ary.serializer.type())
   );
   size_t n = ary.size();
   uint64_t retVal = keySize * n;
-  while (n--)
+  const bool stable = IsStable(ary.object());
+  while (n--) {
+    stable_scope ss(*this, ary.get(n), stable);
     retVal += ary.serializer.size(*this, ary.get(n));
+  }
   return retVal;
 }
 
 uint64_t OArchiveProtobuf::SizeDictionary(IDictionaryReader&& dictionary) const {
   uint64_t keySize = leap::SizeBase128(
-    (curDescEntry->first << 3) | (size_t)ToWireType(dictionary.key_serializer.type())
+    (static_cast<uint64_t>(curDescEntry->identifier) << 3) | (size_t)ToWireType(dictionary.key_serializer.type())
   );
   uint64_t retVal = 0;
   size_t n = dictionary.size();
-  while (dictionary.next())
+  const bool stable = IsStable(dictionary.object());
+  while (dictionary.next()) {
+    stable_scope ss(*this, dictionary.value(), stable);
     retVal += keySize + dictionary.value_serializer.size(*this, dictionary.value());
+  }
   return retVal;
 }
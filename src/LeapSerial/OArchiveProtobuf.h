@@ -1,6 +1,7 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include "Archive.h"
+#include "SizeCache.h"
 #include <memory>
 
 namespace leap {
@@ -13,6 +14,7 @@ namespace leap {
     OArchiveProtobuf(IOutputStream& os);
 
     // OArchiveRegistry overrides
+    void Reset(void) override;
     void WriteByteArray(const void* pBuf, uint64_t ncb, bool writeSize = false) override;
     void WriteString(const void* pBuf, uint64_t charCount, uint8_t charSize) override;
     void WriteBool(bool value) override { WriteInteger(value, 1); }
@@ -50,6 +52,9 @@ namespace leap {
 
   private:
     // Stateful:  Stores the identifier of the object presently being serialized
-    mutable const std::pair<const uint64_t, field_descriptor>* curDescEntry = nullptr;
+    mutable const field_descriptor* curDescEntry = nullptr;
+
+    // Sizes of embedded messages already computed during the current call to WriteObject
+    mutable internal::SizeCache sizeCache;
   };
 }
@@ -0,0 +1,111 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Hash table for the small, short-lived maps that archives keep while writing a root object
+    /// </summary>
+    /// <remarks>
+    /// This is an open-addressed table with linear probing.  Entries are stored inline, so a lookup
+    /// generally touches a single cache line and no allocation takes place per entry.
+    ///
+    /// Each slot is stamped with the generation it was filled in, and only slots from the current
+    /// generation are occupied.  Clear just moves to the next generation, so it costs the same no matter
+    /// how large the table has grown, and the table keeps its storage across clears.
+    ///
+    /// hash_t must be default constructible, and map a key to a uint64_t whose high bits are well mixed.
+    /// </remarks>
+    template<typename key_t, typename value_t, typename hash_t>
+    class OpenTable {
+    private:
+      struct slot {
+        key_t key;
+        value_t value;
+        uint32_t gen;
+      };
+
+      // Table of slots, always empty or a power of two in size
+      std::vector<slot> m_slots;
+
+      // Number of occupied slots
+      size_t m_n = 0;
+
+      // Generation of occupied slots, never zero so that new slots start out empty
+      uint32_t m_gen = 1;
+
+      size_t Home(const key_t& key) const {
+        return static_cast<size_t>(hash_t{}(key) >> 32) & (m_slots.size() - 1);
+      }
+
+      void Grow(void) {
+        std::vector<slot> prior(m_slots.empty() ? 16 : m_slots.size() * 2, slot{ key_t{}, value_t{}, 0 });
+        prior.swap(m_slots);
+
+        for (const slot& cur : prior)
+          if (cur.gen == m_gen)
+            for (size_t i = Home(cur.key);; i = (i + 1) & (m_slots.size() - 1))
+              if (m_slots[i].gen != m_gen) {
+                m_slots[i] = cur;
+                break;
+              }
+      }
+
+    public:
+      /// <returns>The number of entries in the table</returns>
+      size_t Size(void) const { return m_n; }
+
+      /// <returns>The value stored under the specified key, or nullptr if there is none</returns>
+      const value_t* Find(const key_t& key) const {
+        if (!m_n)
+          return nullptr;
+
+        for (size_t i = Home(key);; i = (i + 1) & (m_slots.size() - 1)) {
+          const slot& cur = m_slots[i];
+          if (cur.gen != m_gen)
+            return nullptr;
+          if (cur.key == key)
+            return &cur.value;
+        }
+      }
+
+      /// <summary>
+      /// Stores a value under the specified key, replacing any value already there
+      /// </summary>
+      void Insert(const key_t& key, const value_t& value) {
+        // Keep the load factor at or below one half so that probe sequences stay short
+        if ((m_n + 1) * 2 > m_slots.size())
+          Grow();
+
+        size_t i = Home(key);
+        for (; m_slots[i].gen == m_gen; i = (i + 1) & (m_slots.size() - 1))
+          if (m_slots[i].key == key) {
+            m_slots[i].value = value;
+            return;
+          }
+
+        m_slots[i] = { key, value, m_gen };
+        m_n++;
+      }
+
+      /// <summary>
+      /// Removes all entries without releasing the table
+      /// </summary>
+      void Clear(void) {
+        if (!m_n)
+          return;
+        m_n = 0;
+
+        // Stale stamps must not come back into use once the generation wraps around
+        if (!++m_gen) {
+          for (slot& cur : m_slots)
+            cur.gen = 0;
+          m_gen = 1;
+        }
+      }
+    };
+  }
+}
@@ -0,0 +1,177 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "ParallelRecordReader.h"
+#include "Utility.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace leap;
+using namespace leap::internal;
+
+// Batches that must be copied out of the input stream are cut off once they reach this size
+static const size_t sc_ncbMaxCopiedBatch = 1024 * 1024;
+
+ParallelRecordReaderBase::ParallelRecordReaderBase(IInputStream& is, size_t nThreads, size_t nRecordsPerBatch) :
+  is(is),
+  nThreads(nThreads ? nThreads : std::max(1U, std::thread::hardware_concurrency())),
+  nRecordsPerBatch(nRecordsPerBatch ? nRecordsPerBatch : 1),
+  nMaxPending(2 * this->nThreads)
+{}
+
+ParallelRecordReaderBase::~ParallelRecordReaderBase(void) {
+  Stop();
+}
+
+void ParallelRecordReaderBase::Start(void) {
+  for (size_t i = 0; i < nThreads; i++)
+    workers.emplace_back(&ParallelRecordReaderBase::ThreadProc, this);
+}
+
+void ParallelRecordReaderBase::Stop(void) {
+  {
+    std::lock_guard<std::mutex> lk(lock);
+    stop = true;
+  }
+  cvRoom.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+  workers.clear();
+}
+
+void ParallelRecordReaderBase::Scan(RecordBatch& batch) {
+  size_t nRecords = 0;
+
+  // Memory that the stream retains can be decoded where it lies, provided whole records are available
+  const void* pBuf;
+  std::streamsize ncbBuf;
+  if (is.CanRetain() && (ncbBuf = is.GetContiguous(&pBuf)) > 0) {
+    const uint8_t* pData = static_cast<const uint8_t*>(pBuf);
+    size_t off = 0;
+    while (nRecords < nRecordsPerBatch) {
+      uint64_t ncb;
+      size_t ncbVarint;
+      if (!FromBase128(pData + off, static_cast<size_t>(ncbBuf) - off, &ncb, 1, ncbVarint))
+        break;
+      if (ncb > static_cast<size_t>(ncbBuf) - off - ncbVarint)
+        break;
+      off += ncbVarint + static_cast<size_t>(ncb);
+      nRecords++;
+    }
+
+    if (nRecords) {
+      batch.pData = pData;
+      batch.ncb = off;
+      is.Consume(off);
+      return;
+    }
+  }
+
+  // Otherwise, records are copied out one at a time, each with its length prefix
+  while (nRecords < nRecordsPerBatch && batch.owned.size() < sc_ncbMaxCopiedBatch) {
+    uint64_t ncb;
+    if (!ReadRecordLength(is, ncb)) {
+      eof = true;
+      break;
+    }
+
+    size_t ncbVarint = 1;
+    auto varint = ToBase128(ncb, ncbVarint);
+    size_t off = batch.owned.size();
+    batch.owned.resize(off + ncbVarint + static_cast<size_t>(ncb));
+    std::memcpy(&batch.owned[off], varint.data(), ncbVarint);
+    std::streamsize ncbBody = static_cast<std::streamsize>(ncb);
+    if (is.Read(&batch.owned[off + ncbVarint], ncbBody) != ncbBody) {
+      batch.owned.resize(off);
+      batch.pData = batch.owned.data();
+      throw std::runtime_error("End of file reached prematurely");
+    }
+    nRecords++;
+
+    // Only whole records are counted, so that those ahead of a bad one still get decoded
+    batch.pData = batch.owned.data();
+    batch.ncb = batch.owned.size();
+  }
+}
+
+void ParallelRecordReaderBase::ThreadProc(void) {
+  std::unique_lock<std::mutex> lk(lock);
+  for (;;) {
+    cvRoom.wait(lk, [this] { return stop || eof || pending.size() < nMaxPending; });
+    if (stop || eof)
+      return;
+
+    auto batch = std::make_shared<RecordBatch>();
+    std::shared_ptr<RecordBatch> failed;
+    try {
+      Scan(*batch);
+    }
+    catch (...) {
+      // The consumer sees this error once it has been handed every record ahead of it
+      failed = std::make_shared<RecordBatch>();
+      failed->err = std::current_exception();
+      failed->done = true;
+      eof = true;
+    }
+
+    if (eof) {
+      // Wake up everyone else so that they can quit
+      cvRoom.notify_all();
+      cvReady.notify_all();
+    }
+    if (batch->ncb)
+      pending.push_back(batch);
+    if (failed)
+      pending.push_back(failed);
+    if (!batch->ncb)
+      continue;
+
+    lk.unlock();
+    try {
+      Decode(*batch);
+    }
+    catch (...) {
+      batch->err = std::current_exception();
+    }
+    lk.lock();
+    batch->done = true;
+    cvReady.notify_all();
+  }
+}
+
+std::shared_ptr<void> ParallelRecordReaderBase::Next(void) {
+  for (;;) {
+    if (current) {
+      if (iCurrent < current->results.size())
+        return current->results[iCurrent++];
+
+      if (current->err) {
+        // Nothing after a failed record is delivered
+        std::exception_ptr err = current->err;
+        current.reset();
+        {
+          std::lock_guard<std::mutex> lk(lock);
+          eof = true;
+          pending.clear();
+        }
+        cvRoom.notify_all();
+        std::rethrow_exception(err);
+      }
+      current.reset();
+    }
+
+    std::unique_lock<std::mutex> lk(lock);
+    cvReady.wait(lk, [this] {
+      return
+        (!pending.empty() && pending.front()->done) ||
+        (pending.empty() && eof);
+    });
+    if (pending.empty())
+      return nullptr;
+
+    current = std::move(pending.front());
+    pending.pop_front();
+    iCurrent = 0;
+    lk.unlock();
+    cvRoom.notify_one();
+  }
+}
@@ -0,0 +1,181 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "BufferedInputStream.h"
+#include "RecordStream.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// A run of whole records, as written by RecordWriter, that is decoded by one worker
+    /// </summary>
+    struct RecordBatch {
+      // The records themselves, length prefixes included.  These point either into memory lent out by the
+      // input stream, or into the owned buffer.
+      const uint8_t* pData = nullptr;
+      size_t ncb = 0;
+      std::vector<uint8_t> owned;
+
+      // The decoded objects, in order, once done is set
+      std::vector<std::shared_ptr<void>> results;
+      std::exception_ptr err;
+      bool done = false;
+    };
+
+    /// <summary>
+    /// Input stream over one batch, which only lends out memory for good if the batch was borrowed
+    /// </summary>
+    class RecordBatchInputStream :
+      public BufferedInputStream
+    {
+    public:
+      RecordBatchInputStream(const RecordBatch& batch) :
+        BufferedInputStream(batch.pData, batch.ncb),
+        retain(batch.owned.empty())
+      {}
+
+    private:
+      const bool retain;
+
+    public:
+      bool CanRetain(void) const override { return retain; }
+    };
+
+    /// <summary>
+    /// Thread pool and ordered batch queue behind ParallelRecordReader
+    /// </summary>
+    class ParallelRecordReaderBase {
+    public:
+      /// <param name="is">The stream of records</param>
+      /// <param name="nThreads">The number of workers, or zero for one per hardware thread</param>
+      /// <param name="nRecordsPerBatch">The most records handed to a worker at a time</param>
+      ParallelRecordReaderBase(IInputStream& is, size_t nThreads, size_t nRecordsPerBatch);
+      virtual ~ParallelRecordReaderBase(void);
+
+    private:
+      IInputStream& is;
+      const size_t nThreads;
+      const size_t nRecordsPerBatch;
+
+      // The most batches that may be scanned but not yet taken by the consumer
+      const size_t nMaxPending;
+
+      std::vector<std::thread> workers;
+
+      // Guards everything below, and the input stream
+      std::mutex lock;
+      std::condition_variable cvRoom;
+      std::condition_variable cvReady;
+
+      // Batches in stream order, the oldest first
+      std::deque<std::shared_ptr<RecordBatch>> pending;
+
+      // Set once the input stream has no more records, or could not be scanned
+      bool eof = false;
+
+      // Set when the workers must quit
+      bool stop = false;
+
+      // The batch being handed out by Next
+      std::shared_ptr<RecordBatch> current;
+      size_t iCurrent = 0;
+
+      // Locates the next batch of records in the input stream, the lock must be held
+      void Scan(RecordBatch& batch);
+      void ThreadProc(void);
+
+    protected:
+      /// <summary>
+      /// Decodes every record in the specified batch into results
+      /// </summary>
+      /// <remarks>
+      /// Called concurrently on worker threads.  If a record cannot be decoded, the records ahead of it
+      /// in the batch are still delivered before the exception is.
+      /// </remarks>
+      virtual void Decode(RecordBatch& batch) = 0;
+
+      /// <summary>
+      /// Starts the workers, must be called once the most derived type is constructed
+      /// </summary>
+      void Start(void);
+
+      /// <summary>
+      /// Stops and joins the workers, must be called before the most derived type is destroyed
+      /// </summary>
+      void Stop(void);
+
+      /// <summary>
+      /// Waits for the next record to be decoded
+      /// </summary>
+      /// <returns>The record, or nullptr if there are no more records</returns>
+      std::shared_ptr<void> Next(void);
+    };
+  }
+
+  /// <summary>
+  /// Reads a sequence of objects written by RecordWriter, decoding records on a pool of worker threads
+  /// </summary>
+  /// <remarks>
+  /// Record boundaries are found from the length prefixes alone, and runs of whole records are handed to
+  /// the workers, each of which decodes with an archive of its own.  Objects are still returned in the
+  /// order in which they were written.  At most a few batches per worker are held in memory at a time.
+  ///
+  /// If the input stream lends out memory that it retains, such as a BufferedInputStream over a mapped
+  /// file, records are decoded in place; otherwise each batch is copied out of the stream first.  Either
+  /// way, the stream must outlive this reader.
+  /// </remarks>
+  template<typename T, typename archive_t = IArchiveLeapSerial>
+  class ParallelRecordReader:
+    public internal::ParallelRecordReaderBase
+  {
+  public:
+    /// <param name="is">The stream of records</param>
+    /// <param name="nThreads">The number of workers, or zero for one per hardware thread</param>
+    /// <param name="nRecordsPerBatch">The most records handed to a worker at a time</param>
+    ParallelRecordReader(IInputStream& is, size_t nThreads = 0, size_t nRecordsPerBatch = 64) :
+      ParallelRecordReaderBase(is, nThreads, nRecordsPerBatch)
+    {
+      Start();
+    }
+
+    ~ParallelRecordReader(void) {
+      Stop();
+    }
+
+  protected:
+    void Decode(internal::RecordBatch& batch) override {
+      internal::RecordBatchInputStream bis{ batch };
+      RecordReader<T, archive_t> reader{ bis };
+      while (auto obj = reader.Read())
+        batch.results.push_back(std::move(obj));
+    }
+
+  public:
+    /// <summary>
+    /// Reads the next record
+    /// </summary>
+    /// <returns>The object, or nullptr if there are no more records</returns>
+    /// <remarks>
+    /// Errors encountered while scanning or decoding a record are thrown from here, once every record
+    /// before it has been returned
+    /// </remarks>
+    std::shared_ptr<T> Read(void) {
+      return std::static_pointer_cast<T>(Next());
+    }
+
+    /// <summary>
+    /// Input iterator over the remaining records
+    /// </summary>
+    typedef internal::record_iterator<ParallelRecordReader, T> iterator;
+
+    iterator begin(void) { return iterator{ this }; }
+    iterator end(void) { return iterator{}; }
+  };
+}
@@ -0,0 +1,147 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "Plan.h"
+#include "Descriptor.h"
+#include "ProtobufType.h"
+#include "serial_traits.h"
+#include "Utility.hpp"
+#include <algorithm>
+#include <memory>
+
+using namespace leap;
+using namespace leap::internal;
+
+PlanSlot::~PlanSlot(void) {
+  delete m_pPlan.load();
+}
+
+PlanSlot& PlanSlot::operator=(const PlanSlot&) {
+  // Our descriptor is about to take on different fields, so our plan no longer describes it
+  delete m_pPlan.exchange(nullptr);
+  return *this;
+}
+
+template<typename T>
+static bool Is(const field_serializer& serializer) {
+  return &serializer == &field_serializer_t<T, void>::GetDescriptor();
+}
+
+static Plan::Opcode Classify(const field_serializer& serializer) {
+  // Only the exact primitive serializers are recognized.  Other types may share a serial_atom with a
+  // primitive (enums, for instance) but convert to and from the wire differently.
+  if (Is<int8_t>(serializer)) return Plan::Opcode::i8;
+  if (Is<uint8_t>(serializer)) return Plan::Opcode::ui8;
+  if (Is<int16_t>(serializer)) return Plan::Opcode::i16;
+  if (Is<uint16_t>(serializer)) return Plan::Opcode::ui16;
+  if (Is<int32_t>(serializer)) return Plan::Opcode::i32;
+  if (Is<uint32_t>(serializer)) return Plan::Opcode::ui32;
+  if (Is<int64_t>(serializer)) return Plan::Opcode::i64;
+  if (Is<uint64_t>(serializer)) return Plan::Opcode::ui64;
+  if (Is<bool>(serializer)) return Plan::Opcode::boolean;
+  if (Is<float>(serializer)) return Plan::Opcode::f32;
+  if (Is<double>(serializer)) return Plan::Opcode::f64;
+
+  // Embedded objects are always described by a descriptor, which we can compile in turn
+  if (dynamic_cast<const field_serializer_object*>(&serializer))
+    return Plan::Opcode::object;
+  return Plan::Opcode::generic;
+}
+
+static Plan::Op Compile(const field_descriptor& field) {
+  Plan::Op op;
+  op.code = Classify(field.serializer);
+  op.identifier = field.identifier;
+  op.offset = field.offset;
+  op.field = &field;
+  op.serializer = &field.serializer;
+  op.desc = nullptr;
+  op.child = nullptr;
+  if (op.code == Plan::Opcode::object) {
+    // Objects are embedded by value, so the descriptor graph cannot be cyclic here
+    op.desc = &static_cast<const field_serializer_object&>(field.serializer).object();
+    op.child = &Plan::Get(*op.desc);
+  }
+
+  const auto type = Protobuf::GetSerialType(field.serializer.type());
+  op.counted = type == Protobuf::serial_type::string;
+
+  size_t ncb = 0;
+  if (field.identifier) {
+    int64_t tag = (field.identifier << 3) | static_cast<int>(type);
+    const auto arr = leap::ToBase128(tag, ncb);
+    std::copy(arr.begin(), arr.begin() + ncb, op.tag);
+  }
+  op.ncbTag = static_cast<uint8_t>(ncb);
+  return op;
+}
+
+const Plan::Op* Plan::Find(uint64_t identifier, size_t& hint) const {
+  if (hint < nPositional)
+    hint = nPositional;
+  if (hint < ops.size() && static_cast<uint64_t>(ops[hint].identifier) == identifier)
+    return &ops[hint++];
+
+  // Repeated fields in some formats are written as several consecutive entries with the same identifier
+  if (hint > nPositional && static_cast<uint64_t>(ops[hint - 1].identifier) == identifier)
+    return &ops[hint - 1];
+
+  const Op* op;
+  if (!byIdentifier.empty()) {
+    if (identifier >= byIdentifier.size() || byIdentifier[identifier] < 0)
+      return nullptr;
+    op = &ops[byIdentifier[identifier]];
+  }
+  else {
+    auto q = std::lower_bound(
+      ops.begin() + nPositional,
+      ops.end(),
+      static_cast<int64_t>(identifier),
+      [](const Op& op, int64_t identifier) { return op.identifier < identifier; }
+    );
+    if (q == ops.end() || q->identifier != static_cast<int64_t>(identifier))
+      return nullptr;
+    op = &*q;
+  }
+  hint = static_cast<size_t>(op - ops.data()) + 1;
+  return op;
+}
+
+const Plan& Plan::Get(const descriptor& desc) {
+  const Plan* pPlan = desc.m_plan.m_pPlan.load(std::memory_order_acquire);
+  if (pPlan)
+    return *pPlan;
+
+  std::unique_ptr<Plan> plan(new Plan);
+  plan->ops.reserve(desc.field_descriptors.size() + desc.identified_descriptors.size());
+  for (const auto& field : desc.field_descriptors)
+    plan->ops.push_back(Compile(field));
+  plan->nPositional = plan->ops.size();
+
+  // Identified fields are put in ascending order, so that the order in which they are written does not
+  // depend on how the descriptor's map happens to enumerate them
+  int maxIdentifier = 0;
+  for (const auto& cur : desc.identified_descriptors) {
+    plan->ops.push_back(Compile(cur.second));
+    maxIdentifier = std::max(maxIdentifier, cur.second.identifier);
+  }
+  std::sort(
+    plan->ops.begin() + plan->nPositional,
+    plan->ops.end(),
+    [](const Op& lhs, const Op& rhs) { return lhs.identifier < rhs.identifier; }
+  );
+
+  // Small, dense identifiers are looked up directly
+  const size_t nIdentified = plan->ops.size() - plan->nPositional;
+  if (static_cast<size_t>(maxIdentifier) <= 4 * nIdentified + 16) {
+    plan->byIdentifier.assign(static_cast<size_t>(maxIdentifier) + 1, -1);
+    for (size_t i = plan->nPositional; i < plan->ops.size(); i++)
+      if (plan->ops[i].identifier > 0)
+        plan->byIdentifier[plan->ops[i].identifier] = static_cast<int32_t>(i);
+  }
+
+  // Another thread may have compiled this plan at the same time, in which case theirs is kept
+  const Plan* pExpected = nullptr;
+  if (desc.m_plan.m_pPlan.compare_exchange_strong(pExpected, plan.get(), std::memory_order_acq_rel))
+    return *plan.release();
+  return *pExpected;
+}
@@ -0,0 +1,120 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace leap {
+  struct descriptor;
+  struct field_descriptor;
+  struct field_serializer;
+
+  namespace internal {
+    /// <summary>
+    /// A descriptor flattened into a linear program of field operations
+    /// </summary>
+    /// <remarks>
+    /// Writing a field through its descriptor costs a virtual call into the field_serializer, another
+    /// into serial_traits, and a third into the archive.  A plan is compiled once per descriptor and
+    /// records, for each field, an opcode that an archive can dispatch on directly.  Primitive fields
+    /// and embedded objects are handled without any virtual calls; everything else falls back to the
+    /// field's own serializer.
+    ///
+    /// Plans describe the LeapSerial encoding: identified fields carry the varint of their identifier
+    /// and Protobuf::serial_type, precomputed.  The order of the fields and the identifier lookup table
+    /// are independent of encoding, and other archives use these as well.
+    /// </remarks>
+    struct Plan {
+      enum class Opcode : uint8_t {
+        i8,
+        ui8,
+        i16,
+        ui16,
+        i32,
+        ui32,
+        i64,
+        ui64,
+        boolean,
+        f32,
+        f64,
+
+        // Embedded object with a plan of its own
+        object,
+
+        // Any other field, handled by its field_serializer
+        generic
+      };
+
+      struct Op {
+        Opcode code;
+
+        // True if the field is length-prefixed when it is identified
+        bool counted;
+
+        // Encoded identifier and type, or zero bytes for a positional field
+        uint8_t ncbTag;
+        uint8_t tag[10];
+
+        // Field identifier, or zero for a positional field
+        int identifier;
+
+        // Offset of the field from the start of the object
+        size_t offset;
+
+        // The field this op was compiled from, and its serializer
+        const field_descriptor* field;
+        const field_serializer* serializer;
+
+        // Descriptor and plan of an embedded object, if code is Opcode::object
+        const descriptor* desc;
+        const Plan* child;
+      };
+
+      // Positional fields, followed by identified fields in ascending order of identifier.  This is also
+      // the order in which fields are written.
+      std::vector<Op> ops;
+      size_t nPositional = 0;
+
+      // Index into ops of each identified field, indexed by identifier, or -1 for unused identifiers.
+      // Left empty if identifiers are too sparse for a direct table, in which case the identified
+      // ops are binary searched.
+      std::vector<int32_t> byIdentifier;
+
+      /// <summary>
+      /// Finds the identified field with the specified identifier
+      /// </summary>
+      /// <param name="hint">
+      /// The index of the field expected to be next, which is checked before anything else.  Streams are
+      /// almost always written in plan order, so this is updated to the index following the field found.
+      /// </param>
+      /// <returns>The identified field, or nullptr if there is none</returns>
+      const Op* Find(uint64_t identifier, size_t& hint) const;
+
+      /// <returns>
+      /// The plan for the specified descriptor, which is compiled on first use
+      /// </returns>
+      static const Plan& Get(const descriptor& desc);
+    };
+
+    /// <summary>
+    /// Holds a lazily compiled plan on behalf of a descriptor
+    /// </summary>
+    /// <remarks>
+    /// Copies start out empty; the plan is rebuilt on demand from the fields of the copy.
+    /// </remarks>
+    class PlanSlot {
+    public:
+      PlanSlot(void) {}
+      PlanSlot(const PlanSlot&) {}
+      ~PlanSlot(void);
+
+      PlanSlot& operator=(const PlanSlot&);
+
+    private:
+      std::atomic<const Plan*> m_pPlan{ nullptr };
+
+      friend struct Plan;
+    };
+  }
+}
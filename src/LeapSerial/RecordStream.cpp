@@ -0,0 +1,66 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "RecordStream.h"
+#include "Utility.hpp"
+
+using namespace leap;
+
+size_t internal::WriteRecordLength(IOutputStream& os, uint64_t ncb) {
+  size_t ncbVarint = 1;
+  auto varint = leap::ToBase128(ncb, ncbVarint);
+  if (!os.Write(varint.data(), ncbVarint))
+    throw std::runtime_error("Failed to write a record to the output stream");
+  return ncbVarint;
+}
+
+bool internal::ReadRecordLength(IInputStream& is, uint64_t& ncb) {
+  uint8_t buf[10];
+  size_t n = 0;
+  do {
+    if (n == sizeof(buf))
+      throw std::runtime_error("Malformed record length encountered");
+    if (is.Read(&buf[n], 1) != 1) {
+      if (!n)
+        return false;
+      throw std::runtime_error("End of file reached prematurely");
+    }
+  } while (buf[n++] & 0x80);
+
+  ncb = leap::FromBase128(buf, n);
+  return true;
+}
+
+void internal::WriteRecordOffset(IOutputStream& index, uint64_t off) {
+  uint8_t buf[8];
+  for (size_t i = 0; i < sizeof(buf); i++)
+    buf[i] = static_cast<uint8_t>(off >> (8 * i));
+  if (!index.Write(buf, sizeof(buf)))
+    throw std::runtime_error("Failed to write to the record index");
+}
+
+RecordIndex::RecordIndex(IInputStream& is) :
+  is(is)
+{}
+
+uint64_t RecordIndex::size(void) {
+  is.Clear();
+  is.Seek(0);
+  std::streamsize ncb = is.Length();
+  if (ncb < 0)
+    throw std::runtime_error("The length of the record index cannot be determined");
+  return static_cast<uint64_t>(ncb) / 8;
+}
+
+std::streampos RecordIndex::Offset(uint64_t n) {
+  is.Clear();
+  is.Seek(static_cast<std::streamoff>(n * 8));
+
+  uint8_t buf[8];
+  if (is.Read(buf, sizeof(buf)) != sizeof(buf))
+    throw std::out_of_range("Record number is past the end of the record index");
+
+  uint64_t off = 0;
+  for (size_t i = 0; i < sizeof(buf); i++)
+    off |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  return static_cast<std::streamoff>(off);
+}
@@ -0,0 +1,250 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "Allocation.h"
+#include "ArchiveLeapSerial.h"
+#include "ForwardingStream.h"
+#include "IInputStream.h"
+#include "IOutputStream.h"
+#include "MemoryStream.h"
+#include "serial_traits.h"
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Writes the length prefix of a record
+    /// </summary>
+    /// <returns>The size of the prefix</returns>
+    size_t WriteRecordLength(IOutputStream& os, uint64_t ncb);
+
+    /// <summary>
+    /// Reads the length prefix of a record
+    /// </summary>
+    /// <returns>False if the stream ended before the prefix began</returns>
+    bool ReadRecordLength(IInputStream& is, uint64_t& ncb);
+
+    /// <summary>
+    /// Appends the offset of a record to an index, see RecordIndex
+    /// </summary>
+    void WriteRecordOffset(IOutputStream& index, uint64_t off);
+
+    /// <summary>
+    /// Input iterator over the records returned by reader_t::Read, which must return nullptr at the end
+    /// </summary>
+    template<typename reader_t, typename T>
+    class record_iterator:
+      public std::iterator<std::input_iterator_tag, T>
+    {
+    public:
+      record_iterator(void) = default;
+      explicit record_iterator(reader_t* pReader) :
+        pReader(pReader),
+        cur(pReader->Read())
+      {
+        if (!cur)
+          this->pReader = nullptr;
+      }
+
+    private:
+      reader_t* pReader = nullptr;
+      std::shared_ptr<T> cur;
+
+    public:
+      const T& operator*(void) const { return *cur; }
+      const T* operator->(void) const { return cur.get(); }
+
+      /// <returns>The current record, which remains valid after the iterator moves on</returns>
+      const std::shared_ptr<T>& shared(void) const { return cur; }
+
+      record_iterator& operator++(void) {
+        cur = pReader->Read();
+        if (!cur)
+          pReader = nullptr;
+        return *this;
+      }
+
+      bool operator==(const record_iterator& rhs) const { return pReader == rhs.pReader && cur == rhs.cur; }
+      bool operator!=(const record_iterator& rhs) const { return !(*this == rhs); }
+    };
+  }
+
+  /// <summary>
+  /// Side table giving the offset of each record in a stream written by RecordWriter
+  /// </summary>
+  /// <remarks>
+  /// The index holds one 64-bit little-endian offset per record, in record order, so the offset of any
+  /// record can be found with a single seek.  The writer appends to the index as it goes, and so the
+  /// index of a stream that was appended to by several writers is the concatenation of their indexes.
+  /// </remarks>
+  class RecordIndex {
+  public:
+    /// <param name="is">The index, which must support Seek</param>
+    RecordIndex(IInputStream& is);
+
+  private:
+    IInputStream& is;
+
+  public:
+    /// <returns>The number of records in the index</returns>
+    uint64_t size(void);
+
+    /// <returns>The offset of the nth record in the record stream</returns>
+    std::streampos Offset(uint64_t n);
+  };
+
+  /// <summary>
+  /// Writes a sequence of objects to a stream, each one as a length-delimited record
+  /// </summary>
+  /// <remarks>
+  /// Every record is a varint length followed by one serialized object graph, so records are independent
+  /// of one another.  Records may be appended to a stream that already holds records, such as a file
+  /// opened for appending, by a new writer.  A single archive is reused for every record.
+  ///
+  /// The writer may also be given a RecordIndex output stream, to which it appends the offset of each
+  /// record as it is written.
+  /// </remarks>
+  template<typename T, typename archive_t = OArchiveLeapSerial>
+  class RecordWriter {
+  public:
+    RecordWriter(IOutputStream& os) :
+      os(os),
+      ar(scratch)
+    {}
+
+    /// <param name="os">The record stream</param>
+    /// <param name="index">The stream to receive the index of the records</param>
+    /// <param name="offset">
+    /// The offset in the record stream of the first record written, such as the length of a file being
+    /// appended to
+    /// </param>
+    RecordWriter(IOutputStream& os, IOutputStream& index, uint64_t offset = 0) :
+      os(os),
+      pIndex(&index),
+      offset(offset),
+      ar(scratch)
+    {}
+
+  private:
+    IOutputStream& os;
+
+    // Index of record offsets, if one is being kept, and the offset of the next record
+    IOutputStream* pIndex = nullptr;
+    uint64_t offset = 0;
+
+    // Each record is staged here until its length is known
+    MemoryStream scratch;
+    archive_t ar;
+
+  public:
+    /// <summary>
+    /// Writes the specified object as the next record
+    /// </summary>
+    void Write(const T& obj) {
+      ar.WriteObject(field_serializer_t<T, void>::GetDescriptor(), &obj);
+
+      const void* pBuf;
+      std::streamsize ncb = scratch.GetContiguous(&pBuf);
+      if (pIndex)
+        internal::WriteRecordOffset(*pIndex, offset);
+      offset += internal::WriteRecordLength(os, static_cast<uint64_t>(ncb));
+      if (!os.Write(pBuf, ncb))
+        throw std::runtime_error("Failed to write a record to the output stream");
+      offset += static_cast<uint64_t>(ncb);
+
+      // Consuming everything rewinds the scratch buffer for the next record
+      scratch.Consume(ncb);
+    }
+  };
+
+  /// <summary>
+  /// Reads a sequence of objects written by RecordWriter
+  /// </summary>
+  /// <remarks>
+  /// A single archive is reused for every record.  Any part of a record that the archive does not read,
+  /// such as fields unknown to T, is skipped.
+  /// </remarks>
+  template<typename T, typename archive_t = IArchiveLeapSerial>
+  class RecordReader {
+  public:
+    RecordReader(IInputStream& is) :
+      is(is),
+      view(is),
+      ar(view)
+    {}
+
+  private:
+    IInputStream& is;
+
+    // The archive reads through a view that cannot report a stream offset, so that it never looks beyond
+    // the end of a record.  The length prefix says where the next record starts.
+    ForwardingInputStream view;
+    archive_t ar;
+
+    // Reads the body of a record of the specified length with the archive, and skips whatever it leaves
+    void ReadBody(uint64_t ncb, void* pObj, internal::AllocationBase* pOwner) {
+      ar.ReadObject(field_serializer_t<T, void>::GetDescriptor(), pObj, pOwner);
+
+      // Resetting also hands back to the stream anything the archive is still holding
+      const uint64_t ncbRead = ar.Count();
+      ar.Reset();
+      if (ncbRead > ncb)
+        throw std::runtime_error("Record was longer than its length prefix");
+      if (ncbRead < ncb && is.Skip(static_cast<std::streamsize>(ncb - ncbRead)) != static_cast<std::streamsize>(ncb - ncbRead))
+        throw std::runtime_error("End of file reached prematurely");
+    }
+
+  public:
+    /// <summary>
+    /// Reads the next record into an object, which must not need to allocate anything
+    /// </summary>
+    /// <returns>False if there are no more records</returns>
+    bool Read(T& obj) {
+      uint64_t ncb;
+      if (!internal::ReadRecordLength(is, ncb))
+        return false;
+      ReadBody(ncb, &obj, nullptr);
+      return true;
+    }
+
+    /// <summary>
+    /// Reads the next record
+    /// </summary>
+    /// <returns>The object, or nullptr if there are no more records</returns>
+    std::shared_ptr<T> Read(void) {
+      uint64_t ncb;
+      if (!internal::ReadRecordLength(is, ncb))
+        return nullptr;
+
+      auto retVal = std::make_shared<internal::Allocation<T>>();
+      T* pObj = &retVal->val;
+      ReadBody(ncb, pObj, retVal.get());
+      return{ retVal, pObj };
+    }
+
+    /// <summary>
+    /// Input iterator over the remaining records
+    /// </summary>
+    typedef internal::record_iterator<RecordReader, T> iterator;
+
+    /// <summary>
+    /// Positions the reader at the nth record, the input stream must support Seek
+    /// </summary>
+    void Seek(RecordIndex& index, uint64_t n) {
+      Seek(index.Offset(n));
+    }
+
+    /// <summary>
+    /// Positions the reader at the record at the specified offset, the input stream must support Seek
+    /// </summary>
+    void Seek(std::streampos off) {
+      is.Clear();
+      is.Seek(off);
+    }
+
+    iterator begin(void) { return iterator{ this }; }
+    iterator end(void) { return iterator{}; }
+  };
+}
@@ -0,0 +1,46 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "SizeCache.h"
+
+using namespace leap::internal;
+
+SizeCache::Scope::Scope(SizeCache& cache) :
+  cache(cache),
+  prior(cache.m_enabled)
+{
+  cache.m_enabled = true;
+}
+
+SizeCache::Scope::~Scope(void) {
+  cache.m_enabled = prior;
+  if (!prior)
+    cache.Clear();
+}
+
+uint64_t SizeCache::hash::operator()(const key& k) const {
+  uint64_t h =
+    static_cast<uint64_t>(reinterpret_cast<uintptr_t>(k.pObj)) * 0x9E3779B97F4A7C15ULL +
+    static_cast<uint64_t>(reinterpret_cast<uintptr_t>(k.serializer));
+  return h * 0x9E3779B97F4A7C15ULL;
+}
+
+bool SizeCache::Find(const field_serializer& serializer, const void* pObj, uint64_t& ncb) const {
+  if (!m_enabled)
+    return false;
+
+  const uint64_t* pNcb = m_table.Find({ pObj, &serializer });
+  if (!pNcb)
+    return false;
+  ncb = *pNcb;
+  return true;
+}
+
+uint64_t SizeCache::Insert(const field_serializer& serializer, const void* pObj, uint64_t ncb) {
+  if (m_enabled)
+    m_table.Insert({ pObj, &serializer }, ncb);
+  return ncb;
+}
+
+void SizeCache::Clear(void) {
+  m_table.Clear();
+}
@@ -0,0 +1,75 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "OpenTable.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace leap {
+  struct field_serializer;
+
+  namespace internal {
+    /// <summary>
+    /// Memoizes the serialized size of (object, serializer) pairs during a single root write operation
+    /// </summary>
+    /// <remarks>
+    /// Length-prefixed formats must know the size of every embedded object before the object is
+    /// written.  Without memoization, an object nested N levels deep is sized once by each of its
+    /// ancestors.  The cache is only populated while a Scope is held, which archives do for the
+    /// duration of a call to WriteObject; outside of that window the object graph may be mutated
+    /// by the caller, and so nothing is retained.
+    /// </remarks>
+    class SizeCache {
+    public:
+      /// <summary>
+      /// Enables memoization for the lifetime of this object, and discards all entries on exit
+      /// </summary>
+      struct Scope {
+        Scope(const Scope&) = delete;
+        Scope(SizeCache& cache);
+        ~Scope(void);
+
+        SizeCache& cache;
+        const bool prior;
+      };
+
+    private:
+      struct key {
+        const void* pObj;
+        const field_serializer* serializer;
+
+        bool operator==(const key& rhs) const { return pObj == rhs.pObj && serializer == rhs.serializer; }
+      };
+
+      struct hash {
+        uint64_t operator()(const key& k) const;
+      };
+
+      // True if entries may be recorded
+      bool m_enabled = false;
+
+      // Sizes of the objects seen so far, kept across scopes so that steady-state use does not allocate
+      OpenTable<key, uint64_t, hash> m_table;
+
+    public:
+      /// <returns>True if the cache is presently recording entries</returns>
+      bool IsEnabled(void) const { return m_enabled; }
+
+      /// <summary>
+      /// Attempts to find the size of the specified object
+      /// </summary>
+      /// <returns>True if the size was found, in which case ncb is assigned</returns>
+      bool Find(const field_serializer& serializer, const void* pObj, uint64_t& ncb) const;
+
+      /// <summary>
+      /// Records the size of the specified object, if the cache is enabled
+      /// </summary>
+      /// <returns>The passed size</returns>
+      uint64_t Insert(const field_serializer& serializer, const void* pObj, uint64_t ncb);
+
+      /// <summary>
+      /// Discards all entries without releasing table storage
+      /// </summary>
+      void Clear(void);
+    };
+  }
+}
@@ -1,6 +1,18 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include "Utility.hpp"
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #define LEAP_SIMD_X86 1
+  #define LEAP_TARGET(x)
+  #include <intrin.h>
+  #include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define LEAP_SIMD_X86 1
+  #define LEAP_TARGET(x) __attribute__((target(x)))
+  #include <immintrin.h>
+#endif
 
 std::array<uint8_t, 10> leap::ToBase128(uint64_t val, size_t& ncb) {
   if (!val)
@@ -53,3 +65,285 @@ uint64_t leap::FromBase128(uint8_t* data, size_t ncb) {
     retVal |= uint64_t(data[i] & 0x7F) << (i * 7);
   return retVal;
 }
+
+bool leap::ToBase128Padded(uint64_t val, uint8_t* data, size_t ncb) {
+  if (!ncb || (ncb < 10 && (val >> (ncb * 7))))
+    return false;
+
+  for (size_t i = 0; i < ncb - 1; i++, val >>= 7)
+    data[i] = 0x80 | (val & 0x7F);
+  data[ncb - 1] = val & 0x7F;
+  return true;
+}
+
+namespace {
+  typedef size_t(*t_pfnEncode)(const uint64_t* pVals, size_t n, uint8_t* pOut);
+  typedef size_t(*t_pfnDecode)(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead);
+
+  // Encodes a single value, returns the number of bytes written
+  inline size_t EncodeOne(uint64_t val, uint8_t* pOut) {
+    size_t ncb = 0;
+    for (; val >= 0x80; val >>= 7)
+      pOut[ncb++] = 0x80 | (val & 0x7F);
+    pOut[ncb++] = static_cast<uint8_t>(val);
+    return ncb;
+  }
+
+  // Decodes a single value, returns the number of bytes consumed, or zero if the buffer ends first or
+  // the varint is malformed.  A 64-bit value never takes more than ten bytes.
+  inline size_t DecodeOne(const uint8_t* data, size_t ncb, uint64_t& val) {
+    val = 0;
+    ncb = ncb < 10 ? ncb : 10;
+    for (size_t i = 0; i < ncb; i++) {
+      val |= uint64_t(data[i] & 0x7F) << (i * 7);
+      if (!(data[i] & 0x80))
+        return i + 1;
+    }
+    return 0;
+  }
+
+  size_t EncodeScalar(const uint64_t* pVals, size_t n, uint8_t* pOut) {
+    size_t ncb = 0;
+    for (size_t i = 0; i < n; i++)
+      ncb += EncodeOne(pVals[i], pOut + ncb);
+    return ncb;
+  }
+
+  size_t DecodeScalar(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead) {
+    size_t i = 0;
+    ncbRead = 0;
+    for (; i < n; i++) {
+      size_t ncbVal = DecodeOne(data + ncbRead, ncb - ncbRead, pVals[i]);
+      if (!ncbVal)
+        break;
+      ncbRead += ncbVal;
+    }
+    return i;
+  }
+
+#if LEAP_SIMD_X86
+  // The vector kernels below only accelerate runs of values that fit in a single byte, which is the
+  // common case for counts, indices, and enumerations.  Anything else is handed to the scalar code
+  // one value at a time, after which the vector path is attempted again.
+
+  LEAP_TARGET("sse4.1")
+  size_t EncodeSSE41(const uint64_t* pVals, size_t n, uint8_t* pOut) {
+    const __m128i high = _mm_set1_epi64x(~0x7FLL);
+    size_t ncb = 0;
+    size_t i = 0;
+    while (i < n) {
+      if (n - i >= 16) {
+        __m128i v[8];
+        __m128i acc = _mm_setzero_si128();
+        for (size_t j = 0; j < 8; j++) {
+          v[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pVals + i + j * 2));
+          acc = _mm_or_si128(acc, v[j]);
+        }
+
+        if (_mm_testz_si128(acc, high)) {
+          // All sixteen values are single-byte varints, narrow them from 64 bits down to 8
+          __m128i d[4];
+          for (size_t j = 0; j < 4; j++)
+            d[j] = _mm_unpacklo_epi64(
+              _mm_shuffle_epi32(v[j * 2], _MM_SHUFFLE(2, 0, 2, 0)),
+              _mm_shuffle_epi32(v[j * 2 + 1], _MM_SHUFFLE(2, 0, 2, 0))
+            );
+          __m128i w0 = _mm_packus_epi32(d[0], d[1]);
+          __m128i w1 = _mm_packus_epi32(d[2], d[3]);
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + ncb), _mm_packus_epi16(w0, w1));
+          ncb += 16;
+          i += 16;
+          continue;
+        }
+      }
+      ncb += EncodeOne(pVals[i++], pOut + ncb);
+    }
+    return ncb;
+  }
+
+  LEAP_TARGET("sse4.1")
+  size_t DecodeSSE41(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead) {
+    size_t i = 0;
+    size_t off = 0;
+    while (i < n) {
+      if (n - i >= 16 && ncb - off >= 16) {
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + off));
+        if (!_mm_movemask_epi8(b)) {
+          // No continuation bits, these sixteen bytes are sixteen values
+          for (size_t j = 0; j < 8; j++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pVals + i + j * 2), _mm_cvtepu8_epi64(b));
+            b = _mm_srli_si128(b, 2);
+          }
+          off += 16;
+          i += 16;
+          continue;
+        }
+      }
+
+      size_t ncbVal = DecodeOne(data + off, ncb - off, pVals[i]);
+      if (!ncbVal)
+        break;
+      off += ncbVal;
+      i++;
+    }
+    ncbRead = off;
+    return i;
+  }
+
+  LEAP_TARGET("avx2")
+  size_t DecodeAVX2(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead) {
+    size_t i = 0;
+    size_t off = 0;
+    while (i < n) {
+      if (n - i >= 32 && ncb - off >= 32) {
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + off));
+        if (!_mm256_movemask_epi8(b)) {
+          // No continuation bits, these 32 bytes are 32 values
+          __m128i h[2] = {
+            _mm256_castsi256_si128(b),
+            _mm256_extracti128_si256(b, 1)
+          };
+          for (size_t j = 0; j < 8; j++) {
+            __m128i& q = h[j / 4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pVals + i + j * 4), _mm256_cvtepu8_epi64(q));
+            q = _mm_srli_si128(q, 4);
+          }
+          off += 32;
+          i += 32;
+          continue;
+        }
+      }
+
+      size_t ncbVal = DecodeOne(data + off, ncb - off, pVals[i]);
+      if (!ncbVal)
+        break;
+      off += ncbVal;
+      i++;
+    }
+    ncbRead = off;
+    return i;
+  }
+
+  enum class SimdLevel {
+    None,
+    SSE41,
+    AVX2
+  };
+
+  SimdLevel DetectSimd(void) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 1)
+      return SimdLevel::None;
+
+    __cpuid(info, 1);
+    const bool sse41 = !!(info[2] & (1 << 19));
+    const bool osxsave = !!(info[2] & (1 << 27));
+    bool avx2 = false;
+    if (osxsave && info[0] >= 7 && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      avx2 = !!(info[1] & (1 << 5));
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2)
+      return SimdLevel::AVX2;
+    if (sse41)
+      return SimdLevel::SSE41;
+    return SimdLevel::None;
+  }
+#endif
+
+  struct Base128Kernels {
+    Base128Kernels(void) {
+#if LEAP_SIMD_X86
+      switch (DetectSimd()) {
+      case SimdLevel::AVX2:
+        pfnEncode = EncodeSSE41;
+        pfnDecode = DecodeAVX2;
+        break;
+      case SimdLevel::SSE41:
+        pfnEncode = EncodeSSE41;
+        pfnDecode = DecodeSSE41;
+        break;
+      case SimdLevel::None:
+        break;
+      }
+#endif
+    }
+
+    t_pfnEncode pfnEncode = EncodeScalar;
+    t_pfnDecode pfnDecode = DecodeScalar;
+
+    static const Base128Kernels& Get(void) {
+      static const Base128Kernels kernels;
+      return kernels;
+    }
+  };
+}
+
+size_t leap::ToBase128(const uint64_t* pVals, size_t n, uint8_t* pOut) {
+  return Base128Kernels::Get().pfnEncode(pVals, n, pOut);
+}
+
+size_t leap::FromBase128(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead) {
+  return Base128Kernels::Get().pfnDecode(data, ncb, pVals, n, ncbRead);
+}
+
+namespace {
+  template<typename T>
+  void Narrow(const uint64_t* pVals, size_t n, void* pDest) {
+    T* pOut = static_cast<T*>(pDest);
+    for (size_t i = 0; i < n; i++)
+      pOut[i] = static_cast<T>(pVals[i]);
+  }
+
+  template<typename T>
+  void Widen(const void* pSrc, size_t n, uint64_t* pVals) {
+    const T* pIn = static_cast<const T*>(pSrc);
+    for (size_t i = 0; i < n; i++)
+      pVals[i] = static_cast<uint64_t>(static_cast<int64_t>(pIn[i]));
+  }
+}
+
+void leap::NarrowIntegers(const uint64_t* pVals, size_t n, void* pDest, size_t ncbWidth) {
+  switch (ncbWidth) {
+  case 1:
+    Narrow<uint8_t>(pVals, n, pDest);
+    break;
+  case 2:
+    Narrow<uint16_t>(pVals, n, pDest);
+    break;
+  case 4:
+    Narrow<uint32_t>(pVals, n, pDest);
+    break;
+  case 8:
+    Narrow<uint64_t>(pVals, n, pDest);
+    break;
+  default:
+    throw std::invalid_argument("Integers must be 1, 2, 4, or 8 bytes wide");
+  }
+}
+
+void leap::WidenIntegers(const void* pSrc, size_t n, size_t ncbWidth, bool isSigned, uint64_t* pVals) {
+  switch (ncbWidth) {
+  case 1:
+    isSigned ? Widen<int8_t>(pSrc, n, pVals) : Widen<uint8_t>(pSrc, n, pVals);
+    break;
+  case 2:
+    isSigned ? Widen<int16_t>(pSrc, n, pVals) : Widen<uint16_t>(pSrc, n, pVals);
+    break;
+  case 4:
+    isSigned ? Widen<int32_t>(pSrc, n, pVals) : Widen<uint32_t>(pSrc, n, pVals);
+    break;
+  case 8:
+    Widen<uint64_t>(pSrc, n, pVals);
+    break;
+  default:
+    throw std::invalid_argument("Integers must be 1, 2, 4, or 8 bytes wide");
+  }
+}
@@ -1,10 +1,47 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
 namespace leap {
   std::array<uint8_t, 10> ToBase128(uint64_t val, size_t& ncb);
   uint8_t SizeBase128(uint64_t val);
   uint64_t FromBase128(uint8_t* data, size_t ncb);
+
+  /// <summary>
+  /// Encodes val as a varint that occupies exactly ncb bytes, padding with empty continuation groups
+  /// </summary>
+  /// <returns>False if val cannot be represented in ncb bytes</returns>
+  bool ToBase128Padded(uint64_t val, uint8_t* data, size_t ncb);
+
+  /// <summary>
+  /// Encodes each of the n values in pVals as consecutive varints
+  /// </summary>
+  /// <param name="pOut">The output buffer, which must have room for at least 10 * n bytes</param>
+  /// <returns>The number of bytes written to pOut</returns>
+  size_t ToBase128(const uint64_t* pVals, size_t n, uint8_t* pOut);
+
+  /// <summary>
+  /// Decodes up to n consecutive varints from the ncb bytes at data
+  /// </summary>
+  /// <param name="ncbRead">Receives the number of bytes consumed</param>
+  /// <returns>The number of values written to pVals</returns>
+  /// <remarks>
+  /// Decoding stops early if the buffer ends partway through a varint, or at a malformed varint that runs
+  /// longer than ten bytes; the bytes of that varint are not consumed.  The two cases can be told apart
+  /// because a malformed varint leaves at least ten bytes unconsumed.
+  /// </remarks>
+  size_t FromBase128(const uint8_t* data, size_t ncb, uint64_t* pVals, size_t n, size_t& ncbRead);
+
+  /// <summary>
+  /// Stores the low ncbWidth bytes of each of the n values in pVals contiguously at pDest
+  /// </summary>
+  void NarrowIntegers(const uint64_t* pVals, size_t n, void* pDest, size_t ncbWidth);
+
+  /// <summary>
+  /// Widens each of the n integers of ncbWidth bytes at pSrc to 64 bits
+  /// </summary>
+  /// <param name="isSigned">True if the source integers should be sign-extended, false to zero-extend</param>
+  void WidenIntegers(const void* pSrc, size_t n, size_t ncbWidth, bool isSigned, uint64_t* pVals);
 }
@@ -56,7 +56,11 @@ namespace leap {
   {
   private:
     // Singleton pattern, do not use this routine, use GetDescriptor instead
-    field_serializer_t(void) {}
+    constexpr field_serializer_t(void) {}
+
+    // The singleton itself.  It has no state and a constexpr constructor, so it is constant-initialized:
+    // it exists before any dynamic initializer runs, and GetDescriptor needs no thread-safe static guard.
+    static const field_serializer_t s_instance;
 
   public:
     bool allocates(void) const override {
@@ -82,12 +86,15 @@ namespace leap {
 
     bool is_optional(void) const override { return leap::is_optional<T, void>::value; }
 
-    static const field_serializer& GetDescriptor(void) {
-      static const field_serializer_t m{};
-      return m;
+    static constexpr const field_serializer& GetDescriptor(void) {
+      return s_instance;
     }
   };
 
+  template<typename T>
+  const field_serializer_t<T, typename std::enable_if<!std::is_base_of<std::false_type, serial_traits<T>>::value>::type>
+    field_serializer_t<T, typename std::enable_if<!std::is_base_of<std::false_type, serial_traits<T>>::value>::type>::s_instance;
+
   template<typename T>
   struct mem_hash {
     size_t operator()(const T& obj) const {
@@ -177,10 +184,12 @@ namespace leap {
     }
 
     uint64_t size(const OArchiveRegistry& ar, const void* pObj) const override {
+      OArchiveRegistry::transient_scope ts(ar);
       return serial_traits<field_type>::size(ar, (static_cast<const T*>(pObj)->*pfnGetter)());
     }
 
     void serialize(OArchiveRegistry& ar, const void* pObj) const override {
+      OArchiveRegistry::transient_scope ts(ar);
       serial_traits<field_type>::serialize(ar, (static_cast<const T*>(pObj)->*pfnGetter)());
     }
 
@@ -241,10 +250,12 @@ namespace leap {
     }
 
     uint64_t size(const OArchiveRegistry& ar, const void* pObj) const override {
+      OArchiveRegistry::transient_scope ts(ar);
       return serial_traits<field_type>::size(ar, pfnGetter(*static_cast<const T*>(pObj)));
     }
 
     void serialize(OArchiveRegistry& ar, const void* pObj) const override {
+      OArchiveRegistry::transient_scope ts(ar);
       serial_traits<field_type>::serialize(ar, pfnGetter(*static_cast<const T*>(pObj)));
     }
 
@@ -0,0 +1,63 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "fields.h"
+#include "Descriptor.h"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace leap;
+
+struct fields::cache {
+  std::mutex lock;
+  std::unordered_map<const descriptor*, std::unique_ptr<descriptor>> projections;
+};
+
+fields::fields(std::initializer_list<const char*> names) :
+  m_names(names.begin(), names.end()),
+  m_cache(std::make_shared<cache>())
+{}
+
+fields::fields(std::initializer_list<int> identifiers) :
+  m_identifiers(identifiers),
+  m_cache(std::make_shared<cache>())
+{}
+
+const descriptor& fields::project(const descriptor& desc) const {
+  std::lock_guard<std::mutex> lk(m_cache->lock);
+  std::unique_ptr<descriptor>& retVal = m_cache->projections[&desc];
+  if (retVal)
+    return *retVal;
+
+  std::vector<field_descriptor> selected(desc.field_descriptors.begin(), desc.field_descriptors.end());
+  for (const std::string& name : m_names) {
+    auto q = std::find_if(
+      desc.identified_descriptors.begin(),
+      desc.identified_descriptors.end(),
+      [&name](const std::pair<const uint64_t, field_descriptor>& cur) {
+        return cur.second.name && name == cur.second.name;
+      }
+    );
+    if (q != desc.identified_descriptors.end())
+      selected.push_back(q->second);
+    else if (
+      std::none_of(
+        desc.field_descriptors.begin(),
+        desc.field_descriptors.end(),
+        [&name](const field_descriptor& cur) { return cur.name && name == cur.name; }
+      )
+    )
+      throw std::invalid_argument("Projection selects a field named " + name + ", which does not exist");
+  }
+
+  for (int identifier : m_identifiers) {
+    auto q = desc.identified_descriptors.find(identifier);
+    if (q == desc.identified_descriptors.end())
+      throw std::invalid_argument("Projection selects a field with identifier " + std::to_string(identifier) + ", which does not exist");
+    selected.push_back(q->second);
+  }
+
+  retVal.reset(new descriptor(desc.name, selected.data(), selected.data() + selected.size()));
+  return *retVal;
+}
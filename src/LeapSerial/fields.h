@@ -0,0 +1,45 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace leap {
+  struct descriptor;
+
+  /// <summary>
+  /// A projection, which selects the identified fields of an object that are to be deserialized
+  /// </summary>
+  /// <remarks>
+  /// Fields are selected by the name or identifier given to them in the object's descriptor.  Identified
+  /// fields that are not selected are skipped by their length prefixes rather than decoded, and objects
+  /// referred to only by those fields are passed over as well.  Positional fields are always read, because
+  /// they have no length prefix to skip them by.
+  ///
+  /// A projection applies to the root object only.  Copies of a projection share the descriptors built
+  /// from it, so a projection that is reused across many reads only builds its descriptors once.
+  /// </remarks>
+  class fields {
+  public:
+    fields(std::initializer_list<const char*> names);
+    fields(std::initializer_list<int> identifiers);
+
+  private:
+    std::vector<std::string> m_names;
+    std::vector<int> m_identifiers;
+
+    // Descriptors built from this projection so far
+    struct cache;
+    std::shared_ptr<cache> m_cache;
+
+  public:
+    /// <returns>
+    /// A descriptor with the positional fields of the specified descriptor, and only the selected identified fields
+    /// </returns>
+    /// <remarks>
+    /// Throws std::invalid_argument if a selected field does not exist in the specified descriptor
+    /// </remarks>
+    const descriptor& project(const descriptor& desc) const;
+  };
+}
@@ -0,0 +1,91 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "Archive.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace leap {
+  namespace internal {
+    /// <summary>
+    /// Source of the objects referred to by lazy_ptr fields that have not yet been dereferenced
+    /// </summary>
+    class LazySource {
+    public:
+      virtual ~LazySource(void) {}
+
+      /// <summary>
+      /// Deserializes the object with the specified identifier, if it is not already loaded
+      /// </summary>
+      /// <param name="pfnAlloc">The routine to be used for allocation, if the object must be loaded</param>
+      /// <param name="serializer">The descriptor to use to deserialize this object</param>
+      /// <param name="objId">The identifier of the object in the source</param>
+      /// <returns>The loaded object</returns>
+      virtual std::shared_ptr<void> Load(IArchive::ReleasedMemory(*pfnAlloc)(), const field_serializer& serializer, uint32_t objId) = 0;
+    };
+  }
+
+  /// <summary>
+  /// A shared pointer whose object is only deserialized when it is first dereferenced
+  /// </summary>
+  /// <remarks>
+  /// On the wire, a lazy_ptr is indistinguishable from the corresponding std::shared_ptr.  Referenced
+  /// objects are only deferred if the archive was asked to read lazily and the input stream can seek, see
+  /// IArchiveLeapSerial::Lazy; otherwise they are read right away, as they would be for a shared_ptr.
+  ///
+  /// A deferred object is read from the input stream when the lazy_ptr is dereferenced, so the stream
+  /// must outlive the lazy_ptr.  Dereferencing is not thread safe.
+  /// </remarks>
+  template<typename T>
+  class lazy_ptr {
+  public:
+    lazy_ptr(void) = default;
+    lazy_ptr(std::nullptr_t) {}
+    lazy_ptr(std::shared_ptr<T> ptr) :
+      m_ptr(std::move(ptr))
+    {}
+
+    /// <summary>
+    /// Refers to an object that has yet to be loaded from the specified source
+    /// </summary>
+    lazy_ptr(std::shared_ptr<internal::LazySource> source, const field_serializer& serializer, uint32_t objId) :
+      m_source(std::move(source)),
+      m_serializer(&serializer),
+      m_objId(objId)
+    {}
+
+  private:
+    // The object, once it is loaded
+    mutable std::shared_ptr<T> m_ptr;
+
+    // Where the object can be loaded from, if it has not been loaded yet
+    mutable std::shared_ptr<internal::LazySource> m_source;
+    const field_serializer* m_serializer = nullptr;
+    uint32_t m_objId = 0;
+
+    static IArchive::ReleasedMemory Allocate(void) {
+      std::shared_ptr<T> retVal = std::shared_ptr<T>(new T());
+      return IArchive::ReleasedMemory{ retVal.get(), retVal };
+    }
+
+  public:
+    /// <returns>True if the object is in memory, or if there is no object</returns>
+    bool loaded(void) const { return !m_source; }
+
+    /// <summary>
+    /// Loads the object, if necessary
+    /// </summary>
+    const std::shared_ptr<T>& shared(void) const {
+      if (m_source) {
+        m_ptr = std::static_pointer_cast<T>(m_source->Load(&Allocate, *m_serializer, m_objId));
+        m_source.reset();
+      }
+      return m_ptr;
+    }
+
+    T* get(void) const { return shared().get(); }
+    T& operator*(void) const { return *get(); }
+    T* operator->(void) const { return get(); }
+    explicit operator bool(void) const { return m_source || m_ptr; }
+  };
+}
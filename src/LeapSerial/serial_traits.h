@@ -3,15 +3,28 @@
 #include "Archive.h"
 #include "Descriptor.h"
 #include "field_serializer_t.h"
+#include "lazy_ptr.h"
+#include "string_ref.h"
 #include <array>
 #include <chrono>
 #include <map>
 #include <memory>
+#include <new>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 namespace leap {
+  /// <summary>
+  /// Describes how to serialize values of type T
+  /// </summary>
+  /// <remarks>
+  /// Specializations provide type, size, serialize, and deserialize.  Within a single call to WriteObject,
+  /// an archive may remember the size of an object that it found in the graph itself by its address, so
+  /// such objects must hold the same contents until the call returns.  Temporaries that a specialization
+  /// builds and passes on are never remembered.
+  /// </remarks>
   template<typename T>
   struct serial_traits;
 
@@ -58,8 +71,28 @@ namespace leap {
   struct create_delete {
     void* (*pfnAlloc)();
     void(*pfnFree)(void*);
+
+    // Size and alignment of the type, and routines to construct it in place and destroy it without
+    // freeing its memory.  These allow the type to be placed in an arena.  pfnDestroy is null for
+    // trivially destructible types.
+    size_t size;
+    size_t align;
+    void* (*pfnConstruct)(void*);
+    void(*pfnDestroy)(void*);
   };
 
+  namespace internal {
+    template<typename T>
+    typename std::enable_if<std::is_trivially_destructible<T>::value, void(*)(void*)>::type DestroyFn(void) {
+      return nullptr;
+    }
+
+    template<typename T>
+    typename std::enable_if<!std::is_trivially_destructible<T>::value, void(*)(void*)>::type DestroyFn(void) {
+      return [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+    }
+  }
+
   // Specialization for anything that is a floating-point type.  These can be written directly to disk,
   // so we don't have to perform any kind of translation.  On big-endian systems, we will need to
   // perform byte order conversions.
@@ -154,6 +187,8 @@ namespace leap {
       size_t immutable_size(void) const override { return std::is_arithmetic<T>::value ? sizeof(T) : 0; }
       const void* get(size_t i) const override { return pAry + i; }
       size_t size(void) const override { return N; }
+      const void* data(void) const override { return std::is_arithmetic<T>::value ? pAry : nullptr; }
+      const void* object(void) const override { return pAry; }
     };
 
     struct ArrayImpl :
@@ -175,6 +210,27 @@ namespace leap {
       void* allocate(void) override {
         return pAry + i++;
       };
+
+      void* allocate_raw(size_t n) override {
+        if (!std::is_arithmetic<T>::value)
+          return nullptr;
+        if (N - i < n)
+          throw std::runtime_error("Incorrect deserialization attempt into a non-fixed-size space");
+
+        T* retVal = pAry + i;
+        i += n;
+        return retVal;
+      }
+
+      void* allocate_n(size_t n, size_t& stride) override {
+        if (N - i < n)
+          throw std::runtime_error("Incorrect deserialization attempt into a non-fixed-size space");
+
+        T* retVal = pAry + i;
+        i += n;
+        stride = sizeof(T);
+        return retVal;
+      }
     };
 
     static ::leap::serial_atom type() {
@@ -263,6 +319,8 @@ namespace leap {
       size_t immutable_size(void) const override { return std::is_arithmetic<T>::value ? sizeof(T) : 0; }
       const void* get(size_t i) const override { return &obj[i]; }
       size_t size(void) const override { return obj.size(); }
+      const void* data(void) const override { return std::is_arithmetic<T>::value ? obj.data() : nullptr; }
+      const void* object(void) const override { return &obj; }
     };
 
     struct ArrayImpl :
@@ -280,6 +338,20 @@ namespace leap {
         obj.push_back({});
         return &obj.back();
       }
+      void* allocate_raw(size_t n) override {
+        if (!std::is_arithmetic<T>::value)
+          return nullptr;
+
+        size_t i = obj.size();
+        obj.resize(i + n);
+        return obj.data() + i;
+      }
+      void* allocate_n(size_t n, size_t& stride) override {
+        size_t i = obj.size();
+        obj.resize(i + n);
+        stride = sizeof(T);
+        return obj.data() + i;
+      }
     };
 
     static ::leap::serial_atom type() {
@@ -363,6 +435,7 @@ namespace leap {
       }
       const void* key(void) const override { return &q->first; }
       const void* value(void) const override { return &q->second; }
+      const void* object(void) const override { return &container; }
     };
 
     struct DictionaryInserterImpl :
@@ -498,6 +571,44 @@ namespace leap {
     }
   };
 
+  template<typename T>
+  struct primitive_serial_traits<lazy_ptr<T>, void> :
+    std::integral_constant<bool, has_serializer<T>::value>
+  {
+    typedef lazy_ptr<T> ptr_t;
+    static const bool is_optional = true;
+
+    static ::leap::serial_atom type() {
+      return ::leap::serial_atom::reference;
+    }
+
+    static uint64_t size(const OArchiveRegistry& ar, const ptr_t& pObj) {
+      return ar.SizeObjectReference(field_serializer_t<T, void>::GetDescriptor(), pObj.get());
+    }
+
+    static void serialize(OArchiveRegistry& ar, const ptr_t& obj) {
+      ar.WriteObjectReference(
+        field_serializer_t<T, void>::GetDescriptor(),
+        obj.get()
+      );
+    }
+
+    static void deserialize(IArchive& ar, ptr_t& obj, uint64_t ncb) {
+      std::shared_ptr<internal::LazySource> source;
+      uint32_t objId;
+      if (!ar.ReadObjectReferenceLazy(source, objId)) {
+        // Archive reads everything right away, same as it would for a shared pointer
+        std::shared_ptr<T> ptr;
+        primitive_serial_traits<std::shared_ptr<T>>::deserialize(ar, ptr, ncb);
+        obj = std::move(ptr);
+      }
+      else if (source)
+        obj = ptr_t{ std::move(source), field_serializer_t<T, void>::GetDescriptor(), objId };
+      else
+        obj = nullptr;
+    }
+  };
+
   template<typename T, size_t N>
   struct primitive_serial_traits<std::array<T, N>, void> :
     std::integral_constant<bool, has_serializer<T>::value>
@@ -553,7 +664,11 @@ namespace leap {
     static void deserialize(IArchiveRegistry& ar, T*& pObj, uint64_t ncb) {
       create_delete creatorDeletor = {
         []() -> void* { return new T; },
-        [](void* ptr) { delete (T*)ptr; }
+        [](void* ptr) { delete (T*)ptr; },
+        sizeof(T),
+        alignof(T),
+        [](void* ptr) -> void* { return new (ptr) T; },
+        internal::DestroyFn<T>()
       };
 
       pObj = (T*)ar.ReadObjectReference(creatorDeletor, field_serializer_t<T, void>::GetDescriptor());
@@ -605,4 +720,36 @@ namespace leap {
       );
     }
   };
+
+  template<typename T>
+  struct serial_traits<basic_string_ref<T>>
+  {
+    static const bool is_optional = true;
+
+    static ::leap::serial_atom type() {
+      return ::leap::serial_atom::string;
+    }
+
+    static uint64_t size(const OArchive& ar, const basic_string_ref<T>& obj) {
+      return ar.SizeString(obj.data(), obj.size(), sizeof(T));
+    }
+
+    static void serialize(OArchive& ar, const basic_string_ref<T>& obj) {
+      ar.WriteString(obj.data(), obj.size(), sizeof(T));
+    }
+
+    static void deserialize(IArchive& ar, basic_string_ref<T>& obj, uint64_t ncb) {
+      // Refer to the input directly if we can, otherwise take a copy
+      const void* pBuf;
+      uint64_t count;
+      if (ar.ReadStringRef(pBuf, count, sizeof(T), ncb))
+        obj = basic_string_ref<T>{ static_cast<const T*>(pBuf), static_cast<size_t>(count) };
+      else
+        ar.ReadString(
+          [&](uint64_t count) { return obj.allocate(static_cast<size_t>(count)); },
+          sizeof(T),
+          ncb
+        );
+    }
+  };
 }
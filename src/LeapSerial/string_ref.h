@@ -0,0 +1,116 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace leap {
+  /// <summary>
+  /// A run of characters that refers to the buffer it was deserialized from, where possible
+  /// </summary>
+  /// <remarks>
+  /// When a string_ref field is read from a stream that lends out memory which outlives the stream,
+  /// such as a BufferedInputStream over a caller-supplied or memory-mapped buffer, the field points
+  /// directly into that memory and no copy is made.  The caller must then keep the memory alive for
+  /// as long as the field is in use.  Otherwise, the field holds a copy of its own.
+  ///
+  /// On the wire, a basic_string_ref is indistinguishable from the corresponding std::basic_string.
+  /// </remarks>
+  template<typename T>
+  class basic_string_ref {
+  public:
+    basic_string_ref(void) = default;
+
+    /// <summary>
+    /// Refers to the specified characters without copying them
+    /// </summary>
+    basic_string_ref(const T* pData, size_t n) :
+      m_pData(pData),
+      m_size(n)
+    {}
+
+    /// <summary>
+    /// Refers to the contents of the specified string, which must outlive this reference
+    /// </summary>
+    basic_string_ref(const std::basic_string<T>& str) :
+      m_pData(str.data()),
+      m_size(str.size())
+    {}
+
+    basic_string_ref(const basic_string_ref& rhs) { *this = rhs; }
+    basic_string_ref(basic_string_ref&& rhs) = default;
+
+  private:
+    const T* m_pData = nullptr;
+    size_t m_size = 0;
+
+    // Owned copy, if m_pData does not point into some other buffer
+    std::unique_ptr<T[]> m_owned;
+
+  public:
+    const T* data(void) const { return m_pData; }
+    size_t size(void) const { return m_size; }
+    bool empty(void) const { return !m_size; }
+    const T* begin(void) const { return m_pData; }
+    const T* end(void) const { return m_pData + m_size; }
+    const T& operator[](size_t i) const { return m_pData[i]; }
+
+    /// <returns>True if this instance holds its own copy of the characters</returns>
+    bool owned(void) const { return m_owned && m_owned.get() == m_pData; }
+
+    std::basic_string<T> str(void) const { return{ m_pData, m_size }; }
+
+    /// <summary>
+    /// Allocates space for a copy of n characters, and returns a pointer to it for the caller to fill
+    /// </summary>
+    /// <remarks>
+    /// Unlike std::basic_string::resize, the new space is not initialized
+    /// </remarks>
+    T* allocate(size_t n) {
+      m_owned.reset(n ? new T[n] : nullptr);
+      m_pData = m_owned.get();
+      m_size = n;
+      return m_owned.get();
+    }
+
+    basic_string_ref& operator=(const basic_string_ref& rhs) {
+      if (this == &rhs)
+        return *this;
+      if (rhs.owned())
+        std::memcpy(allocate(rhs.m_size), rhs.m_pData, rhs.m_size * sizeof(T));
+      else {
+        m_owned.reset();
+        m_pData = rhs.m_pData;
+        m_size = rhs.m_size;
+      }
+      return *this;
+    }
+    basic_string_ref& operator=(basic_string_ref&& rhs) = default;
+
+    bool operator==(const basic_string_ref& rhs) const {
+      return m_size == rhs.m_size && std::equal(begin(), end(), rhs.begin());
+    }
+    bool operator!=(const basic_string_ref& rhs) const { return !(*this == rhs); }
+    bool operator==(const std::basic_string<T>& rhs) const { return *this == basic_string_ref{ rhs }; }
+    bool operator!=(const std::basic_string<T>& rhs) const { return !(*this == rhs); }
+  };
+
+  template<typename T>
+  bool operator==(const std::basic_string<T>& lhs, const basic_string_ref<T>& rhs) { return rhs == lhs; }
+  template<typename T>
+  bool operator!=(const std::basic_string<T>& lhs, const basic_string_ref<T>& rhs) { return rhs != lhs; }
+
+  typedef basic_string_ref<char> string_ref;
+  typedef basic_string_ref<wchar_t> wstring_ref;
+
+  /// <summary>
+  /// A run of bytes that refers to the buffer it was deserialized from, where possible
+  /// </summary>
+  /// <remarks>
+  /// Bytes are written as a counted string of one-byte characters
+  /// </remarks>
+  typedef basic_string_ref<uint8_t> bytes_ref;
+}
@@ -1,7 +1,12 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include <LeapSerial/ArchiveLeapSerial.h>
+#include <LeapSerial/ArchiveLeapSerialV0.h>
+#include <LeapSerial/ForwardingStream.h>
 #include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <LeapSerial/OpenTable.h>
+#include <LeapSerial/Utility.hpp>
 #include <gtest/gtest.h>
 #include <sstream>
 
@@ -157,3 +162,1088 @@ TEST_F(ArchiveLeapSerialTest, VarintSizeExpectationCheck) {
     oarch.SizeInteger(0x7FFFFFFFFULL)
   ) << "Boundary case failure";
 }
+
+namespace {
+  // Leaf type that counts the number of times its size has been queried
+  struct SizeCountedLeaf {
+    int value;
+    static size_t s_nSizeCalls;
+  };
+  size_t SizeCountedLeaf::s_nSizeCalls = 0;
+
+  struct NestedLevel3 {
+    SizeCountedLeaf leaf;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &NestedLevel3::leaf } }; }
+  };
+
+  struct NestedLevel2 {
+    NestedLevel3 child;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &NestedLevel2::child } }; }
+  };
+
+  struct NestedLevel1 {
+    NestedLevel2 child;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &NestedLevel1::child } }; }
+  };
+}
+
+namespace leap {
+  template<>
+  struct serial_traits<SizeCountedLeaf> {
+    static const bool is_optional = false;
+
+    static ::leap::serial_atom type() { return ::leap::serial_atom::i32; }
+
+    static uint64_t size(const OArchive& ar, const SizeCountedLeaf& obj) {
+      SizeCountedLeaf::s_nSizeCalls++;
+      return ar.SizeInteger(obj.value, sizeof(obj.value));
+    }
+
+    static void serialize(OArchive& ar, const SizeCountedLeaf& obj) {
+      ar.WriteInteger(obj.value, sizeof(obj.value));
+    }
+
+    static void deserialize(IArchive& ar, SizeCountedLeaf& obj, uint64_t ncb) {
+      obj.value = static_cast<int>(ar.ReadInteger(sizeof(obj.value)));
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, NestedObjectsSizedOnce) {
+  NestedLevel1 obj;
+  obj.child.child.leaf.value = 1099;
+
+  SizeCountedLeaf::s_nSizeCalls = 0;
+  std::stringstream ss;
+  leap::Serialize(ss, obj);
+  ASSERT_EQ(1UL, SizeCountedLeaf::s_nSizeCalls) << "Deeply nested field was sized once per ancestor";
+
+  NestedLevel1 read;
+  leap::Deserialize(ss, read);
+  ASSERT_EQ(1099, read.child.child.leaf.value);
+}
+
+namespace {
+  struct NestedList {
+    std::vector<NestedLevel1> entries;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &NestedList::entries } }; }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, NestedEntriesSizedOnce) {
+  NestedList obj;
+  obj.entries.resize(5);
+  for (size_t i = 0; i < obj.entries.size(); i++)
+    obj.entries[i].child.child.leaf.value = static_cast<int>(i);
+
+  SizeCountedLeaf::s_nSizeCalls = 0;
+  std::stringstream ss;
+  leap::Serialize(ss, obj);
+  ASSERT_EQ(obj.entries.size(), SizeCountedLeaf::s_nSizeCalls) << "Entries of a container were sized once per ancestor";
+
+  NestedList read;
+  leap::Deserialize(ss, read);
+  ASSERT_EQ(5UL, read.entries.size());
+  ASSERT_EQ(4, read.entries[4].child.child.leaf.value);
+}
+
+namespace {
+  struct Label {
+    std::string text;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &Label::text } }; }
+  };
+
+  // Written out as a Label that its serial_traits build on the stack
+  struct Tag {
+    size_t length;
+    Label ToLabel(void) const { return{ std::string(length, 'x') }; }
+  };
+
+  struct Tags {
+    std::vector<Tag> tags;
+    static leap::descriptor GetDescriptor(void) { return{ { 1, &Tags::tags } }; }
+  };
+}
+
+namespace leap {
+  template<>
+  struct serial_traits<Tag> {
+    static const bool is_optional = false;
+
+    static ::leap::serial_atom type() { return serial_traits<Label>::type(); }
+
+    static uint64_t size(const OArchiveRegistry& ar, const Tag& obj) {
+      // Every label is built at the same address, which the archive must not remember sizes by
+      return serial_traits<Label>::size(ar, obj.ToLabel());
+    }
+
+    static void serialize(OArchiveRegistry& ar, const Tag& obj) {
+      serial_traits<Label>::serialize(ar, obj.ToLabel());
+    }
+
+    static void deserialize(IArchiveRegistry& ar, Tag& obj, uint64_t ncb) {
+      Label label;
+      serial_traits<Label>::deserialize(ar, label, ncb);
+      obj.length = label.text.size();
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, TraitsSerializingTemporaries) {
+  Tags obj;
+  for (size_t i = 0; i < 20; i++)
+    obj.tags.push_back({ i * 7 % 13 });
+
+  // A stream that cannot be patched, so that every length prefix is computed up front
+  std::stringstream ss;
+  leap::OutputStreamAdapter osa{ ss };
+  leap::OArchiveLeapSerial oarch(osa);
+  leap::SerializeWithArchive(oarch, obj);
+
+  leap::InputStreamAdapter isa{ ss };
+  leap::IArchiveLeapSerial iarch(isa);
+  auto read = leap::DeserializeWithArchive<Tags>(iarch);
+  ASSERT_EQ(obj.tags.size(), read->tags.size());
+  for (size_t i = 0; i < obj.tags.size(); i++)
+    ASSERT_EQ(obj.tags[i].length, read->tags[i].length) << "Size of one temporary was reused for another";
+}
+
+TEST_F(ArchiveLeapSerialTest, BackpatchedLengths) {
+  NestedLevel1 nested;
+  nested.child.child.leaf.value = -7;
+
+  MyRepeatedStructure child;
+  int childValue = 101;
+  child.pv = &childValue;
+
+  MySimpleStructure mss;
+  mss.a = 909;
+  mss.b = -1;
+  mss.myString = "Hello world";
+  mss.myWString = L"Hello world again!";
+  mss.selfReference = &mss;
+  mss.x = &child;
+  mss.y = nullptr;
+  mss.someIntegers = { 1, 2, 3 };
+  mss.vectorOfChildren = { &child, &child };
+
+  leap::MemoryStream ms;
+  SizeCountedLeaf::s_nSizeCalls = 0;
+  {
+    leap::OArchiveLeapSerial oarch(ms);
+    oarch.Backpatch = true;
+    leap::SerializeWithArchive(oarch, nested);
+  }
+  {
+    leap::OArchiveLeapSerial oarch(ms);
+    oarch.Backpatch = true;
+    leap::SerializeWithArchive(oarch, mss);
+  }
+  ASSERT_EQ(0UL, SizeCountedLeaf::s_nSizeCalls) << "Sizing pass was performed even though lengths were backpatched";
+
+  NestedLevel1 nestedRead;
+  leap::Deserialize(ms, nestedRead);
+  ASSERT_EQ(-7, nestedRead.child.child.leaf.value);
+
+  auto read = leap::Deserialize<MySimpleStructure>(ms);
+  ASSERT_EQ(909, read->a);
+  ASSERT_EQ(-1, read->b);
+  ASSERT_EQ(mss.myString, read->myString);
+  ASSERT_EQ(mss.myWString, read->myWString);
+  ASSERT_EQ(read.get(), read->selfReference);
+  ASSERT_EQ(101, *read->x->pv);
+  ASSERT_EQ(nullptr, read->y);
+  ASSERT_EQ(mss.someIntegers, read->someIntegers);
+  ASSERT_EQ(2UL, read->vectorOfChildren.size());
+  ASSERT_EQ(read->x, read->vectorOfChildren[0]);
+}
+
+TEST_F(ArchiveLeapSerialTest, SmallWriteBuffer) {
+  MySimpleStructure mss;
+  mss.a = 909;
+  mss.b = -1;
+  mss.myString = "A string that is longer than the staging buffer";
+  mss.myWString = L"Hello world again!";
+  mss.selfReference = &mss;
+  mss.x = nullptr;
+  mss.y = nullptr;
+  mss.someIntegers = { 1, 2, 3 };
+
+  // Both with and without backpatching, so that placeholders are patched both in the staging
+  // buffer and in the output stream after they have been flushed
+  for (bool backpatch : { false, true }) {
+    leap::MemoryStream ms;
+    {
+      leap::OArchiveLeapSerial oarch(ms);
+      oarch.BufferSize = 8;
+      oarch.Backpatch = backpatch;
+      leap::SerializeWithArchive(oarch, mss);
+    }
+
+    auto read = leap::Deserialize<MySimpleStructure>(ms);
+    ASSERT_EQ(909, read->a);
+    ASSERT_EQ(-1, read->b);
+    ASSERT_EQ(mss.myString, read->myString);
+    ASSERT_EQ(mss.myWString, read->myWString);
+    ASSERT_EQ(read.get(), read->selfReference);
+    ASSERT_EQ(mss.someIntegers, read->someIntegers);
+  }
+}
+
+namespace {
+  struct PackedArrays {
+    std::vector<float> floats;
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> integers;
+    double fixed[4];
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &PackedArrays::floats },
+        { 2, &PackedArrays::bytes },
+        { 3, &PackedArrays::integers },
+        { 4, &PackedArrays::fixed }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, PackedArithmeticArrays) {
+  PackedArrays obj;
+  for (size_t i = 0; i < 1000; i++) {
+    obj.floats.push_back(static_cast<float>(i) * 0.5f);
+    obj.bytes.push_back(static_cast<uint8_t>(i));
+    obj.integers.push_back(-(static_cast<int64_t>(i) << 40));
+  }
+  obj.fixed[0] = 1.0;
+  obj.fixed[1] = -2.0;
+  obj.fixed[2] = 3.5;
+  obj.fixed[3] = 1e100;
+
+  std::stringstream ss;
+  leap::OutputStreamAdapter osa{ ss };
+  {
+    leap::OArchiveLeapSerial oarch(osa);
+    oarch.Pack = true;
+
+    // Each array is a count word, an element width, and then the raw elements
+    ASSERT_EQ(
+      sizeof(uint32_t) + 1 + obj.floats.size() * sizeof(float),
+      leap::serial_traits<std::vector<float>>::size(oarch, obj.floats)
+    ) << "Arithmetic array was not packed";
+
+    leap::SerializeWithArchive(oarch, obj);
+  }
+
+  PackedArrays read;
+  leap::Deserialize(ss, read);
+  ASSERT_EQ(obj.floats, read.floats);
+  ASSERT_EQ(obj.bytes, read.bytes);
+  ASSERT_EQ(obj.integers, read.integers);
+  for (size_t i = 0; i < 4; i++)
+    ASSERT_EQ(obj.fixed[i], read.fixed[i]);
+}
+
+namespace {
+  struct PackedFlags {
+    bool flags[4];
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &PackedFlags::flags }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, PackedBoolsNormalized) {
+  PackedFlags obj;
+  obj.flags[0] = true;
+  obj.flags[1] = false;
+  obj.flags[2] = true;
+  obj.flags[3] = true;
+
+  std::stringstream ss;
+  {
+    leap::OutputStreamAdapter osa{ ss };
+    leap::OArchiveLeapSerial oarch(osa);
+    oarch.Pack = true;
+    leap::SerializeWithArchive(oarch, obj);
+  }
+
+  // Any nonzero byte in the stream is a true value
+  std::string data = ss.str();
+  const std::string packed("\x01\x00\x01\x01", 4);
+  size_t pos = data.find(packed);
+  ASSERT_NE(std::string::npos, pos) << "Bool array was not packed";
+  data[pos] = '\x7F';
+  data[pos + 2] = '\xFF';
+
+  std::stringstream corrupted(data);
+  PackedFlags read;
+  leap::Deserialize(corrupted, read);
+  for (size_t i = 0; i < 4; i++) {
+    uint8_t b;
+    memcpy(&b, &read.flags[i], 1);
+    ASSERT_EQ(obj.flags[i] ? 1 : 0, b) << "Bool was left holding a byte other than zero or one";
+  }
+}
+
+namespace {
+  struct UnpackedArrays {
+    std::vector<float> floats;
+    std::vector<uint8_t> bytes;
+    std::vector<int64_t> integers;
+    double fixed[2];
+    bool flags[3];
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &UnpackedArrays::floats },
+        { 2, &UnpackedArrays::bytes },
+        { 3, &UnpackedArrays::integers },
+        { 4, &UnpackedArrays::fixed },
+        { 5, &UnpackedArrays::flags }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, ArraysUnpackedByDefault) {
+  UnpackedArrays obj;
+  obj.floats = { 0.5f, -1.0f };
+  obj.bytes = { 1, 200 };
+  obj.integers = { 1, -300, 1LL << 40 };
+  obj.fixed[0] = 1.0;
+  obj.fixed[1] = -2.0;
+  obj.flags[0] = true;
+  obj.flags[1] = false;
+  obj.flags[2] = true;
+
+  std::stringstream ss;
+  leap::Serialize(ss, obj);
+
+  // Each field as it was written by a build that did not know how to pack arrays, which wrote the
+  // fields in a different order
+  const std::string expected[] = {
+    std::string("\x0A\x0C\x02\x00\x00\x00\x00\x00\x00\x3F\x00\x00\x80\xBF", 14),
+    std::string("\x12\x07\x02\x00\x00\x00\x01\xC8\x01", 9),
+    std::string(
+      "\x1A\x15\x03\x00\x00\x00\x01\xD4\xFD\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x01"
+      "\x80\x80\x80\x80\x80\x20",
+      23
+    ),
+    std::string(
+      "\x22\x14\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\xF0\x3F\x00\x00\x00\x00"
+      "\x00\x00\x00\xC0",
+      22
+    ),
+    std::string("\x2A\x07\x03\x00\x00\x00\x01\x00\x01", 9)
+  };
+  const std::string data = ss.str();
+  ASSERT_EQ(std::string("\x0A\x4D", 2), data.substr(0, 2));
+  ASSERT_EQ(79UL, data.size());
+  for (const std::string& field : expected)
+    ASSERT_NE(std::string::npos, data.find(field)) << "Array was not written in the original encoding";
+
+  UnpackedArrays read;
+  leap::Deserialize(ss, read);
+  ASSERT_EQ(obj.floats, read.floats);
+  ASSERT_EQ(obj.bytes, read.bytes);
+  ASSERT_EQ(obj.integers, read.integers);
+  ASSERT_EQ(-2.0, read.fixed[1]);
+  ASSERT_FALSE(read.flags[1]);
+  ASSERT_TRUE(read.flags[2]);
+}
+
+namespace {
+  struct MoveCounted {
+    MoveCounted(void) = default;
+    MoveCounted(const MoveCounted& rhs) : value(rhs.value) { nMoves++; }
+    MoveCounted(MoveCounted&& rhs) : value(rhs.value) { nMoves++; }
+    MoveCounted& operator=(const MoveCounted&) = default;
+
+    static size_t nMoves;
+    int value = 0;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &MoveCounted::value
+      };
+    }
+  };
+  size_t MoveCounted::nMoves = 0;
+
+  struct MoveCountedArrays {
+    std::vector<MoveCounted> fixed;
+    std::vector<std::string> counted;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &MoveCountedArrays::fixed },
+        { 2, &MoveCountedArrays::counted }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, ArrayEntriesAllocatedInPlace) {
+  MoveCountedArrays obj;
+  obj.fixed.resize(100);
+  for (size_t i = 0; i < obj.fixed.size(); i++) {
+    obj.fixed[i].value = static_cast<int>(i * 3);
+    obj.counted.push_back(std::to_string(i));
+  }
+
+  std::stringstream ss;
+  leap::Serialize(ss, obj);
+
+  MoveCountedArrays read;
+  MoveCounted::nMoves = 0;
+  leap::Deserialize(ss, read);
+  ASSERT_EQ(0UL, MoveCounted::nMoves) << "Array entries were constructed elsewhere and moved into place";
+  ASSERT_EQ(obj.fixed.size(), read.fixed.size());
+  for (size_t i = 0; i < obj.fixed.size(); i++)
+    ASSERT_EQ(obj.fixed[i].value, read.fixed[i].value);
+  ASSERT_EQ(obj.counted, read.counted);
+}
+
+TEST_F(ArchiveLeapSerialTest, BatchVarintRoundTrip) {
+  // Long runs of single-byte values interrupted by larger values
+  std::vector<uint64_t> values;
+  for (uint64_t i = 0; i < 1000; i++)
+    values.push_back(i % 97 ? i % 128 : i << (i % 57));
+  values.push_back(~0ULL);
+
+  std::vector<uint8_t> expected;
+  for (uint64_t value : values) {
+    size_t ncb = 1;
+    auto varint = leap::ToBase128(value, ncb);
+    expected.insert(expected.end(), varint.begin(), varint.begin() + ncb);
+  }
+
+  std::vector<uint8_t> buf(values.size() * 10);
+  buf.resize(leap::ToBase128(values.data(), values.size(), buf.data()));
+  ASSERT_EQ(expected, buf) << "Batch encoding differs from scalar encoding";
+
+  std::vector<uint64_t> decoded(values.size());
+  size_t ncbRead;
+  ASSERT_EQ(values.size(), leap::FromBase128(buf.data(), buf.size(), decoded.data(), decoded.size(), ncbRead));
+  ASSERT_EQ(buf.size(), ncbRead);
+  ASSERT_EQ(values, decoded);
+
+  // The final value is ten bytes long, decoding must stop before it if it is truncated
+  ASSERT_EQ(values.size() - 1, leap::FromBase128(buf.data(), buf.size() - 1, decoded.data(), decoded.size(), ncbRead));
+  ASSERT_EQ(buf.size() - 10, ncbRead);
+}
+
+TEST_F(ArchiveLeapSerialTest, BatchVarintOverlong) {
+  // Eleven bytes, where a 64-bit value never needs more than ten
+  std::vector<uint8_t> buf(10, 0x80);
+  buf.push_back(0x01);
+  buf.push_back(0x05);
+
+  uint64_t decoded[2];
+  size_t ncbRead;
+  ASSERT_EQ(0U, leap::FromBase128(buf.data(), buf.size(), decoded, 2, ncbRead));
+  ASSERT_EQ(0U, ncbRead);
+
+  // The same varint in the middle of an integer array
+  leap::MemoryStream ms;
+  const uint32_t nEntries = 3;
+  ms.Write(&nEntries, sizeof(nEntries));
+  ms.Write("\x07", 1);
+  ms.Write(buf.data(), buf.size());
+
+  leap::IArchiveLeapSerial iar(ms);
+  std::vector<uint32_t> read;
+  ASSERT_THROW(leap::serial_traits<std::vector<uint32_t>>::deserialize(iar, read, 0), std::runtime_error);
+}
+
+namespace {
+  struct IntegerArrays {
+    std::vector<int32_t> signedValues;
+    std::vector<uint16_t> unsignedValues;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &IntegerArrays::signedValues,
+        &IntegerArrays::unsignedValues
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, V0IntegerArrays) {
+  IntegerArrays obj;
+  for (int32_t i = 0; i < 1000; i++) {
+    obj.signedValues.push_back(i % 3 ? i % 100 : -i * 1000);
+    obj.unsignedValues.push_back(static_cast<uint16_t>(i * 71));
+  }
+
+  std::stringstream ss;
+  leap::Serialize<leap::OArchiveLeapSerialV0>(ss, obj);
+
+  IntegerArrays read;
+  leap::Deserialize<leap::IArchiveLeapSerialV0>(ss, read);
+  ASSERT_EQ(obj.signedValues, read.signedValues);
+  ASSERT_EQ(obj.unsignedValues, read.unsignedValues);
+}
+
+namespace {
+  struct GraphNode {
+    int value;
+    GraphNode* next;
+    std::unique_ptr<int> owned;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &GraphNode::value,
+        &GraphNode::next,
+        &GraphNode::owned
+      };
+    }
+  };
+
+  struct Graph {
+    std::vector<GraphNode*> nodes;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &Graph::nodes
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, LargeReferenceGraph) {
+  // Enough distinct objects that the identity tables must grow several times
+  std::vector<GraphNode> storage(1000);
+  Graph graph;
+  for (size_t i = 0; i < storage.size(); i++) {
+    storage[i].value = static_cast<int>(i);
+    storage[i].next = &storage[(i + 1) % storage.size()];
+    if (i % 2)
+      storage[i].owned.reset(new int(static_cast<int>(i) * 3));
+    graph.nodes.push_back(&storage[i]);
+  }
+
+  std::stringstream ss;
+  leap::Serialize(ss, graph);
+
+  auto read = leap::Deserialize<Graph>(ss);
+  ASSERT_EQ(storage.size(), read->nodes.size());
+  for (size_t i = 0; i < storage.size(); i++) {
+    const GraphNode* pNode = read->nodes[i];
+    ASSERT_EQ(static_cast<int>(i), pNode->value);
+    ASSERT_EQ(read->nodes[(i + 1) % storage.size()], pNode->next) << "Cycle was not reconstructed";
+    if (i % 2)
+      ASSERT_EQ(static_cast<int>(i) * 3, *pNode->owned);
+    else
+      ASSERT_EQ(nullptr, pNode->owned);
+  }
+}
+
+TEST_F(ArchiveLeapSerialTest, ArchiveReuse) {
+  std::vector<GraphNode> storage(10);
+  Graph graph;
+  for (size_t i = 0; i < storage.size(); i++) {
+    storage[i].value = static_cast<int>(i);
+    storage[i].next = &storage[(i + 1) % storage.size()];
+    graph.nodes.push_back(&storage[i]);
+  }
+
+  // Two records through one archive, then a third after rebinding it to a new stream
+  std::stringstream ss1, ss2;
+  leap::OutputStreamAdapter os1{ ss1 }, os2{ ss2 };
+  leap::OArchiveLeapSerial oar(os1);
+  leap::SerializeWithArchive(oar, graph);
+  storage[0].value = 100;
+  leap::SerializeWithArchive(oar, graph);
+  oar.Rebind(os2);
+  storage[0].value = 200;
+  leap::SerializeWithArchive(oar, graph);
+
+  leap::InputStreamAdapter is1{ ss1 }, is2{ ss2 };
+  leap::IArchiveLeapSerial iar(is1);
+  for (int expected : { 0, 100, 200 }) {
+    if (expected == 200)
+      iar.Rebind(is2);
+
+    auto read = leap::DeserializeWithArchive<Graph>(iar);
+    ASSERT_EQ(storage.size(), read->nodes.size());
+    ASSERT_EQ(expected, read->nodes[0]->value);
+    for (size_t i = 0; i < storage.size(); i++)
+      ASSERT_EQ(read->nodes[(i + 1) % storage.size()], read->nodes[i]->next) << "Cycle was not reconstructed";
+  }
+  ASSERT_EQ(ss2.str().size(), iar.Count()) << "Rebind did not reset the read count";
+}
+
+namespace {
+  struct IdentityHash {
+    uint64_t operator()(int key) const { return static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL; }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, OpenTableClear) {
+  leap::internal::OpenTable<int, int, IdentityHash> table;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 100; i++)
+      table.Insert(i + round, i);
+    ASSERT_EQ(100U, table.Size());
+    ASSERT_EQ(nullptr, table.Find(round - 1)) << "Entry survived a clear";
+    ASSERT_EQ(99, *table.Find(99 + round));
+    table.Clear();
+    ASSERT_EQ(0U, table.Size());
+    ASSERT_EQ(nullptr, table.Find(round));
+  }
+}
+
+namespace {
+  // Writes through the protected stream reference, as archives written before Rebind existed do
+  class LegacyOArchive :
+    public leap::OArchiveLeapSerial
+  {
+  public:
+    LegacyOArchive(leap::IOutputStream& os) :
+      OArchiveLeapSerial(os)
+    {}
+
+    void WriteMarker(void) { os.Write("!", 1); }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, ProtectedStreamFollowsRebind) {
+  leap::MemoryStream ms1, ms2;
+  LegacyOArchive oar(ms1);
+  oar.WriteMarker();
+  oar.Rebind(ms2);
+  oar.WriteMarker();
+  ASSERT_EQ(1, ms1.Length());
+  ASSERT_EQ(1, ms2.Length()) << "Protected stream was not rebound";
+}
+
+namespace {
+  struct NestedPayload {
+    int value;
+    static leap::descriptor GetDescriptor(void) { return{ &NestedPayload::value }; }
+  };
+
+  // Written with a call to WriteObject made while the enclosing object is being written
+  struct NestedRecord {
+    NestedPayload payload;
+  };
+
+  struct BackLinkedRoot;
+
+  struct BackLink {
+    BackLinkedRoot* parent;
+    static leap::descriptor GetDescriptor(void) { return{ &BackLink::parent }; }
+  };
+
+  struct BackLinkedRoot {
+    NestedRecord nested;
+    BackLink* child;
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &BackLinkedRoot::nested,
+        &BackLinkedRoot::child
+      };
+    }
+  };
+}
+
+namespace leap {
+  template<>
+  struct serial_traits<NestedRecord> {
+    static const bool is_optional = false;
+
+    static ::leap::serial_atom type() { return ::leap::serial_atom::ui32; }
+
+    static uint64_t size(const OArchiveRegistry& ar, const NestedRecord& obj) {
+      // A one-byte record header and a one-byte length, then the payload
+      return 2 + serial_traits<NestedPayload>::size(ar, obj.payload);
+    }
+
+    static void serialize(OArchiveRegistry& ar, const NestedRecord& obj) {
+      ar.WriteObject(field_serializer_t<NestedPayload, void>::GetDescriptor(), &obj.payload);
+    }
+
+    static void deserialize(IArchiveRegistry& ar, NestedRecord& obj, uint64_t ncb) {
+      ar.ReadObject(field_serializer_t<NestedPayload, void>::GetDescriptor(), &obj.payload, nullptr);
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, NestedWriteKeepsRootIdentifier) {
+  BackLinkedRoot root;
+  BackLink child;
+  root.nested.payload.value = 42;
+  root.child = &child;
+  child.parent = &root;
+
+  std::stringstream ss;
+  leap::Serialize(ss, root);
+
+  std::shared_ptr<BackLinkedRoot> read = leap::Deserialize<BackLinkedRoot>(ss);
+  ASSERT_EQ(42, read->nested.payload.value);
+  ASSERT_NE(nullptr, read->child);
+  ASSERT_EQ(read.get(), read->child->parent) << "Reference to the root was given the identifier of a nested root";
+}
+
+namespace {
+  enum class PlanEnum : int32_t {
+    Negative = -7,
+    Positive = 9
+  };
+
+  struct PlanInner {
+    int16_t a;
+    double b;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &PlanInner::a,
+        { 3, &PlanInner::b }
+      };
+    }
+  };
+
+  struct PlanPoint {
+    int16_t a;
+    double b;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &PlanPoint::a,
+        &PlanPoint::b
+      };
+    }
+  };
+
+  struct PlanOuter {
+    int8_t i8;
+    uint64_t ui64;
+    bool flag;
+    PlanEnum e;
+    PlanPoint positional;
+    PlanInner identified;
+    uint32_t counted;
+    float sparse;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &PlanOuter::i8,
+        &PlanOuter::ui64,
+        &PlanOuter::flag,
+        &PlanOuter::e,
+        &PlanOuter::positional,
+        { 1, &PlanOuter::identified },
+        { 2, &PlanOuter::counted },
+        { 100000, &PlanOuter::sparse }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, CompiledPlans) {
+  const leap::descriptor& desc = leap::serial_traits<PlanOuter>::get_descriptor();
+  const leap::internal::Plan& plan = leap::internal::Plan::Get(desc);
+  ASSERT_EQ(&plan, &leap::internal::Plan::Get(desc)) << "Plan was not cached on its descriptor";
+  ASSERT_EQ(5U, plan.nPositional);
+  ASSERT_EQ(8U, plan.ops.size());
+  ASSERT_EQ(leap::internal::Plan::Opcode::generic, plan.ops[3].code) << "Enums must not be treated as plain integers";
+  ASSERT_EQ(leap::internal::Plan::Opcode::object, plan.ops[4].code);
+  size_t hint = 0;
+  ASSERT_NE(nullptr, plan.Find(100000, hint));
+  ASSERT_EQ(nullptr, plan.Find(4, hint));
+
+  // Copies compile a plan of their own
+  leap::descriptor copy = desc;
+  ASSERT_NE(&plan, &leap::internal::Plan::Get(copy));
+
+  PlanOuter obj;
+  obj.i8 = -3;
+  obj.ui64 = 0xFEDCBA9876543210ULL;
+  obj.flag = true;
+  obj.e = PlanEnum::Negative;
+  obj.positional = { -300, 1.5 };
+  obj.identified = { 12, -2.25 };
+  obj.counted = 0xFFFFFFFF;
+  obj.sparse = 3.5f;
+
+  for (bool backpatch : { false, true }) {
+    std::stringstream ss;
+    leap::OutputStreamAdapter osa{ ss };
+    leap::OArchiveLeapSerial ar(osa);
+    ar.Backpatch = backpatch;
+    leap::SerializeWithArchive(ar, obj);
+
+    PlanOuter read;
+    leap::Deserialize(ss, read);
+    ASSERT_EQ(obj.i8, read.i8);
+    ASSERT_EQ(obj.ui64, read.ui64);
+    ASSERT_EQ(obj.flag, read.flag);
+    ASSERT_EQ(obj.e, read.e);
+    ASSERT_EQ(obj.positional.a, read.positional.a);
+    ASSERT_EQ(obj.positional.b, read.positional.b);
+    ASSERT_EQ(obj.identified.a, read.identified.a);
+    ASSERT_EQ(obj.identified.b, read.identified.b);
+    ASSERT_EQ(obj.counted, read.counted);
+    ASSERT_EQ(obj.sparse, read.sparse);
+  }
+}
+
+namespace {
+  struct ReadAheadWriter {
+    int64_t small;
+    std::string blob;
+    uint64_t huge;
+    std::vector<int> values;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &ReadAheadWriter::values,
+        { 1, &ReadAheadWriter::small },
+        { 2, &ReadAheadWriter::blob },
+        { 3, &ReadAheadWriter::huge }
+      };
+    }
+  };
+
+  // Same as ReadAheadWriter, but without the blob, which must be skipped
+  struct ReadAheadReader {
+    int64_t small;
+    uint64_t huge;
+    std::vector<int> values;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &ReadAheadReader::values,
+        { 1, &ReadAheadReader::small },
+        { 3, &ReadAheadReader::huge }
+      };
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, ReadAheadStopsAtRecordEnd) {
+  // Blobs on either side of the read-ahead buffer size, so that both buffered and direct reads are exercised
+  const size_t ncbBlobs[] = { 0, 10, 5000, 100000 };
+  std::stringstream ss;
+  std::vector<std::streampos> ends;
+  for (size_t ncbBlob : ncbBlobs) {
+    ReadAheadWriter obj;
+    obj.small = -static_cast<int64_t>(ncbBlob);
+    obj.blob.assign(ncbBlob, 'x');
+    obj.huge = ~0ULL - ncbBlob;
+    for (int i = 0; i < 300; i++)
+      obj.values.push_back((i % 4) << (i % 29));
+    leap::Serialize(ss, obj);
+    ends.push_back(ss.tellp());
+  }
+
+  // Each object is read by its own archive, which must leave the stream at the start of the next one
+  std::streampos begin = 0;
+  for (size_t i = 0; i < ends.size(); i++) {
+    leap::InputStreamAdapter isa{ ss };
+    ReadAheadReader obj;
+    {
+      leap::IArchiveLeapSerial iar(isa);
+      leap::DeserializeWithArchive(iar, obj);
+      ASSERT_EQ(static_cast<uint64_t>(ends[i] - begin), iar.Count()) << "Skipped bytes were not counted";
+    }
+    ASSERT_EQ(ends[i], ss.tellg()) << "Archive read past the end of object " << i;
+    begin = ends[i];
+
+    ASSERT_EQ(-static_cast<int64_t>(ncbBlobs[i]), obj.small);
+    ASSERT_EQ(~0ULL - ncbBlobs[i], obj.huge);
+    ASSERT_EQ(300UL, obj.values.size());
+    for (int j = 0; j < 300; j++)
+      ASSERT_EQ((j % 4) << (j % 29), obj.values[j]);
+  }
+}
+
+TEST_F(ArchiveLeapSerialTest, BorrowedRecords) {
+  leap::MemoryStream ms;
+  for (int64_t i = 0; i < 3; i++) {
+    ReadAheadWriter obj;
+    obj.small = i;
+    obj.blob.assign(static_cast<size_t>(i * 3000), 'x');
+    obj.huge = ~0ULL - i;
+    obj.values.assign(100, static_cast<int>(i));
+    leap::Serialize(ms, obj);
+  }
+
+  // Records are parsed straight out of the memory stream, which must only give up one object at a time
+  for (int64_t i = 0; i < 3; i++) {
+    std::streamsize ncbBefore = ms.Length();
+    ReadAheadReader obj;
+    uint64_t ncbRead;
+    {
+      leap::IArchiveLeapSerial iar(ms);
+      leap::DeserializeWithArchive(iar, obj);
+      ncbRead = iar.Count();
+    }
+    ASSERT_EQ(ncbBefore - static_cast<std::streamsize>(ncbRead), ms.Length()) << "Archive consumed bytes it did not use";
+    ASSERT_EQ(i, obj.small);
+    ASSERT_EQ(~0ULL - i, obj.huge);
+    ASSERT_EQ(std::vector<int>(100, static_cast<int>(i)), obj.values);
+  }
+  ASSERT_EQ(0, ms.Length());
+}
+
+namespace {
+  // Forwards to a patchable stream, but never lends out space, so that everything written to it is copied
+  class CopyOnlyOutputStream :
+    public leap::ForwardingOutputStream
+  {
+  public:
+    using leap::ForwardingOutputStream::ForwardingOutputStream;
+    std::streamsize Reserve(void** ppBuf, std::streamsize ncbMin) override { return IOutputStream::Reserve(ppBuf, ncbMin); }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, ReservedWindowMatchesCopiedOutput) {
+  ReadAheadWriter obj;
+  obj.small = -1;
+  obj.blob.assign(300, 'y');
+  obj.huge = ~0ULL;
+  for (int i = 0; i < 1000; i++)
+    obj.values.push_back(i * i * (i % 2 ? -1 : 1));
+
+  for (bool backpatch : { false, true }) {
+    leap::MemoryStream reserved, copied;
+    CopyOnlyOutputStream copyOnly{ copied };
+    for (leap::IOutputStream* os : { static_cast<leap::IOutputStream*>(&reserved), static_cast<leap::IOutputStream*>(&copyOnly) }) {
+      leap::OArchiveLeapSerial oarch(*os);
+      oarch.Backpatch = backpatch;
+      oarch.BufferSize = 64;
+      leap::SerializeWithArchive(oarch, obj);
+      leap::SerializeWithArchive(oarch, obj);
+    }
+
+    ASSERT_EQ(copied.Length(), reserved.Length());
+    ASSERT_TRUE(
+      std::equal(copied.GetData().begin(), copied.GetData().begin() + copied.Length(), reserved.GetData().begin())
+    ) << "Output encoded in place differs from copied output";
+  }
+}
+
+namespace {
+  struct CountedNode {
+    CountedNode(void) { s_nLive++; }
+    ~CountedNode(void) { s_nLive--; }
+
+    static int s_nLive;
+
+    std::string label;
+    CountedNode* next = nullptr;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &CountedNode::label,
+        &CountedNode::next
+      };
+    }
+  };
+
+  int CountedNode::s_nLive = 0;
+}
+
+TEST_F(ArchiveLeapSerialTest, ArenaGraph) {
+  std::vector<GraphNode> storage(1000);
+  Graph graph;
+  for (size_t i = 0; i < storage.size(); i++) {
+    storage[i].value = static_cast<int>(i);
+    storage[i].next = &storage[(i + 1) % storage.size()];
+    if (i % 2)
+      storage[i].owned.reset(new int(static_cast<int>(i) * 3));
+    graph.nodes.push_back(&storage[i]);
+  }
+
+  std::stringstream ss;
+  leap::Serialize(ss, graph);
+
+  auto read = leap::DeserializeArena<Graph>(ss);
+  ASSERT_EQ(storage.size(), read->nodes.size());
+  size_t nAdjacent = 0;
+  for (size_t i = 0; i < storage.size(); i++) {
+    const GraphNode* pNode = read->nodes[i];
+    ASSERT_EQ(static_cast<int>(i), pNode->value);
+    ASSERT_EQ(read->nodes[(i + 1) % storage.size()], pNode->next) << "Cycle was not reconstructed";
+    if (i % 2)
+      ASSERT_EQ(static_cast<int>(i) * 3, *pNode->owned);
+    else
+      ASSERT_EQ(nullptr, pNode->owned);
+    if (i && pNode == read->nodes[i - 1] + 1)
+      nAdjacent++;
+  }
+
+  // Nodes are allocated in the order they are referenced, so nearly all of them should be neighbors
+  ASSERT_LE(storage.size() - 10, nAdjacent) << "Nodes were not packed into an arena";
+}
+
+TEST_F(ArchiveLeapSerialTest, ArenaRunsDestructors) {
+  {
+    CountedNode nodes[3];
+    for (size_t i = 0; i < 3; i++) {
+      nodes[i].label = std::string(100, static_cast<char>('a' + i));
+      nodes[i].next = &nodes[(i + 1) % 3];
+    }
+
+    std::stringstream ss;
+    leap::Serialize(ss, nodes[0]);
+    ASSERT_EQ(3, CountedNode::s_nLive);
+
+    auto read = leap::DeserializeArena<CountedNode>(ss);
+    ASSERT_EQ(std::string(100, 'c'), read->next->next->label);
+    ASSERT_EQ(read.get(), read->next->next->next);
+    ASSERT_EQ(6, CountedNode::s_nLive);
+  }
+  ASSERT_EQ(0, CountedNode::s_nLive) << "Objects in the arena were not destroyed along with it";
+}
+
+namespace {
+  // Copies like CopyOnlyOutputStream, and records the payloads that arrived by way of gather writes
+  class GatherRecordingOutputStream :
+    public CopyOnlyOutputStream
+  {
+  public:
+    using CopyOnlyOutputStream::CopyOnlyOutputStream;
+    using IOutputStream::Write;
+
+    std::vector<const void*> gathered;
+
+    bool Write(const leap::OutputSegment* pSegs, size_t nSegs) override {
+      for (size_t i = 0; i < nSegs; i++)
+        gathered.push_back(pSegs[i].pBuf);
+      return CopyOnlyOutputStream::Write(pSegs, nSegs);
+    }
+  };
+}
+
+TEST_F(ArchiveLeapSerialTest, LargePayloadsGathered) {
+  MySimpleStructure mss;
+  mss.myString.assign(10000, 'q');
+  mss.selfReference = &mss;
+  mss.x = nullptr;
+  mss.y = nullptr;
+
+  leap::MemoryStream ms;
+  GatherRecordingOutputStream os{ ms };
+  {
+    leap::OArchiveLeapSerial oarch(os);
+    oarch.BufferSize = 64;
+    leap::SerializeWithArchive(oarch, mss);
+  }
+  ASSERT_NE(
+    os.gathered.end(),
+    std::find(os.gathered.begin(), os.gathered.end(), mss.myString.data())
+  ) << "Large string was not written straight from the object along with its header";
+
+  leap::MemoryStream expected;
+  leap::Serialize(expected, mss);
+  ASSERT_EQ(expected.Length(), ms.Length());
+  ASSERT_TRUE(std::equal(expected.GetData().begin(), expected.GetData().begin() + expected.Length(), ms.GetData().begin()));
+}
@@ -73,3 +73,36 @@ TEST(ArchiveProtobufTest, ProtobufToLeapSerial) {
   leap::Deserialize<leap::IArchiveProtobuf>(leap::InputStreamAdapter(ss), person);
   ASSERT_EQ(person, defaultPerson);
 }
+
+namespace {
+  struct PackedIntegers {
+    std::vector<int32_t> values;
+    int32_t trailer;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &PackedIntegers::values },
+        { 2, &PackedIntegers::trailer }
+      };
+    }
+  };
+}
+
+TEST(ArchiveProtobufTest, PackedRepeatedField) {
+  // Field 1 is a packed repeated int32 holding { 1, 300, -1 }, field 2 is a plain int32
+  std::string buf;
+  buf += '\x0A';
+  buf += '\x0D';
+  buf += '\x01';
+  buf += "\xAC\x02";
+  buf += std::string(9, '\xFF');
+  buf += '\x01';
+  buf += '\x10';
+  buf += '\x07';
+  std::stringstream ss(buf);
+
+  PackedIntegers obj;
+  leap::Deserialize<leap::IArchiveProtobuf>(leap::InputStreamAdapter(ss), obj);
+  ASSERT_EQ((std::vector<int32_t>{ 1, 300, -1 }), obj.values);
+  ASSERT_EQ(7, obj.trailer);
+}
@@ -0,0 +1,188 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "TestObject.h"
+#include <LeapSerial/AsyncStream.h>
+#include <LeapSerial/ForwardingStream.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <LeapSerial/RecordStream.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <stdexcept>
+
+using Test::Native::Sample;
+using Test::Native::MakeSample;
+using Test::Native::IsSample;
+
+namespace {
+  void WriteObjects(leap::IOutputStream& os, int n) {
+    leap::RecordWriter<Sample> writer{ os };
+    for (int i = 0; i < n; i++)
+      writer.Write(MakeSample(i));
+  }
+
+  bool SameContents(leap::MemoryStream& lhs, leap::MemoryStream& rhs) {
+    return
+      lhs.Length() == rhs.Length() &&
+      std::equal(lhs.GetData().begin(), lhs.GetData().begin() + lhs.Length(), rhs.GetData().begin());
+  }
+
+  // Accepts only a limited number of bytes, and fails every write after that
+  class LimitedOutputStream :
+    public leap::ForwardingOutputStream
+  {
+  public:
+    LimitedOutputStream(leap::IOutputStream& os, std::streamsize ncbLimit) :
+      ForwardingOutputStream(os),
+      ncbLimit(ncbLimit)
+    {}
+
+    std::streamsize ncbLimit;
+
+    bool Write(const void* pBuf, std::streamsize ncb) override {
+      if (ncbLimit < ncb)
+        return false;
+      ncbLimit -= ncb;
+      return ForwardingOutputStream::Write(pBuf, ncb);
+    }
+  };
+
+  // Throws once a limited number of bytes have been read
+  class FailingInputStream :
+    public leap::ForwardingInputStream
+  {
+  public:
+    FailingInputStream(leap::IInputStream& is, std::streamsize ncbLimit) :
+      ForwardingInputStream(is),
+      ncbLimit(ncbLimit)
+    {}
+
+    std::streamsize ncbLimit;
+
+    std::streamsize Read(void* pBuf, std::streamsize ncb) override {
+      if (!ncbLimit)
+        throw std::runtime_error("Simulated read failure");
+      ncb = ForwardingInputStream::Read(pBuf, std::min(ncb, ncbLimit));
+      ncbLimit -= ncb;
+      return ncb;
+    }
+  };
+
+  // Reports a failure by returning -1, as a stream that does not throw would
+  class ErrorInputStream :
+    public leap::ForwardingInputStream
+  {
+  public:
+    ErrorInputStream(leap::IInputStream& is, std::streamsize ncbLimit) :
+      ForwardingInputStream(is),
+      ncbLimit(ncbLimit)
+    {}
+
+    std::streamsize ncbLimit;
+
+    std::streamsize Read(void* pBuf, std::streamsize ncb) override {
+      if (!ncbLimit)
+        return -1;
+      ncb = ForwardingInputStream::Read(pBuf, std::min(ncb, ncbLimit));
+      ncbLimit -= ncb;
+      return ncb;
+    }
+  };
+}
+
+TEST(AsyncStreamTest, AsyncOutputMatchesDirectOutput) {
+  leap::MemoryStream direct, async;
+  WriteObjects(direct, 5000);
+  {
+    // Small buffers, so that the caller has to wait on the background thread now and then
+    leap::AsyncOutputStream aos{ leap::make_unique<leap::ForwardingOutputStream>(async), 256, 3 };
+    WriteObjects(aos, 2500);
+    aos.Flush();
+    ASSERT_LT(0, async.Length()) << "Flush did not wait for buffered bytes to be written";
+    leap::RecordWriter<Sample> writer{ aos };
+    for (int i = 2500; i < 5000; i++)
+      writer.Write(MakeSample(i));
+  }
+  ASSERT_TRUE(SameContents(direct, async)) << "Output written in the background differs";
+}
+
+TEST(AsyncStreamTest, ArchiveEncodesIntoBuffers) {
+  Sample obj = MakeSample(16);
+  obj.name.assign(1000, 'n');
+
+  leap::MemoryStream direct, async;
+  leap::Serialize(direct, obj);
+  {
+    leap::AsyncOutputStream aos{ leap::make_unique<leap::ForwardingOutputStream>(async), 4096 };
+    void* pBuf;
+    ASSERT_LT(0, aos.Reserve(&pBuf, 16)) << "Stream should lend out its buffers";
+    aos.Commit(0);
+    leap::Serialize(aos, obj);
+  }
+  ASSERT_TRUE(SameContents(direct, async));
+}
+
+TEST(AsyncStreamTest, WriteFailureReported) {
+  leap::MemoryStream ms;
+  leap::AsyncOutputStream aos{ leap::make_unique<LimitedOutputStream>(ms, 100), 64 };
+
+  char buf[64] = {};
+  ASSERT_TRUE(aos.Write(buf, sizeof(buf)));
+  ASSERT_TRUE(aos.Write(buf, sizeof(buf)));
+  aos.Flush();
+
+  // The second block could not be written, which is reported the next time around
+  ASSERT_FALSE(aos.Write(buf, sizeof(buf)));
+  ASSERT_EQ(64, ms.Length()) << "Nothing should have been written after the failed block";
+}
+
+TEST(AsyncStreamTest, Prefetch) {
+  leap::MemoryStream ms;
+  WriteObjects(ms, 5000);
+  const std::streamsize ncb = ms.Length();
+
+  leap::PrefetchInputStream pis{ leap::make_unique<leap::ForwardingInputStream>(ms), 1000, 3 };
+  ASSERT_EQ(ncb, pis.Length());
+
+  leap::RecordReader<Sample> reader{ pis };
+  int i = 0;
+  for (const Sample& obj : reader) {
+    ASSERT_TRUE(IsSample(i, obj));
+    i++;
+  }
+  ASSERT_EQ(5000, i);
+  ASSERT_EQ(0, pis.Length());
+}
+
+TEST(AsyncStreamTest, PrefetchErrorReportedInOrder) {
+  leap::MemoryStream ms;
+  std::vector<uint8_t> data(10000, 0x5A);
+  ms.Write(data.data(), data.size());
+
+  leap::PrefetchInputStream pis{ leap::make_unique<FailingInputStream>(ms, 2500), 1000 };
+  std::vector<uint8_t> buf(2500);
+  ASSERT_EQ(2500, pis.Read(buf.data(), buf.size())) << "Bytes read ahead of the failure were not delivered";
+  ASSERT_THROW(pis.Read(buf.data(), 1), std::runtime_error);
+  ASSERT_EQ(0, pis.Read(buf.data(), 1));
+  ASSERT_TRUE(pis.IsEof());
+}
+
+TEST(AsyncStreamTest, PrefetchErrorReturnIsNotEof) {
+  leap::MemoryStream ms;
+  std::vector<uint8_t> data(10000, 0x5A);
+  ms.Write(data.data(), data.size());
+
+  leap::PrefetchInputStream pis{ leap::make_unique<ErrorInputStream>(ms, 2500), 1000 };
+  std::vector<uint8_t> buf(2500);
+  ASSERT_EQ(2500, pis.Read(buf.data(), buf.size()));
+  ASSERT_THROW(pis.Read(buf.data(), 1), std::runtime_error) << "A failed read was taken for the end of the stream";
+}
+
+TEST(AsyncStreamTest, EarlyDestruction) {
+  leap::MemoryStream ms;
+  WriteObjects(ms, 5000);
+
+  leap::PrefetchInputStream pis{ leap::make_unique<leap::ForwardingInputStream>(ms), 100 };
+  uint8_t b;
+  ASSERT_EQ(1, pis.Read(&b, 1));
+}
@@ -1,6 +1,7 @@
 // Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include <LeapSerial/BoundedStream.h>
+#include <LeapSerial/BufferedInputStream.h>
 #include <LeapSerial/LeapSerial.h>
 #include <gtest/gtest.h>
 
@@ -19,3 +20,21 @@ TEST_F(BoundedStreamTest, NoReadPastLimit) {
   ASSERT_EQ(3, bos.Read(buf, sizeof(buf))) << "Read more characters than should have been possible from the bounded input stream";
   ASSERT_TRUE(bos.IsEof()) << "Should have been at EOF after reading to the character limit";
 }
+
+TEST_F(BoundedStreamTest, NoBorrowPastLimit) {
+  static const char sc_oneTwo[] = "one two";
+  leap::BoundedInputStream bos {
+    leap::make_unique<leap::BufferedInputStream>(sc_oneTwo, sizeof(sc_oneTwo) - 1),
+    5
+  };
+
+  const void* pBuf;
+  ASSERT_EQ(5, bos.GetContiguous(&pBuf)) << "Lent out more bytes than the bounded input stream allows";
+  ASSERT_EQ(sc_oneTwo, pBuf) << "Underlying buffer was not lent out directly";
+  bos.Consume(4);
+
+  char buf[10];
+  ASSERT_EQ(1, bos.Read(buf, sizeof(buf)));
+  ASSERT_EQ('t', buf[0]);
+  ASSERT_EQ(0, bos.GetContiguous(&pBuf));
+}
@@ -72,6 +72,49 @@ TYPED_TEST(CompressionStreamTest, KnownValueRoundTrip) {
   ASSERT_EQ(vec, read) << "Reconstructed vector was not read back intact";
 }
 
+TYPED_TEST(CompressionStreamTest, BorrowAndSkip) {
+  std::vector<uint8_t> vec(0x10000);
+  for (size_t i = 0; i < vec.size(); i++)
+    vec[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+
+  std::stringstream ss;
+  {
+    leap::CompressionStream<TypeParam> cs(
+      leap::make_unique<leap::OutputStreamAdapter>(ss)
+    );
+    cs.Write(vec.data(), vec.size());
+  }
+
+  leap::DecompressionStream<TypeParam> ds{
+    leap::make_unique<leap::InputStreamAdapter>(ss)
+  };
+
+  // Mix borrowed, skipped, and copied bytes, and check that they all line up
+  std::vector<uint8_t> read;
+  while (read.size() < vec.size()) {
+    const void* pBuf;
+    std::streamsize ncb = ds.GetContiguous(&pBuf);
+    ASSERT_LT(0, ncb) << "Decompression stream ran dry early";
+    ncb = std::min<std::streamsize>(ncb, vec.size() - read.size());
+    read.insert(read.end(), static_cast<const uint8_t*>(pBuf), static_cast<const uint8_t*>(pBuf) + ncb);
+    ds.Consume(ncb);
+
+    std::streamsize ncbSkip = std::min<std::streamsize>(100, vec.size() - read.size());
+    ASSERT_EQ(ncbSkip, ds.Skip(ncbSkip));
+    read.insert(read.end(), vec.begin() + read.size(), vec.begin() + read.size() + ncbSkip);
+
+    uint8_t b;
+    if (read.size() < vec.size()) {
+      ASSERT_EQ(1, ds.Read(&b, 1));
+      read.push_back(b);
+    }
+  }
+  ASSERT_EQ(vec, read) << "Borrowed bytes did not match what was written";
+
+  const void* pBuf;
+  ASSERT_EQ(0, ds.GetContiguous(&pBuf));
+}
+
 TYPED_TEST(CompressionStreamTest, CompressionPropCheck) {
   auto val = MakeSimpleStruct(4);
 
@@ -0,0 +1,171 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <LeapSerial/fields.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <gtest/gtest.h>
+#include <map>
+#include <sstream>
+
+namespace {
+  struct Child {
+    std::vector<int> values;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, "values", &Child::values }
+      };
+    }
+  };
+
+  struct Record {
+    int id = 0;
+    std::string name;
+    std::vector<double> samples;
+    std::map<std::string, int> lookup;
+    std::shared_ptr<Child> first;
+    std::shared_ptr<Child> second;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, "id", &Record::id },
+        { 2, "name", &Record::name },
+        { 3, "samples", &Record::samples },
+        { 4, "lookup", &Record::lookup },
+        { 5, "first", &Record::first },
+        { 6, "second", &Record::second }
+      };
+    }
+  };
+
+  struct Link {
+    int value = 0;
+    std::shared_ptr<Link> next;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, "value", &Link::value },
+        { 2, "next", &Link::next }
+      };
+    }
+  };
+
+  struct Links {
+    std::shared_ptr<Link> a;
+    std::shared_ptr<Link> b;
+    std::shared_ptr<Link> c;
+    int k = 0;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, "a", &Links::a },
+        { 2, "b", &Links::b },
+        { 3, "c", &Links::c },
+        { 4, "k", &Links::k }
+      };
+    }
+  };
+
+  Record MakeRecord(int id) {
+    Record retVal;
+    retVal.id = id;
+    retVal.name = "record " + std::to_string(id);
+    retVal.samples.assign(1000, id * 0.5);
+    retVal.lookup["a"] = id;
+    retVal.first = std::make_shared<Child>();
+    retVal.first->values = { id, 1 };
+    retVal.second = std::make_shared<Child>();
+    retVal.second->values = { id, 2 };
+    return retVal;
+  }
+}
+
+TEST(FieldsTest, SelectedFieldsOnly) {
+  std::stringstream ss;
+  for (int i = 1; i <= 3; i++)
+    leap::Serialize(ss, MakeRecord(i));
+
+  leap::fields summary{ "id", "name" };
+  for (int i = 1; i <= 3; i++) {
+    auto read = leap::Deserialize<Record>(ss, summary);
+    ASSERT_EQ(i, read->id);
+    ASSERT_EQ("record " + std::to_string(i), read->name);
+    ASSERT_TRUE(read->samples.empty()) << "Field that was not selected was read";
+    ASSERT_TRUE(read->lookup.empty()) << "Field that was not selected was read";
+    ASSERT_EQ(nullptr, read->first.get());
+    ASSERT_EQ(nullptr, read->second.get());
+  }
+  ASSERT_EQ(std::char_traits<char>::eof(), ss.peek()) << "Records of objects that were not selected were left in the stream";
+}
+
+TEST(FieldsTest, PassOverUnselectedReferences) {
+  std::stringstream ss;
+  leap::Serialize(ss, MakeRecord(1));
+  leap::Serialize(ss, MakeRecord(2));
+
+  // The record of the first child comes before the record of the second
+  Record read;
+  leap::Deserialize(ss, read, leap::fields{ 6 });
+  ASSERT_EQ(0, read.id);
+  ASSERT_EQ(nullptr, read.first.get());
+  ASSERT_EQ(std::vector<int>({ 1, 2 }), read.second->values);
+
+  auto full = leap::Deserialize<Record>(ss);
+  ASSERT_EQ(2, full->id);
+  ASSERT_EQ(std::vector<int>({ 2, 1 }), full->first->values);
+}
+
+TEST(FieldsTest, UnknownField) {
+  std::stringstream ss;
+  leap::Serialize(ss, MakeRecord(1));
+  ASSERT_THROW(leap::Deserialize<Record>(ss, leap::fields{ "id", "nothing" }), std::invalid_argument);
+  ASSERT_THROW(leap::Deserialize<Record>(ss, leap::fields{ 7 }), std::invalid_argument);
+}
+
+TEST(FieldsTest, SharedBehindSkippedField) {
+  // The object behind a and c is numbered first, so it is asked for after the object behind b
+  Links links;
+  links.a = std::make_shared<Link>();
+  links.a->value = 1;
+  links.b = std::make_shared<Link>();
+  links.b->value = 2;
+  links.c = links.a;
+  links.k = 4;
+
+  std::stringstream ss;
+  leap::Serialize(ss, links);
+  leap::Serialize(ss, links);
+
+  auto read = leap::Deserialize<Links>(ss, leap::fields{ 2, 3, 4 });
+  ASSERT_EQ(nullptr, read->a.get());
+  ASSERT_EQ(2, read->b->value);
+  ASSERT_EQ(1, read->c->value);
+  ASSERT_EQ(4, read->k);
+
+  auto full = leap::Deserialize<Links>(ss);
+  ASSERT_EQ(full->a, full->c);
+  ASSERT_EQ(2, full->b->value);
+}
+
+TEST(FieldsTest, ReferenceBackToPassedRecord) {
+  // Only b is read, and the record of a is passed over before b is found to refer to it
+  Links links;
+  links.a = std::make_shared<Link>();
+  links.a->value = 1;
+  links.b = std::make_shared<Link>();
+  links.b->value = 2;
+  links.b->next = links.a;
+
+  std::stringstream ss;
+  leap::Serialize(ss, links);
+  leap::Serialize(ss, links);
+
+  auto read = leap::Deserialize<Links>(ss, leap::fields{ "b" });
+  ASSERT_EQ(nullptr, read->a.get());
+  ASSERT_EQ(2, read->b->value);
+  ASSERT_EQ(1, read->b->next->value);
+
+  auto full = leap::Deserialize<Links>(ss);
+  ASSERT_EQ(full->a, full->b->next);
+  ASSERT_EQ(std::char_traits<char>::eof(), ss.peek());
+}
@@ -0,0 +1,243 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "TestObject.h"
+#include <LeapSerial/FileStream.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/RecordStream.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Test::Native::Sample;
+using Test::Native::MakeSample;
+using Test::Native::IsSample;
+
+namespace {
+  // Records the payloads that arrive by way of gather writes
+  class GatherRecordingOutputStream :
+    public leap::FileOutputStream
+  {
+  public:
+    using leap::FileOutputStream::FileOutputStream;
+    using leap::FileOutputStream::Write;
+
+    std::vector<const void*> gathered;
+
+    bool Write(const leap::OutputSegment* pSegs, size_t nSegs) override {
+      for (size_t i = 0; i < nSegs; i++)
+        gathered.push_back(pSegs[i].pBuf);
+      return leap::FileOutputStream::Write(pSegs, nSegs);
+    }
+  };
+}
+
+class FileStreamTest:
+  public testing::TestWithParam<bool>
+{
+public:
+  void SetUp(void) override {
+    // Not in /tmp, which may be a file system that does not support unbuffered I/O
+    char tmpl[] = "FileStreamTestXXXXXX";
+    int fd = mkstemp(tmpl);
+    ASSERT_LE(0, fd);
+    close(fd);
+    path = tmpl;
+
+    // A small buffer makes sure that records straddle buffer boundaries
+    options.ncbBuffer = 8192;
+    options.direct = GetParam();
+  }
+
+  void TearDown(void) override {
+    unlink(path.c_str());
+  }
+
+  std::string path;
+  leap::FileStreamOptions options;
+
+  off_t FileSize(void) {
+    struct stat st;
+    stat(path.c_str(), &st);
+    return st.st_size;
+  }
+};
+
+TEST_P(FileStreamTest, RoundTrip) {
+  std::vector<std::streamoff> offsets;
+  {
+    leap::FileOutputStream fos{ path.c_str(), false, options };
+    leap::RecordWriter<Sample> writer{ fos };
+    for (int i = 0; i < 2000; i++) {
+      offsets.push_back(fos.WriteOffset());
+      writer.Write(MakeSample(i));
+    }
+    offsets.push_back(fos.WriteOffset());
+  }
+  ASSERT_EQ(offsets.back(), FileSize()) << "File was not trimmed to the bytes written";
+
+  leap::FileInputStream fis{ path.c_str(), options };
+  ASSERT_EQ(offsets.back(), fis.Length());
+
+  leap::RecordReader<Sample> reader{ fis };
+  int i = 0;
+  for (const Sample& obj : reader) {
+    ASSERT_TRUE(IsSample(i, obj));
+    i++;
+  }
+  ASSERT_EQ(2000, i);
+
+  // Random access, both within the current buffer and outside of it
+  for (int n : { 1999, 3, 1000, 1001, 0 }) {
+    reader.Seek(offsets[n]);
+    ASSERT_EQ(offsets[n], fis.Tell());
+    ASSERT_EQ(n, reader.Read()->id);
+  }
+}
+
+TEST_P(FileStreamTest, LargeTransfers) {
+  std::vector<uint8_t> data(100000);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<uint8_t>(i * 7);
+  {
+    leap::FileOutputStream fos{ path.c_str(), false, options };
+    ASSERT_TRUE(fos.Write(data.data(), 3));
+    ASSERT_TRUE(fos.Write(data.data() + 3, data.size() - 3));
+  }
+
+  leap::FileInputStream fis{ path.c_str(), options };
+  std::vector<uint8_t> read(data.size() + 10);
+  ASSERT_EQ(5, fis.Read(read.data(), 5));
+  ASSERT_EQ(static_cast<std::streamsize>(data.size() - 5), fis.Read(read.data() + 5, read.size() - 5));
+  ASSERT_TRUE(fis.IsEof());
+  read.resize(data.size());
+  ASSERT_EQ(data, read);
+}
+
+TEST_P(FileStreamTest, FlushAndAppend) {
+  {
+    leap::FileOutputStream fos{ path.c_str(), false, options };
+    leap::Serialize(fos, MakeSample(1));
+    fos.Flush();
+    ASSERT_EQ(fos.WriteOffset(), FileSize()) << "Flushed file should hold exactly the bytes written";
+    leap::Serialize(fos, MakeSample(2));
+  }
+  {
+    leap::FileOutputStream fos{ path.c_str(), true, options };
+    ASSERT_EQ(FileSize(), fos.WriteOffset());
+    leap::Serialize(fos, MakeSample(3));
+  }
+
+  leap::FileInputStream fis{ path.c_str(), options };
+  for (int i = 1; i <= 3; i++)
+    ASSERT_EQ(i, leap::Deserialize<Sample>(fis)->id);
+  ASSERT_EQ(0, fis.Length());
+}
+
+TEST_P(FileStreamTest, Preallocate) {
+  options.ncbPreallocate = 1024 * 1024;
+  {
+    leap::FileOutputStream fos{ path.c_str(), false, options };
+    ASSERT_TRUE(fos.Write("abc", 3));
+  }
+  ASSERT_EQ(3, FileSize()) << "Preallocated space was not given back";
+}
+
+TEST_P(FileStreamTest, GatherWrite) {
+  std::vector<uint8_t> payload(20000);
+  for (size_t i = 0; i < payload.size(); i++)
+    payload[i] = static_cast<uint8_t>(i * 13);
+  {
+    leap::FileOutputStream fos{ path.c_str(), false, options };
+    ASSERT_TRUE(fos.Write("head", 4));
+
+    // Larger than the buffer, so it goes to the file together with what is already buffered
+    const leap::OutputSegment segs[] = {
+      { "size", 4 },
+      { payload.data(), static_cast<std::streamsize>(payload.size()) },
+      { "tail", 4 }
+    };
+    ASSERT_TRUE(fos.Write(segs, 3));
+    ASSERT_EQ(static_cast<std::streamoff>(12 + payload.size()), fos.WriteOffset());
+
+    // Small enough to be buffered
+    const leap::OutputSegment small[] = { { "ab", 2 }, { "cd", 2 } };
+    ASSERT_TRUE(fos.Write(small, 2));
+  }
+
+  leap::FileInputStream fis{ path.c_str(), options };
+  std::vector<uint8_t> read(static_cast<size_t>(fis.Length()));
+  ASSERT_EQ(16 + payload.size(), read.size());
+  ASSERT_EQ(static_cast<std::streamsize>(read.size()), fis.Read(read.data(), read.size()));
+  ASSERT_EQ("headsize", std::string(read.begin(), read.begin() + 8));
+  ASSERT_TRUE(std::equal(payload.begin(), payload.end(), read.begin() + 8));
+  ASSERT_EQ("tailabcd", std::string(read.end() - 8, read.end()));
+}
+
+TEST_P(FileStreamTest, ArchiveGathersLargePayloads) {
+  Sample sample = MakeSample(1);
+  sample.name.assign(20000, 'q');
+  {
+    // The archive stages its writes in space lent to it by the file stream
+    GatherRecordingOutputStream fos{ path.c_str(), false, options };
+    leap::OArchiveLeapSerial oarch(fos);
+    leap::SerializeWithArchive(oarch, sample);
+    ASSERT_NE(
+      fos.gathered.end(),
+      std::find(fos.gathered.begin(), fos.gathered.end(), sample.name.data())
+    ) << "Large string was not written straight from the object along with its header";
+  }
+
+  leap::FileInputStream fis{ path.c_str(), options };
+  auto read = leap::Deserialize<Sample>(fis);
+  ASSERT_EQ(sample.id, read->id);
+  ASSERT_EQ(sample.name, read->name);
+  ASSERT_EQ(sample.values, read->values);
+  ASSERT_EQ(0, fis.Length());
+}
+
+INSTANTIATE_TEST_CASE_P(Buffering, FileStreamTest, testing::Values(false, true));
+
+TEST(FileStreamBasicTest, Patch) {
+  char tmpl[] = "FileStreamTestXXXXXX";
+  int fd = mkstemp(tmpl);
+  ASSERT_LE(0, fd);
+  close(fd);
+
+  leap::FileStreamOptions options;
+  options.ncbBuffer = 4096;
+  {
+    leap::FileOutputStream fos{ tmpl, false, options };
+    ASSERT_TRUE(fos.CanPatch());
+    std::vector<char> filler(10000, 'x');
+    ASSERT_TRUE(fos.Write(filler.data(), filler.size()));
+    ASSERT_TRUE(fos.Write("tail", 4));
+
+    // Spans bytes that were written out and bytes that are still buffered
+    ASSERT_TRUE(fos.Patch(9998, "ABCD", 4));
+    ASSERT_FALSE(fos.Patch(10002, "ABCD", 4));
+  }
+
+  leap::FileInputStream fis{ tmpl };
+  ASSERT_EQ(9998, fis.Skip(9998));
+  char buf[6];
+  ASSERT_EQ(6, fis.Read(buf, sizeof(buf)));
+  ASSERT_EQ("ABCDil", std::string(buf, sizeof(buf)));
+  unlink(tmpl);
+}
+
+TEST(FileStreamBasicTest, ReadErrorIsReturned) {
+  // A directory can be opened, but not read
+  leap::FileInputStream fis{ "." };
+  const void* pBuf;
+  ASSERT_EQ(0, fis.GetContiguous(&pBuf));
+
+  char buf[16];
+  ASSERT_EQ(-1, fis.Read(buf, sizeof(buf)));
+  ASSERT_NE(0, fis.GetError());
+  ASSERT_EQ(-1, fis.Skip(1)) << "A failed stream went on reading";
+
+  fis.Clear();
+  ASSERT_EQ(0, fis.GetError());
+}
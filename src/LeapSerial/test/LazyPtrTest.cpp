@@ -0,0 +1,152 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <LeapSerial/BufferedInputStream.h>
+#include <LeapSerial/lazy_ptr.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace {
+  struct Payload {
+    std::vector<int> samples;
+    std::shared_ptr<Payload> next;
+    leap::lazy_ptr<Payload> deferred;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &Payload::samples },
+        { 2, &Payload::next },
+        { 3, &Payload::deferred }
+      };
+    }
+  };
+
+  struct Recording {
+    int version = 0;
+    leap::lazy_ptr<Payload> body;
+    std::shared_ptr<Payload> header;
+    leap::lazy_ptr<Payload> alias;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &Recording::version },
+        { 2, &Recording::body },
+        { 3, &Recording::header },
+        { 4, &Recording::alias }
+      };
+    }
+  };
+
+  // Same layout as Recording, but with ordinary shared pointers
+  struct EagerRecording {
+    int version = 0;
+    std::shared_ptr<Payload> body;
+    std::shared_ptr<Payload> header;
+    std::shared_ptr<Payload> alias;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &EagerRecording::version },
+        { 2, &EagerRecording::body },
+        { 3, &EagerRecording::header },
+        { 4, &EagerRecording::alias }
+      };
+    }
+  };
+
+  Recording MakeRecording(int version) {
+    Recording retVal;
+    retVal.version = version;
+
+    auto body = std::make_shared<Payload>();
+    for (int i = 0; i < 1000; i++)
+      body->samples.push_back(i * version);
+    body->next = std::make_shared<Payload>();
+    body->next->samples = { 7 };
+    body->deferred = std::make_shared<Payload>();
+    body->deferred->samples = { 8 };
+    retVal.body = body;
+
+    retVal.header = std::make_shared<Payload>();
+    retVal.header->samples = { 1, 2, 3 };
+    retVal.alias = retVal.header;
+    return retVal;
+  }
+
+  // Two recordings, one after the other
+  std::vector<uint8_t> MakeRecordings(void) {
+    leap::MemoryStream ms;
+    leap::Serialize(ms, MakeRecording(1));
+    leap::Serialize(ms, MakeRecording(2));
+    return std::vector<uint8_t>(ms.GetData().begin(), ms.GetData().begin() + ms.Length());
+  }
+}
+
+TEST(LazyPtrTest, DefersUntilDereferenced) {
+  std::vector<uint8_t> buf = MakeRecordings();
+  leap::BufferedInputStream bis{ buf.data(), buf.size() };
+
+  auto first = leap::DeserializeLazy<Recording>(bis);
+  ASSERT_EQ(1, first->version);
+  ASSERT_FALSE(first->body.loaded()) << "Object behind a lazy_ptr was read before it was used";
+  ASSERT_TRUE(static_cast<bool>(first->body)) << "Deferred object should still be reported as present";
+  ASSERT_EQ(std::vector<int>({ 1, 2, 3 }), first->header->samples);
+  ASSERT_EQ(first->header.get(), first->alias.get()) << "Lazy reference to an object already read was not resolved to that object";
+
+  // The stream must have been left at the start of the second recording
+  auto second = leap::DeserializeLazy<Recording>(bis);
+  ASSERT_EQ(2, second->version);
+  const std::streampos end = bis.Tell();
+
+  ASSERT_EQ(1000UL, first->body->samples.size());
+  ASSERT_EQ(999, first->body->samples.back());
+  ASSERT_EQ(std::vector<int>({ 7 }), first->body->next->samples);
+  ASSERT_FALSE(first->body->deferred.loaded()) << "Lazy reference in a lazily loaded object was read eagerly";
+  ASSERT_EQ(std::vector<int>({ 8 }), first->body->deferred->samples);
+  ASSERT_EQ(1998, second->body->samples.back());
+  ASSERT_EQ(end, bis.Tell()) << "Loading a deferred object moved the stream";
+
+  // Copies of a lazy_ptr share the object once it has been loaded
+  leap::lazy_ptr<Payload> copy = second->body;
+  ASSERT_EQ(second->body.get(), copy.get());
+}
+
+TEST(LazyPtrTest, WireCompatibleWithSharedPtr) {
+  std::vector<uint8_t> buf = MakeRecordings();
+
+  leap::BufferedInputStream bis{ buf.data(), buf.size() };
+  auto eager = leap::Deserialize<EagerRecording>(bis);
+  ASSERT_EQ(1000UL, eager->body->samples.size());
+  ASSERT_EQ(std::vector<int>({ 8 }), eager->body->deferred->samples);
+  ASSERT_EQ(eager->header, eager->alias);
+
+  // Without lazy reading, everything is read right away
+  leap::BufferedInputStream bis2{ buf.data(), buf.size() };
+  auto read = leap::Deserialize<Recording>(bis2);
+  ASSERT_TRUE(read->body.loaded());
+  ASSERT_EQ(1000UL, read->body->samples.size());
+  ASSERT_EQ(read->header.get(), read->alias.get());
+}
+
+TEST(LazyPtrTest, EagerWhenNotSeekable) {
+  leap::MemoryStream ms;
+  leap::Serialize(ms, MakeRecording(3));
+
+  auto read = leap::DeserializeLazy<Recording>(ms);
+  ASSERT_TRUE(read->body.loaded()) << "Reading was deferred on a stream that cannot seek";
+  ASSERT_EQ(2997, read->body->samples.back());
+}
+
+TEST(LazyPtrTest, StandardStream) {
+  std::vector<uint8_t> buf = MakeRecordings();
+  std::stringstream ss(std::string(buf.begin(), buf.end()));
+
+  // The archive's own adapter is gone by the time the object is loaded
+  auto first = leap::DeserializeLazy<Recording>(ss);
+  auto second = leap::DeserializeLazy<Recording>(ss);
+  ASSERT_FALSE(first->body.loaded());
+  ASSERT_EQ(999, first->body->samples.back());
+  ASSERT_EQ(1998, second->body->samples.back());
+  ASSERT_EQ(std::char_traits<char>::eof(), ss.peek());
+}
@@ -0,0 +1,126 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "TestObject.h"
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MappedStream.h>
+#include <LeapSerial/RecordStream.h>
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <unistd.h>
+
+using Test::Native::Sample;
+using Test::Native::MakeSample;
+using Test::Native::IsSample;
+
+class MappedStreamTest:
+  public testing::Test
+{
+public:
+  void SetUp(void) override {
+    char tmpl[] = "/tmp/MappedStreamTestXXXXXX";
+    int fd = mkstemp(tmpl);
+    ASSERT_LE(0, fd);
+    close(fd);
+    path = tmpl;
+  }
+
+  void TearDown(void) override {
+    unlink(path.c_str());
+  }
+
+  std::string path;
+};
+
+TEST_F(MappedStreamTest, RoundTrip) {
+  {
+    // A tiny initial size forces the file to be extended and remapped many times
+    leap::MappedOutputStream mos{ path.c_str(), false, 16 };
+    leap::RecordWriter<Sample> writer{ mos };
+    for (int i = 0; i < 1000; i++)
+      writer.Write(MakeSample(i));
+  }
+
+  leap::MappedInputStream mis{ path.c_str() };
+  ASSERT_TRUE(mis.CanRetain());
+
+  const void* pBuf;
+  std::streamsize ncb = mis.GetContiguous(&pBuf);
+  ASSERT_EQ(mis.Length(), ncb) << "The whole file should have been lent out at once";
+
+  leap::RecordReader<Sample> reader{ mis };
+  int i = 0;
+  for (const Sample& obj : reader) {
+    ASSERT_TRUE(IsSample(i, obj));
+    i++;
+  }
+  ASSERT_EQ(1000, i);
+  ASSERT_EQ(0, mis.Length());
+}
+
+TEST_F(MappedStreamTest, TrimmedOnClose) {
+  {
+    leap::MappedOutputStream mos{ path.c_str() };
+    ASSERT_TRUE(mos.Write("abc", 3));
+  }
+  leap::MappedInputStream mis{ path.c_str() };
+  ASSERT_EQ(3, mis.Length()) << "Space mapped past the last byte written was not trimmed";
+}
+
+TEST_F(MappedStreamTest, Append) {
+  {
+    leap::MappedOutputStream mos{ path.c_str() };
+    leap::Serialize(mos, MakeSample(1));
+  }
+  {
+    leap::MappedOutputStream mos{ path.c_str(), true };
+    ASSERT_LT(0, mos.WriteOffset()) << "Appending stream should start at the end of the file";
+    leap::Serialize(mos, MakeSample(2));
+  }
+
+  leap::MappedInputStream mis{ path.c_str(), leap::AccessHint::Random };
+  ASSERT_EQ(1, leap::Deserialize<Sample>(mis)->id);
+  ASSERT_EQ(2, leap::Deserialize<Sample>(mis)->id);
+}
+
+TEST_F(MappedStreamTest, Seek) {
+  std::streamoff off;
+  {
+    leap::MappedOutputStream mos{ path.c_str() };
+    leap::Serialize(mos, MakeSample(1));
+    off = mos.WriteOffset();
+    leap::Serialize(mos, MakeSample(2));
+  }
+
+  leap::MappedInputStream mis{ path.c_str() };
+  mis.Seek(off);
+  ASSERT_EQ(off, mis.Tell());
+  ASSERT_EQ(2, leap::Deserialize<Sample>(mis)->id);
+}
+
+TEST_F(MappedStreamTest, EmptyFile) {
+  leap::MappedInputStream mis{ path.c_str() };
+  ASSERT_EQ(0, mis.Length());
+  uint8_t b;
+  ASSERT_EQ(0, mis.Read(&b, 1));
+}
+
+TEST_F(MappedStreamTest, MissingFile) {
+  ASSERT_THROW(leap::MappedInputStream{ (path + ".missing").c_str() }, std::system_error);
+}
+
+TEST_F(MappedStreamTest, GrowthFailureReturned) {
+  // No file system or address space can hold this much
+  const std::streamsize ncbHuge = std::streamsize(1) << 62;
+
+  leap::MappedOutputStream mos{ path.c_str() };
+  ASSERT_TRUE(mos.Write("abc", 3));
+
+  void* pBuf;
+  ASSERT_EQ(0, mos.Reserve(&pBuf, ncbHuge));
+  ASSERT_EQ(nullptr, pBuf);
+
+  // Only the size matters, nothing is read from the buffer when the mapping cannot grow
+  ASSERT_FALSE(mos.Write("abc", ncbHuge));
+  ASSERT_EQ(3, mos.WriteOffset());
+  ASSERT_TRUE(mos.Write("def", 3)) << "A failed write left the stream unusable";
+}
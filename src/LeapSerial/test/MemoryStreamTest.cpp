@@ -39,3 +39,38 @@ TEST_F(MemoryStreamTest, UnboundedCopy) {
   ASSERT_EQ(1024 * 100, ncbWritten);
   ASSERT_EQ(1024 * 100, msr.Length());
 }
+
+TEST_F(MemoryStreamTest, PatchInPlace) {
+  leap::MemoryStream ms;
+  ASSERT_TRUE(ms.CanPatch());
+
+  const char helloWorld[] = "Hello world!";
+  ASSERT_TRUE(ms.Write(helloWorld, sizeof(helloWorld)));
+  std::streamoff off = ms.WriteOffset();
+  ASSERT_TRUE(ms.Write(helloWorld, sizeof(helloWorld)));
+  ASSERT_TRUE(ms.Patch(off, "J", 1));
+  ASSERT_FALSE(ms.Patch(ms.WriteOffset(), "J", 1)) << "Patched a range that was never written";
+
+  char buf[sizeof(helloWorld)];
+  ASSERT_EQ(sizeof(helloWorld), ms.Skip(sizeof(helloWorld)));
+  ASSERT_EQ(sizeof(helloWorld), ms.Read(buf, sizeof(buf)));
+  ASSERT_STREQ("Jello world!", buf);
+}
+
+TEST_F(MemoryStreamTest, ReserveAndCommit) {
+  leap::MemoryStream ms;
+  const char helloWorld[] = "Hello world!";
+  ASSERT_TRUE(ms.Write(helloWorld, 6));
+
+  void* pBuf;
+  std::streamsize ncb = ms.Reserve(&pBuf, 100);
+  ASSERT_LE(100, ncb) << "Reservation was smaller than requested";
+  memcpy(pBuf, helloWorld + 6, sizeof(helloWorld) - 6);
+  ASSERT_EQ(6, ms.Length()) << "Reserved bytes became readable before they were committed";
+  ASSERT_TRUE(ms.Commit(sizeof(helloWorld) - 6));
+
+  char buf[sizeof(helloWorld)];
+  ASSERT_EQ(sizeof(helloWorld), ms.Read(buf, sizeof(buf)));
+  ASSERT_STREQ(helloWorld, buf);
+  ASSERT_EQ(0, ms.Length()) << "Unused part of the reservation was not backed up";
+}
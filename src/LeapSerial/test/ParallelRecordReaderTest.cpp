@@ -0,0 +1,75 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "TestObject.h"
+#include <LeapSerial/BufferedInputStream.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <LeapSerial/ParallelRecordReader.h>
+#include <gtest/gtest.h>
+
+using Test::Native::Sample;
+using Test::Native::MakeSample;
+using Test::Native::IsSample;
+
+namespace {
+  std::vector<uint8_t> MakeRecords(int n) {
+    leap::MemoryStream ms;
+    {
+      leap::RecordWriter<Sample> writer(ms);
+      for (int i = 0; i < n; i++)
+        writer.Write(MakeSample(i));
+    }
+
+    const void* pBuf;
+    std::streamsize ncb = ms.GetContiguous(&pBuf);
+    return{ static_cast<const uint8_t*>(pBuf), static_cast<const uint8_t*>(pBuf) + ncb };
+  }
+
+  void ExpectRecords(leap::ParallelRecordReader<Sample>& reader, int n) {
+    int i = 0;
+    for (const Sample& sample : reader) {
+      ASSERT_TRUE(IsSample(i, sample)) << "Records were not returned in order";
+      i++;
+    }
+    ASSERT_EQ(n, i);
+    ASSERT_EQ(nullptr, reader.Read()) << "Reader produced a record past the end of the stream";
+  }
+}
+
+TEST(ParallelRecordReaderTest, InPlace) {
+  auto records = MakeRecords(5000);
+  leap::BufferedInputStream bis{ records.data(), records.size() };
+  leap::ParallelRecordReader<Sample> reader{ bis, 4, 16 };
+  ExpectRecords(reader, 5000);
+}
+
+TEST(ParallelRecordReaderTest, Copied) {
+  auto records = MakeRecords(5000);
+  leap::MemoryStream ms;
+  ms.Write(records.data(), records.size());
+
+  leap::ParallelRecordReader<Sample> reader{ ms, 4, 16 };
+  ExpectRecords(reader, 5000);
+}
+
+TEST(ParallelRecordReaderTest, TruncatedFile) {
+  auto records = MakeRecords(100);
+  leap::MemoryStream ms;
+  ms.Write(records.data(), records.size() - 1);
+
+  leap::ParallelRecordReader<Sample> reader{ ms, 3, 7 };
+  int i = 0;
+  ASSERT_ANY_THROW({
+    while (auto sample = reader.Read())
+      ASSERT_EQ(i++, sample->id);
+  });
+  ASSERT_EQ(99, i) << "Records ahead of the truncated one should have been delivered";
+  ASSERT_EQ(nullptr, reader.Read());
+}
+
+TEST(ParallelRecordReaderTest, EarlyDestruction) {
+  auto records = MakeRecords(5000);
+  leap::BufferedInputStream bis{ records.data(), records.size() };
+  leap::ParallelRecordReader<Sample> reader{ bis, 4, 8 };
+  ASSERT_EQ(0, reader.Read()->id);
+}
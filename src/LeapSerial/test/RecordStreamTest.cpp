@@ -0,0 +1,134 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "TestObject.h"
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <LeapSerial/RecordStream.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+using Test::Native::Sample;
+using Test::Native::MakeSample;
+using Test::Native::IsSample;
+
+namespace {
+  struct SampleWithLink {
+    int id = 0;
+    std::shared_ptr<Sample> link;
+    std::string name;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &SampleWithLink::id },
+        { 4, &SampleWithLink::link },
+        { 2, &SampleWithLink::name }
+      };
+    }
+  };
+}
+
+TEST(RecordStreamTest, RoundTrip) {
+  leap::MemoryStream ms;
+  {
+    leap::RecordWriter<Sample> writer(ms);
+    for (int i = 0; i < 1000; i++)
+      writer.Write(MakeSample(i));
+  }
+
+  leap::RecordReader<Sample> reader(ms);
+  int i = 0;
+  for (const Sample& sample : reader) {
+    ASSERT_TRUE(IsSample(i, sample));
+    i++;
+  }
+  ASSERT_EQ(1000, i);
+  ASSERT_EQ(nullptr, reader.Read()) << "Reader produced a record past the end of the stream";
+}
+
+TEST(RecordStreamTest, Append) {
+  std::stringstream ss;
+  {
+    leap::OutputStreamAdapter osa{ ss };
+    leap::RecordWriter<Sample> writer(osa);
+    writer.Write(MakeSample(1));
+    writer.Write(MakeSample(2));
+  }
+  {
+    // A second writer picks up where the first one left off
+    leap::OutputStreamAdapter osa{ ss };
+    leap::RecordWriter<Sample> writer(osa);
+    writer.Write(MakeSample(3));
+  }
+
+  leap::InputStreamAdapter isa{ ss };
+  leap::RecordReader<Sample> reader(isa);
+  for (int i = 1; i <= 3; i++) {
+    Sample sample;
+    ASSERT_TRUE(reader.Read(sample));
+    ASSERT_EQ(i, sample.id);
+  }
+  Sample sample;
+  ASSERT_FALSE(reader.Read(sample));
+}
+
+TEST(RecordStreamTest, SkipsUnreadParts) {
+  leap::MemoryStream ms;
+  {
+    leap::RecordWriter<SampleWithLink> writer(ms);
+    for (int i = 0; i < 10; i++) {
+      SampleWithLink obj;
+      obj.id = i;
+      obj.link = std::make_shared<Sample>(MakeSample(i * 100));
+      obj.name = "linked";
+      writer.Write(obj);
+    }
+  }
+
+  // Sample has no link field, so the records of linked objects are left for the reader to skip
+  leap::RecordReader<Sample> reader(ms);
+  int i = 0;
+  for (auto it = reader.begin(); it != reader.end(); ++it, i++) {
+    ASSERT_EQ(i, it->id);
+    ASSERT_EQ("linked", it->name);
+  }
+  ASSERT_EQ(10, i);
+}
+
+TEST(RecordStreamTest, IndexedSeek) {
+  std::stringstream ss, idx;
+  {
+    leap::OutputStreamAdapter osa{ ss }, idxa{ idx };
+    leap::RecordWriter<Sample> writer(osa, idxa);
+    for (int i = 0; i < 500; i++)
+      writer.Write(MakeSample(i));
+  }
+  {
+    // Appending continues the index from where the record stream ends
+    uint64_t ncbExisting = ss.str().size();
+    leap::OutputStreamAdapter osa{ ss }, idxa{ idx };
+    leap::RecordWriter<Sample> writer(osa, idxa, ncbExisting);
+    for (int i = 500; i < 1000; i++)
+      writer.Write(MakeSample(i));
+  }
+
+  leap::InputStreamAdapter idxa{ idx };
+  leap::RecordIndex index{ idxa };
+  ASSERT_EQ(1000U, index.size());
+
+  leap::InputStreamAdapter isa{ ss };
+  leap::RecordReader<Sample> reader(isa);
+  for (int n : { 999, 0, 500, 499, 731 }) {
+    reader.Seek(index, n);
+    auto sample = reader.Read();
+    ASSERT_NE(nullptr, sample);
+    ASSERT_EQ(n, sample->id);
+    ASSERT_EQ(std::to_string(n), sample->name);
+  }
+
+  // Reading carries on sequentially after a seek
+  reader.Seek(index, 998);
+  ASSERT_EQ(998, reader.Read()->id);
+  ASSERT_EQ(999, reader.Read()->id);
+  ASSERT_EQ(nullptr, reader.Read());
+  ASSERT_THROW(index.Offset(1000), std::out_of_range);
+}
@@ -0,0 +1,111 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <LeapSerial/BufferedInputStream.h>
+#include <LeapSerial/LeapSerial.h>
+#include <LeapSerial/MemoryStream.h>
+#include <LeapSerial/string_ref.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace {
+  struct Labels {
+    leap::string_ref name;
+    leap::wstring_ref wideName;
+    leap::bytes_ref blob;
+    std::string plain;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &Labels::name,
+        &Labels::wideName,
+        { 1, &Labels::blob },
+        { 2, &Labels::plain }
+      };
+    }
+  };
+
+  // Same layout as Labels, but with every field owning its contents
+  struct OwnedLabels {
+    std::string name;
+    std::wstring wideName;
+    std::string blob;
+    std::string plain;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        &OwnedLabels::name,
+        &OwnedLabels::wideName,
+        { 1, &OwnedLabels::blob },
+        { 2, &OwnedLabels::plain }
+      };
+    }
+  };
+
+  static const uint8_t sc_blob[] = { 0, 1, 2, 0xFE, 0xFF };
+
+  std::vector<uint8_t> MakeLabels(void) {
+    OwnedLabels labels;
+    labels.name = "left hand";
+    labels.wideName = L"right hand";
+    labels.blob.assign(std::begin(sc_blob), std::end(sc_blob));
+    labels.plain = "plain";
+
+    leap::MemoryStream ms;
+    leap::Serialize(ms, labels);
+    return std::vector<uint8_t>(ms.GetData().begin(), ms.GetData().begin() + ms.Length());
+  }
+}
+
+static bool Within(const std::vector<uint8_t>& buf, const void* p) {
+  return buf.data() <= p && p < buf.data() + buf.size();
+}
+
+TEST(StringRefTest, BorrowsFromBuffer) {
+  const std::vector<uint8_t> buf = MakeLabels();
+
+  Labels labels;
+  leap::BufferedInputStream bis{ buf.data(), buf.size() };
+  leap::Deserialize(bis, labels);
+
+  ASSERT_EQ(std::string("left hand"), labels.name);
+  ASSERT_EQ(std::wstring(L"right hand"), labels.wideName);
+  ASSERT_EQ(leap::bytes_ref(sc_blob, sizeof(sc_blob)), labels.blob);
+  ASSERT_EQ("plain", labels.plain);
+
+  ASSERT_FALSE(labels.name.owned()) << "String was copied even though the buffer could be lent out";
+  ASSERT_TRUE(Within(buf, labels.name.data()));
+  ASSERT_TRUE(Within(buf, labels.wideName.data()));
+  ASSERT_TRUE(Within(buf, labels.blob.data()));
+}
+
+TEST(StringRefTest, CopiesFromOtherStreams) {
+  Labels labels;
+  {
+    const std::vector<uint8_t> buf = MakeLabels();
+    std::stringstream ss(std::string(buf.begin(), buf.end()));
+    leap::Deserialize(ss, labels);
+  }
+
+  ASSERT_TRUE(labels.name.owned()) << "String refers to memory that belongs to the stream";
+  ASSERT_TRUE(labels.blob.owned());
+  ASSERT_EQ(std::string("left hand"), labels.name);
+  ASSERT_EQ(std::wstring(L"right hand"), labels.wideName);
+  ASSERT_EQ(leap::bytes_ref(sc_blob, sizeof(sc_blob)), labels.blob);
+
+  // Copies of an owned reference own a copy of their own
+  Labels copy = labels;
+  labels.name = leap::string_ref{};
+  ASSERT_TRUE(copy.name.owned());
+  ASSERT_EQ(std::string("left hand"), copy.name);
+}
+
+TEST(StringRefTest, WireCompatible) {
+  const std::vector<uint8_t> buf = MakeLabels();
+  leap::BufferedInputStream bis{ buf.data(), buf.size() };
+  auto labels = leap::Deserialize<Labels>(bis);
+
+  // Written back out, references must be indistinguishable from the strings they were read from
+  leap::MemoryStream ms;
+  leap::Serialize(ms, *labels);
+  ASSERT_EQ(buf, std::vector<uint8_t>(ms.GetData().begin(), ms.GetData().begin() + ms.Length()));
+}
@@ -63,5 +63,45 @@ namespace Native {
     }
   };
 
+  /// <summary>
+  /// Record type used by the record and stream tests
+  /// </summary>
+  struct Sample {
+    int id = 0;
+    std::string name;
+    std::vector<int> values;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &Sample::id },
+        { 2, &Sample::name },
+        { 3, &Sample::values }
+      };
+    }
+  };
+
+  /// <summary>
+  /// Makes the sample with the specified identifier
+  /// </summary>
+  /// <remarks>
+  /// The other fields are derived from the identifier, see IsSample, so a reader can check a sample
+  /// knowing only its position in the stream.
+  /// </remarks>
+  inline Sample MakeSample(int id) {
+    Sample retVal;
+    retVal.id = id;
+    retVal.name = std::to_string(id);
+    retVal.values.assign(id % 7, id);
+    return retVal;
+  }
+
+  /// <returns>True if the sample is identical to MakeSample(id)</returns>
+  inline bool IsSample(int id, const Sample& sample) {
+    return
+      sample.id == id &&
+      sample.name == std::to_string(id) &&
+      sample.values == std::vector<int>(id % 7, id);
+  }
+
 }
 }
@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include "LeapSerialBench.h"
 #include "Encryption.h"
+#include "SmallFields.h"
 #include <iostream>
 #include <memory>
 #include <string.h>
@@ -17,7 +18,8 @@ struct BenchmarkEntry {
 };
 
 static BenchmarkEntry benchmarks[] = {
-  { "encryption", new Encryption }
+  { "encryption", new Encryption },
+  { "smallfields", new SmallFields }
 };
 
 static void PrintUsage(void) {
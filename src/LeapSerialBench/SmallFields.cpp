@@ -0,0 +1,109 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "SmallFields.h"
+#include "Utility.h"
+#include <LeapSerial/LeapSerial.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+  struct Vector3 {
+    float x;
+    float y;
+    float z;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &Vector3::x },
+        { 2, &Vector3::y },
+        { 3, &Vector3::z }
+      };
+    }
+  };
+
+  struct Hand {
+    int64_t id;
+    int32_t nFingers;
+    bool isLeft;
+    bool isValid;
+    float confidence;
+    Vector3 palm;
+    Vector3 direction;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &Hand::id },
+        { 2, &Hand::nFingers },
+        { 3, &Hand::isLeft },
+        { 4, &Hand::isValid },
+        { 5, &Hand::confidence },
+        { 6, &Hand::palm },
+        { 7, &Hand::direction }
+      };
+    }
+  };
+
+  struct TrackingFrame {
+    int64_t id;
+    std::vector<Hand> hands;
+
+    static leap::descriptor GetDescriptor(void) {
+      return{
+        { 1, &TrackingFrame::id },
+        { 2, &TrackingFrame::hands }
+      };
+    }
+  };
+}
+
+// Each hand has eleven primitive fields, plus the frame identifier
+const size_t SmallFields::sc_nFieldsPerFrame = SmallFields::sc_nHandsPerFrame * 11 + 1;
+
+SmallFields::SmallFields(void) {}
+
+nanoseconds SmallFields::Write(size_t bufferSize, bool reuse) {
+  TrackingFrame frame;
+  frame.id = 0;
+  const Hand hand{ 1, 5, true, true, 0.5f, { 1.0f, 2.0f, 3.0f }, { 0.0f, 1.0f, 0.0f } };
+  frame.hands.assign(sc_nHandsPerFrame, hand);
+  std::ostringstream ss;
+  leap::OutputStreamAdapter os(ss);
+
+  leap::OArchiveLeapSerial shared(os);
+  shared.BufferSize = bufferSize;
+
+  auto start = high_resolution_clock::now();
+  for (size_t i = 0; i < nFrames; i++) {
+    ss.seekp(0);
+    frame.id = static_cast<int64_t>(i);
+    if (reuse) {
+      shared.Reset();
+      leap::SerializeWithArchive(shared, frame);
+    }
+    else {
+      leap::OArchiveLeapSerial ar(os);
+      ar.BufferSize = bufferSize;
+      leap::SerializeWithArchive(ar, frame);
+    }
+  }
+  return high_resolution_clock::now() - start;
+}
+
+int SmallFields::Benchmark(std::ostream& os) {
+  os << nFrames << " frames of " << sc_nFieldsPerFrame << " fields each" << std::endl;
+
+  static const size_t bufferSizes[] = { 0, 4 * 1024, 64 * 1024 };
+  for (bool reuse : { false, true })
+    for (size_t bufferSize : bufferSizes) {
+      os << "Staging buffer " << (bufferSize / 1024) << " KiB, "
+         << (reuse ? "reused archive" : "archive per frame") << ": " << std::flush;
+      auto duration = Write(bufferSize, reuse);
+      os << format_duration(duration) << " ("
+         << format_duration(duration / (nFrames * sc_nFieldsPerFrame)) << " per field)"
+         << std::endl;
+    }
+  return 0;
+}
@@ -0,0 +1,30 @@
+// Copyright (C) 2012-2018 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "Benchmark.h"
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+
+/// <summary>
+/// Measures the per-field cost of serializing frames made up of many small fields
+/// </summary>
+class SmallFields :
+  public IBenchmark
+{
+public:
+  SmallFields(void);
+
+private:
+  const size_t nFrames = 10 * 1000;
+
+  // Writes nFrames frames, either through a single archive that is reset between frames or through
+  // a new archive for each frame
+  std::chrono::nanoseconds Write(size_t bufferSize, bool reuse);
+
+public:
+  // Number of hands in each frame, and primitive fields written per frame
+  static const size_t sc_nHandsPerFrame = 64;
+  static const size_t sc_nFieldsPerFrame;
+
+  int Benchmark(std::ostream& os) override;
+};